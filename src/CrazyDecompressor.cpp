@@ -0,0 +1,932 @@
+#include "CrazyThreadPool.h"
+
+#include "CrazyDecompressor.h"
+
+#define DECOMPRESS_FLUSH_SIZE Megabytes(4)
+#define MAX_DECOMPRESS_THREADS 32
+#define INFLATE_FAST_BITS 9
+#define INFLATE_FAST_MASK ((1 << INFLATE_FAST_BITS) - 1)
+#define GZIP_MIN_MEMBER_SIZE 18
+#define LZ4_FRAME_MAGIC 0x184D2204
+#define LZ4_SKIPPABLE_FRAME_MAGIC 0x184D2A50
+#define ZSTD_FRAME_MAGIC 0xFD2FB528
+
+static uint32_t ReadU32LE(const uint8_t* pData)
+{
+	return (uint32_t)pData[0] | ((uint32_t)pData[1] << 8) | ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24);
+}
+
+CompressionType DetectCompression(const uint8_t* pData, size_t Size)
+{
+	if (Size >= 2 && pData[0] == 0x1F && pData[1] == 0x8B)
+		return CT_Gzip;
+
+	if (Size >= 4)
+	{
+		uint32_t Magic = ReadU32LE(pData);
+		if (Magic == LZ4_FRAME_MAGIC)
+			return CT_LZ4;
+
+		if (Magic == ZSTD_FRAME_MAGIC)
+			return CT_Zstd;
+	}
+
+	return CT_None;
+}
+
+static bool EnsureCapacity(DecompressSink* pSink, int Count)
+{
+	if (pSink->Size + Count <= pSink->Capacity)
+		return true;
+
+	return pSink->pGrowFunc && pSink->pGrowFunc(pSink, pSink->Size + Count);
+}
+
+static bool FlushIfNeeded(DecompressSink* pSink, bool bForce)
+{
+	if (!pSink->pFlushFunc)
+		return true;
+
+	if (!bForce && pSink->Size - pSink->FlushedSize < DECOMPRESS_FLUSH_SIZE)
+		return true;
+
+	pSink->FlushedSize = pSink->Size;
+	return pSink->pFlushFunc(pSink);
+}
+
+//=============================================================
+// Parallel decoding of independent blocks
+
+// A block that doesn't depend on any other, so it can be decoded by any thread.
+struct DecompressTask
+{
+	const uint8_t* pSrc;
+	int SrcSize;
+	int DestOffset;
+	int DestSize;
+	int DecodedSize;
+	bool bIsRaw;
+	bool bStartsFrame;
+	bool bIsLinked;
+	bool bSucceeded;
+};
+
+typedef bool (*DecodeTaskFunc)(DecompressTask* pTask, char* pDest);
+
+struct DecodeBatch
+{
+	DecompressTask* pTasks;
+	char* pDestBase;
+	DecodeTaskFunc pDecodeTaskFunc;
+};
+
+static void DecodeTaskMT(void* pUserData, int TaskIdx)
+{
+	DecodeBatch* pBatch = (DecodeBatch*)pUserData;
+	DecompressTask* pTask = &pBatch->pTasks[TaskIdx];
+	pTask->bSucceeded = pBatch->pDecodeTaskFunc(pTask, pBatch->pDestBase + pTask->DestOffset);
+}
+
+// Every task gets a slot of DestSize bytes, once a batch is decoded the slots are
+// packed together in case some task decoded less than its slot.
+static bool RunDecompressTasks(ImVector<DecompressTask>& vTasks, DecompressSink* pSink, ThreadPool* pPool, 
+                               int ExtraThreadCount, DecodeTaskFunc pDecodeTaskFunc)
+{
+	if (vTasks.Size == 0)
+		return true;
+
+	int64_t TotalSize = (int64_t)vTasks.back().DestOffset + vTasks.back().DestSize;
+	if (pSink->Size + TotalSize >= INT_MAX || !EnsureCapacity(pSink, (int)TotalSize))
+		return false;
+
+	int ThreadCount = ExtraThreadCount + 1;
+	int BaseSize = pSink->Size;
+	int TaskIdx = 0;
+
+	while (TaskIdx < vTasks.Size)
+	{
+		// Big enough to keep all the threads busy, small enough to publish often.
+		int BatchEnd = TaskIdx;
+		int64_t BatchSize = 0;
+		while (BatchEnd < vTasks.Size && BatchSize < DECOMPRESS_FLUSH_SIZE * ThreadCount)
+			BatchSize += vTasks[BatchEnd++].DestSize;
+
+		// The workers take the blocks one by one, so a big one doesn't hold the rest back.
+		char* pDestBase = pSink->pDest + BaseSize;
+		DecodeBatch Batch = { &vTasks[TaskIdx], pDestBase, pDecodeTaskFunc };
+		RunPoolTasks(pPool, DecodeTaskMT, &Batch, BatchEnd - TaskIdx, ExtraThreadCount);
+
+		for (int i = TaskIdx; i < BatchEnd; i++)
+		{
+			DecompressTask& Task = vTasks[i];
+			if (!Task.bSucceeded)
+				return false;
+
+			char* pDecoded = pDestBase + Task.DestOffset;
+			if (pDecoded != pSink->pDest + pSink->Size)
+				memmove(pSink->pDest + pSink->Size, pDecoded, Task.DecodedSize);
+
+			pSink->Size += Task.DecodedSize;
+		}
+
+		if (!FlushIfNeeded(pSink, true))
+			return false;
+
+		TaskIdx = BatchEnd;
+	}
+
+	return true;
+}
+
+//=============================================================
+// Inflate (RFC 1951)
+
+struct InflateHuffman
+{
+	uint16_t aFast[1 << INFLATE_FAST_BITS];
+	uint16_t aFirstCode[16];
+	uint16_t aFirstSymbol[16];
+	int aMaxCode[17];
+	uint8_t aSize[288];
+	uint16_t aValue[288];
+};
+
+struct InflateState
+{
+	const uint8_t* pIn;
+	const uint8_t* pInEnd;
+	uint64_t BitBuffer;
+	int BitCount;
+
+	// Zeros that we fed past the end of the input.
+	int FakeBytesCount;
+};
+
+static const uint16_t aInflateLengthBase[29] =
+{
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t aInflateLengthExtra[29] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t aInflateDistBase[30] =
+{
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t aInflateDistExtra[30] =
+{
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8_t aInflateCodeLengthOrder[19] =
+{
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static int ReverseBits16(int Value)
+{
+	Value = ((Value & 0xAAAA) >> 1) | ((Value & 0x5555) << 1);
+	Value = ((Value & 0xCCCC) >> 2) | ((Value & 0x3333) << 2);
+	Value = ((Value & 0xF0F0) >> 4) | ((Value & 0x0F0F) << 4);
+	Value = ((Value & 0xFF00) >> 8) | ((Value & 0x00FF) << 8);
+	return Value;
+}
+
+// Canonical huffman, the codes that fit in INFLATE_FAST_BITS are resolved with a single lookup.
+static bool BuildHuffman(InflateHuffman* pHuffman, const uint8_t* pSizes, int SymbolsCount)
+{
+	int aSizesCount[17] = { 0 };
+	int aNextCode[16];
+
+	memset(pHuffman->aFast, 0, sizeof(pHuffman->aFast));
+
+	for (int i = 0; i < SymbolsCount; i++)
+		aSizesCount[pSizes[i]]++;
+
+	aSizesCount[0] = 0;
+	for (int i = 1; i < 16; i++)
+	{
+		if (aSizesCount[i] > (1 << i))
+			return false;
+	}
+
+	int Code = 0;
+	int Symbol = 0;
+	for (int i = 1; i < 16; i++)
+	{
+		aNextCode[i] = Code;
+		pHuffman->aFirstCode[i] = (uint16_t)Code;
+		pHuffman->aFirstSymbol[i] = (uint16_t)Symbol;
+
+		Code += aSizesCount[i];
+		if (aSizesCount[i] && Code - 1 >= (1 << i))
+			return false;
+
+		// Preshifted, so the slow path can compare against the next 16 bits.
+		pHuffman->aMaxCode[i] = Code << (16 - i);
+		Code <<= 1;
+		Symbol += aSizesCount[i];
+	}
+
+	pHuffman->aMaxCode[16] = 0x10000;
+
+	for (int i = 0; i < SymbolsCount; i++)
+	{
+		int Size = pSizes[i];
+		if (Size == 0)
+			continue;
+
+		int Idx = aNextCode[Size] - pHuffman->aFirstCode[Size] + pHuffman->aFirstSymbol[Size];
+		pHuffman->aSize[Idx] = (uint8_t)Size;
+		pHuffman->aValue[Idx] = (uint16_t)i;
+
+		if (Size <= INFLATE_FAST_BITS)
+		{
+			uint16_t FastValue = (uint16_t)((Size << 9) | i);
+			for (int j = ReverseBits16(aNextCode[Size]) >> (16 - Size); j < (1 << INFLATE_FAST_BITS); j += (1 << Size))
+				pHuffman->aFast[j] = FastValue;
+		}
+
+		aNextCode[Size]++;
+	}
+
+	return true;
+}
+
+static inline void FillBits(InflateState* pState)
+{
+	if (pState->pInEnd - pState->pIn >= 8)
+	{
+		// Bits past BitCount are either zero or the same we are about to add, so this is safe.
+		uint64_t Bytes;
+		memcpy(&Bytes, pState->pIn, sizeof(Bytes));
+
+		int BytesCount = (64 - pState->BitCount) >> 3;
+		pState->BitBuffer |= Bytes << pState->BitCount;
+		pState->BitCount += BytesCount * 8;
+		pState->pIn += BytesCount;
+		return;
+	}
+
+	while (pState->BitCount <= 56)
+	{
+		uint64_t Byte = 0;
+		if (pState->pIn < pState->pInEnd)
+			Byte = *pState->pIn++;
+		else
+			pState->FakeBytesCount++;
+
+		pState->BitBuffer |= Byte << pState->BitCount;
+		pState->BitCount += 8;
+	}
+}
+
+static inline int GetBits(InflateState* pState, int Count)
+{
+	if (pState->BitCount < Count)
+		FillBits(pState);
+
+	int Value = (int)(pState->BitBuffer & ((1ull << Count) - 1));
+	pState->BitBuffer >>= Count;
+	pState->BitCount -= Count;
+	return Value;
+}
+
+static inline int DecodeSymbol(InflateState* pState, const InflateHuffman* pHuffman)
+{
+	if (pState->BitCount < 16)
+		FillBits(pState);
+
+	int FastValue = pHuffman->aFast[pState->BitBuffer & INFLATE_FAST_MASK];
+	if (FastValue)
+	{
+		int Size = FastValue >> 9;
+		pState->BitBuffer >>= Size;
+		pState->BitCount -= Size;
+		return FastValue & 511;
+	}
+
+	int Code = ReverseBits16((int)(pState->BitBuffer & 0xFFFF));
+	int Size = INFLATE_FAST_BITS + 1;
+	while (Size < 16 && Code >= pHuffman->aMaxCode[Size])
+		Size++;
+
+	if (Size >= 16)
+		return -1;
+
+	int Idx = (Code >> (16 - Size)) - pHuffman->aFirstCode[Size] + pHuffman->aFirstSymbol[Size];
+	if (Idx >= 288 || pHuffman->aSize[Idx] != Size)
+		return -1;
+
+	pState->BitBuffer >>= Size;
+	pState->BitCount -= Size;
+	return pHuffman->aValue[Idx];
+}
+
+static void ResetInput(InflateState* pState, const uint8_t* pIn, const uint8_t* pInEnd)
+{
+	pState->pIn = pIn;
+	pState->pInEnd = pInEnd;
+	pState->BitBuffer = 0;
+	pState->BitCount = 0;
+	pState->FakeBytesCount = 0;
+}
+
+// Drops the bits left of the current byte and gives back the whole bytes that were not used.
+static const uint8_t* GetInputPosition(InflateState* pState)
+{
+	int UnusedBytes = (pState->BitCount >> 3) - pState->FakeBytesCount;
+	return UnusedBytes >= 0 ? pState->pIn - UnusedBytes : nullptr;
+}
+
+static bool InflateStoredBlock(InflateState* pState, DecompressSink* pSink)
+{
+	const uint8_t* pIn = GetInputPosition(pState);
+	if (!pIn || pState->pInEnd - pIn < 4)
+		return false;
+
+	int Length = pIn[0] | (pIn[1] << 8);
+	int NegatedLength = pIn[2] | (pIn[3] << 8);
+	if (Length != (~NegatedLength & 0xFFFF))
+		return false;
+
+	pIn += 4;
+	if (pState->pInEnd - pIn < Length || !EnsureCapacity(pSink, Length))
+		return false;
+
+	memcpy(pSink->pDest + pSink->Size, pIn, Length);
+	pSink->Size += Length;
+
+	ResetInput(pState, pIn + Length, pState->pInEnd);
+
+	return FlushIfNeeded(pSink, false);
+}
+
+static bool InflateHuffmanBlock(InflateState* pState, DecompressSink* pSink, int StreamStart,
+                                const InflateHuffman* pLiterals, const InflateHuffman* pDistances)
+{
+	for (;;)
+	{
+		int Symbol = DecodeSymbol(pState, pLiterals);
+		if (Symbol < 0)
+		{
+			return false;
+		}
+		else if (Symbol < 256)
+		{
+			if (!EnsureCapacity(pSink, 1))
+				return false;
+
+			pSink->pDest[pSink->Size++] = (char)Symbol;
+		}
+		else if (Symbol == 256)
+		{
+			return true;
+		}
+		else
+		{
+			Symbol -= 257;
+			if (Symbol >= 29)
+				return false;
+
+			int Length = aInflateLengthBase[Symbol] + GetBits(pState, aInflateLengthExtra[Symbol]);
+
+			int DistSymbol = DecodeSymbol(pState, pDistances);
+			if (DistSymbol < 0 || DistSymbol >= 30)
+				return false;
+
+			int Distance = aInflateDistBase[DistSymbol] + GetBits(pState, aInflateDistExtra[DistSymbol]);
+			if (Distance > pSink->Size - StreamStart || !EnsureCapacity(pSink, Length))
+				return false;
+
+			char* pOut = pSink->pDest + pSink->Size;
+			const char* pMatch = pOut - Distance;
+			if (Distance >= Length)
+			{
+				memcpy(pOut, pMatch, Length);
+			}
+			else
+			{
+				for (int i = 0; i < Length; i++)
+					pOut[i] = pMatch[i];
+			}
+
+			pSink->Size += Length;
+		}
+
+		// We are already decoding the zeros past the end of the input.
+		if (pState->BitCount < pState->FakeBytesCount * 8)
+			return false;
+
+		if (!FlushIfNeeded(pSink, false))
+			return false;
+	}
+}
+
+static bool ReadDynamicHuffman(InflateState* pState, InflateHuffman* pLiterals, InflateHuffman* pDistances)
+{
+	int LiteralsCount = GetBits(pState, 5) + 257;
+	int DistancesCount = GetBits(pState, 5) + 1;
+	int CodeLengthsCount = GetBits(pState, 4) + 4;
+
+	uint8_t aCodeLengthSizes[19] = { 0 };
+	for (int i = 0; i < CodeLengthsCount; i++)
+		aCodeLengthSizes[aInflateCodeLengthOrder[i]] = (uint8_t)GetBits(pState, 3);
+
+	InflateHuffman CodeLengths;
+	if (!BuildHuffman(&CodeLengths, aCodeLengthSizes, 19))
+		return false;
+
+	uint8_t aSizes[288 + 32];
+	int TotalCount = LiteralsCount + DistancesCount;
+	int SizesCount = 0;
+	while (SizesCount < TotalCount)
+	{
+		int Symbol = DecodeSymbol(pState, &CodeLengths);
+		if (Symbol < 0 || Symbol >= 19)
+			return false;
+
+		if (Symbol < 16)
+		{
+			aSizes[SizesCount++] = (uint8_t)Symbol;
+			continue;
+		}
+
+		uint8_t Fill = 0;
+		int Repeat = 0;
+		if (Symbol == 16)
+		{
+			if (SizesCount == 0)
+				return false;
+
+			Fill = aSizes[SizesCount - 1];
+			Repeat = 3 + GetBits(pState, 2);
+		}
+		else if (Symbol == 17)
+		{
+			Repeat = 3 + GetBits(pState, 3);
+		}
+		else
+		{
+			Repeat = 11 + GetBits(pState, 7);
+		}
+
+		if (SizesCount + Repeat > TotalCount)
+			return false;
+
+		memset(&aSizes[SizesCount], Fill, Repeat);
+		SizesCount += Repeat;
+	}
+
+	// Without the end of block code we would never stop.
+	if (aSizes[256] == 0)
+		return false;
+
+	return BuildHuffman(pLiterals, aSizes, LiteralsCount) &&
+		BuildHuffman(pDistances, &aSizes[LiteralsCount], DistancesCount);
+}
+
+// Inflates a whole deflate stream, pState is left right after it.
+static bool Inflate(InflateState* pState, DecompressSink* pSink)
+{
+	InflateHuffman Literals;
+	InflateHuffman Distances;
+	int StreamStart = pSink->Size;
+	int bIsFinalBlock = 0;
+
+	do
+	{
+		bIsFinalBlock = GetBits(pState, 1);
+		int BlockType = GetBits(pState, 2);
+
+		if (BlockType == 0)
+		{
+			if (!InflateStoredBlock(pState, pSink))
+				return false;
+		}
+		else if (BlockType == 1)
+		{
+			uint8_t aSizes[288];
+			memset(&aSizes[0], 8, 144);
+			memset(&aSizes[144], 9, 112);
+			memset(&aSizes[256], 7, 24);
+			memset(&aSizes[280], 8, 8);
+			BuildHuffman(&Literals, aSizes, 288);
+
+			memset(aSizes, 5, 30);
+			BuildHuffman(&Distances, aSizes, 30);
+
+			if (!InflateHuffmanBlock(pState, pSink, StreamStart, &Literals, &Distances))
+				return false;
+		}
+		else if (BlockType == 2)
+		{
+			if (!ReadDynamicHuffman(pState, &Literals, &Distances) ||
+				!InflateHuffmanBlock(pState, pSink, StreamStart, &Literals, &Distances))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+
+	} while (!bIsFinalBlock);
+
+	return GetInputPosition(pState) != nullptr;
+}
+
+//=============================================================
+// Gzip (RFC 1952)
+
+// Returns where the deflate stream starts, pOutMemberSize is only known for BGZF members.
+static const uint8_t* ParseGzipHeader(const uint8_t* pIn, const uint8_t* pInEnd, int* pOutMemberSize)
+{
+	*pOutMemberSize = 0;
+
+	if (pInEnd - pIn < GZIP_MIN_MEMBER_SIZE || pIn[0] != 0x1F || pIn[1] != 0x8B || pIn[2] != 8)
+		return nullptr;
+
+	uint8_t Flags = pIn[3];
+	const uint8_t* pCursor = pIn + 10;
+
+	// FEXTRA
+	if (Flags & 4)
+	{
+		int ExtraSize = pCursor[0] | (pCursor[1] << 8);
+		pCursor += 2;
+		if (pInEnd - pCursor < ExtraSize)
+			return nullptr;
+
+		// BGZF stores the size of the member, with that we can find all of them without inflating.
+		const uint8_t* pExtraEnd = pCursor + ExtraSize;
+		for (const uint8_t* pField = pCursor; pExtraEnd - pField >= 4; pField += 4 + (pField[2] | (pField[3] << 8)))
+		{
+			if (pField[0] == 'B' && pField[1] == 'C' && pField[2] == 2 && pField[3] == 0 && pExtraEnd - pField >= 6)
+				*pOutMemberSize = (pField[4] | (pField[5] << 8)) + 1;
+		}
+
+		pCursor = pExtraEnd;
+	}
+
+	// FNAME and FCOMMENT are null terminated
+	for (int Flag = 8; Flag <= 16; Flag <<= 1)
+	{
+		if (Flags & Flag)
+		{
+			while (pCursor < pInEnd && *pCursor != 0)
+				pCursor++;
+
+			pCursor++;
+		}
+	}
+
+	// FHCRC
+	if (Flags & 2)
+		pCursor += 2;
+
+	return pCursor < pInEnd ? pCursor : nullptr;
+}
+
+static bool DecodeGzipTask(DecompressTask* pTask, char* pDest)
+{
+	DecompressSink Sink = { 0 };
+	Sink.pDest = pDest;
+	Sink.Capacity = pTask->DestSize;
+
+	InflateState State;
+	ResetInput(&State, pTask->pSrc, pTask->pSrc + pTask->SrcSize);
+
+	pTask->DecodedSize = 0;
+	if (!Inflate(&State, &Sink) || Sink.Size != pTask->DestSize)
+		return false;
+
+	pTask->DecodedSize = Sink.Size;
+	return true;
+}
+
+// Only possible with BGZF, every member is a task and the trailers tell us their decoded size.
+static bool CollectGzipTasks(const uint8_t* pSrc, size_t SrcSize, ImVector<DecompressTask>& vTasks)
+{
+	const uint8_t* pIn = pSrc;
+	const uint8_t* pInEnd = pSrc + SrcSize;
+	int64_t DestOffset = 0;
+
+	while (pInEnd - pIn >= GZIP_MIN_MEMBER_SIZE && pIn[0] == 0x1F && pIn[1] == 0x8B)
+	{
+		int MemberSize = 0;
+		const uint8_t* pStream = ParseGzipHeader(pIn, pInEnd, &MemberSize);
+		if (!pStream || MemberSize == 0 || pInEnd - pIn < MemberSize || pIn + MemberSize - 8 < pStream)
+			return false;
+
+		const uint8_t* pTrailer = pIn + MemberSize - 8;
+
+		DecompressTask Task = { 0 };
+		Task.pSrc = pStream;
+		Task.SrcSize = (int)(pTrailer - pStream);
+		Task.DestOffset = (int)DestOffset;
+		Task.DestSize = (int)ReadU32LE(pTrailer + 4);
+		vTasks.push_back(Task);
+
+		DestOffset += Task.DestSize;
+		if (Task.DestSize < 0 || DestOffset >= INT_MAX)
+			return false;
+
+		pIn += MemberSize;
+	}
+
+	return vTasks.Size > 0;
+}
+
+static bool DecompressGzip(const uint8_t* pSrc, size_t SrcSize, DecompressSink* pSink, ThreadPool* pPool, int ExtraThreadCount)
+{
+	const uint8_t* pIn = pSrc;
+	const uint8_t* pInEnd = pSrc + SrcSize;
+
+	int MemberSize = 0;
+	if (!ParseGzipHeader(pIn, pInEnd, &MemberSize))
+		return false;
+
+	if (MemberSize > 0 && ExtraThreadCount > 0)
+	{
+		ImVector<DecompressTask> vTasks;
+		if (CollectGzipTasks(pSrc, SrcSize, vTasks))
+			return RunDecompressTasks(vTasks, pSink, pPool, ExtraThreadCount, DecodeGzipTask);
+	}
+
+	// NOTE(matiasp): The trailer of the last member has its size, with a single member (the usual case)
+	// that is the whole thing, otherwise it's just a starting point and we grow from there.
+	uint32_t LastMemberSize = ReadU32LE(pInEnd - 4);
+	if (LastMemberSize < (uint32_t)(INT_MAX - pSink->Size - 1))
+		EnsureCapacity(pSink, (int)LastMemberSize + 1);
+
+	while (pInEnd - pIn >= GZIP_MIN_MEMBER_SIZE && pIn[0] == 0x1F && pIn[1] == 0x8B)
+	{
+		const uint8_t* pStream = ParseGzipHeader(pIn, pInEnd, &MemberSize);
+		if (!pStream)
+			return false;
+
+		InflateState State;
+		ResetInput(&State, pStream, pInEnd);
+
+		int MemberStart = pSink->Size;
+		if (!Inflate(&State, pSink))
+			return false;
+
+		pIn = GetInputPosition(&State);
+		if (pInEnd - pIn < 8 || ReadU32LE(pIn + 4) != (uint32_t)(pSink->Size - MemberStart))
+			return false;
+
+		pIn += 8;
+	}
+
+	return FlushIfNeeded(pSink, true);
+}
+
+//=============================================================
+// LZ4 frame format
+
+// HistorySize is how many bytes before pDest the matches can reference.
+static bool DecodeLZ4Block(const uint8_t* pSrc, int SrcSize, char* pDest, int DestCapacity, int HistorySize, int* pOutSize)
+{
+	const uint8_t* pIn = pSrc;
+	const uint8_t* pInEnd = pSrc + SrcSize;
+	char* pOut = pDest;
+	char* pOutEnd = pDest + DestCapacity;
+	const char* pLowest = pDest - HistorySize;
+
+	while (pIn < pInEnd)
+	{
+		int Token = *pIn++;
+
+		int LiteralLength = Token >> 4;
+		if (LiteralLength == 15)
+		{
+			int Byte = 255;
+			while (Byte == 255 && pIn < pInEnd)
+			{
+				Byte = *pIn++;
+				LiteralLength += Byte;
+			}
+		}
+
+		if (pInEnd - pIn < LiteralLength || pOutEnd - pOut < LiteralLength)
+			return false;
+
+		memcpy(pOut, pIn, LiteralLength);
+		pOut += LiteralLength;
+		pIn += LiteralLength;
+
+		// The last sequence only has literals.
+		if (pIn == pInEnd)
+			break;
+
+		if (pInEnd - pIn < 2)
+			return false;
+
+		int Offset = pIn[0] | (pIn[1] << 8);
+		pIn += 2;
+
+		if (Offset == 0 || pOut - pLowest < Offset)
+			return false;
+
+		int MatchLength = (Token & 15) + 4;
+		if ((Token & 15) == 15)
+		{
+			int Byte = 255;
+			while (Byte == 255 && pIn < pInEnd)
+			{
+				Byte = *pIn++;
+				MatchLength += Byte;
+			}
+		}
+
+		if (pOutEnd - pOut < MatchLength)
+			return false;
+
+		const char* pMatch = pOut - Offset;
+		if (Offset >= MatchLength)
+		{
+			memcpy(pOut, pMatch, MatchLength);
+		}
+		else
+		{
+			for (int i = 0; i < MatchLength; i++)
+				pOut[i] = pMatch[i];
+		}
+
+		pOut += MatchLength;
+	}
+
+	*pOutSize = (int)(pOut - pDest);
+	return true;
+}
+
+static bool DecodeLZ4Task(DecompressTask* pTask, char* pDest)
+{
+	if (pTask->bIsRaw)
+	{
+		memcpy(pDest, pTask->pSrc, pTask->SrcSize);
+		pTask->DecodedSize = pTask->SrcSize;
+		return true;
+	}
+
+	return DecodeLZ4Block(pTask->pSrc, pTask->SrcSize, pDest, pTask->DestSize, 0, &pTask->DecodedSize);
+}
+
+// Walks all the frames and their blocks, the blocks sizes are in the headers so this is cheap.
+static bool CollectLZ4Tasks(const uint8_t* pSrc, size_t SrcSize, ImVector<DecompressTask>& vTasks, bool* pOutAllIndependent)
+{
+	const uint8_t* pIn = pSrc;
+	const uint8_t* pInEnd = pSrc + SrcSize;
+	int64_t DestOffset = 0;
+	*pOutAllIndependent = true;
+
+	while (pInEnd - pIn >= 4)
+	{
+		uint32_t Magic = ReadU32LE(pIn);
+		if ((Magic & 0xFFFFFFF0) == LZ4_SKIPPABLE_FRAME_MAGIC)
+		{
+			if (pInEnd - pIn < 8 || (uint64_t)(pInEnd - pIn - 8) < ReadU32LE(pIn + 4))
+				return false;
+
+			pIn += 8 + ReadU32LE(pIn + 4);
+			continue;
+		}
+
+		// Anything after the frames is not ours.
+		if (Magic != LZ4_FRAME_MAGIC || pInEnd - pIn < 7)
+			break;
+
+		uint8_t Flags = pIn[4];
+		uint8_t BlockDescriptor = pIn[5];
+		if ((Flags >> 6) != 1)
+			return false;
+
+		int BlockMaxSizeId = (BlockDescriptor >> 4) & 7;
+		if (BlockMaxSizeId < 4)
+			return false;
+
+		bool bIndependentBlocks = (Flags & 0x20) != 0;
+		bool bBlockChecksum = (Flags & 0x10) != 0;
+		bool bContentChecksum = (Flags & 0x04) != 0;
+		int BlockMaxSize = 1 << (8 + 2 * BlockMaxSizeId);
+
+		// Magic + FLG + BD + optional content size + optional dict id + HC
+		pIn += 4 + 2 + ((Flags & 0x08) ? 8 : 0) + ((Flags & 0x01) ? 4 : 0) + 1;
+		if (!bIndependentBlocks)
+			*pOutAllIndependent = false;
+
+		bool bStartsFrame = true;
+		for (;;)
+		{
+			if (pInEnd - pIn < 4)
+				return false;
+
+			uint32_t BlockSize = ReadU32LE(pIn);
+			pIn += 4;
+
+			if (BlockSize == 0)
+				break;
+
+			bool bIsRaw = (BlockSize & 0x80000000) != 0;
+			BlockSize &= 0x7FFFFFFF;
+			if (BlockSize > (uint32_t)BlockMaxSize || (uint64_t)(pInEnd - pIn) < BlockSize)
+				return false;
+
+			DecompressTask Task = { 0 };
+			Task.pSrc = pIn;
+			Task.SrcSize = (int)BlockSize;
+			Task.DestOffset = (int)DestOffset;
+			Task.DestSize = bIsRaw ? (int)BlockSize : BlockMaxSize;
+			Task.bIsRaw = bIsRaw;
+			Task.bStartsFrame = bStartsFrame;
+			Task.bIsLinked = !bIndependentBlocks;
+			vTasks.push_back(Task);
+
+			DestOffset += Task.DestSize;
+			if (DestOffset >= INT_MAX)
+				return false;
+
+			bStartsFrame = false;
+			pIn += BlockSize + (bBlockChecksum ? 4 : 0);
+		}
+
+		pIn += bContentChecksum ? 4 : 0;
+	}
+
+	return pIn <= pInEnd && vTasks.Size > 0;
+}
+
+static bool DecompressLZ4(const uint8_t* pSrc, size_t SrcSize, DecompressSink* pSink, ThreadPool* pPool, int ExtraThreadCount)
+{
+	ImVector<DecompressTask> vTasks;
+	bool bAllIndependent = true;
+	if (!CollectLZ4Tasks(pSrc, SrcSize, vTasks, &bAllIndependent))
+		return false;
+
+	if (bAllIndependent && ExtraThreadCount > 0)
+		return RunDecompressTasks(vTasks, pSink, pPool, ExtraThreadCount, DecodeLZ4Task);
+
+	// Linked blocks can reference the previous ones, so those go one after the other.
+	int64_t TotalSize = (int64_t)vTasks.back().DestOffset + vTasks.back().DestSize;
+	if (pSink->Size + TotalSize >= INT_MAX || !EnsureCapacity(pSink, (int)TotalSize))
+		return false;
+
+	int FrameStart = pSink->Size;
+	for (int i = 0; i < vTasks.Size; i++)
+	{
+		DecompressTask& Task = vTasks[i];
+		if (Task.bStartsFrame)
+			FrameStart = pSink->Size;
+
+		int DecodedSize = 0;
+		if (Task.bIsRaw)
+		{
+			memcpy(pSink->pDest + pSink->Size, Task.pSrc, Task.SrcSize);
+			DecodedSize = Task.SrcSize;
+		}
+		else
+		{
+			int HistorySize = Task.bIsLinked ? pSink->Size - FrameStart : 0;
+			if (!DecodeLZ4Block(Task.pSrc, Task.SrcSize, pSink->pDest + pSink->Size, Task.DestSize, HistorySize, &DecodedSize))
+				return false;
+		}
+
+		pSink->Size += DecodedSize;
+
+		if (!FlushIfNeeded(pSink, false))
+			return false;
+	}
+
+	return FlushIfNeeded(pSink, true);
+}
+
+bool Decompress(CompressionType Type, const uint8_t* pSrc, size_t SrcSize, DecompressSink* pSink, ThreadPool* pPool, 
+                int ExtraThreadCount)
+{
+	if (ExtraThreadCount > MAX_DECOMPRESS_THREADS - 1)
+		ExtraThreadCount = MAX_DECOMPRESS_THREADS - 1;
+
+	switch (Type)
+	{
+		case CT_Gzip: return DecompressGzip(pSrc, SrcSize, pSink, pPool, ExtraThreadCount);
+		case CT_LZ4: return DecompressLZ4(pSrc, SrcSize, pSink, pPool, ExtraThreadCount);
+
+		// NOTE(matiasp): Zstd is detected but not supported, the format is way too big to carry our own decoder.
+		default: return false;
+	}
+}
+
+#undef DECOMPRESS_FLUSH_SIZE
+#undef MAX_DECOMPRESS_THREADS
+#undef INFLATE_FAST_BITS
+#undef INFLATE_FAST_MASK
+#undef GZIP_MIN_MEMBER_SIZE
+#undef LZ4_FRAME_MAGIC
+#undef LZ4_SKIPPABLE_FRAME_MAGIC
+#undef ZSTD_FRAME_MAGIC
@@ -0,0 +1,36 @@
+#pragma once
+
+enum CompressionType
+{
+	CT_None = 0,
+	CT_Gzip,
+	CT_LZ4,
+	CT_Zstd,
+
+	CT_COUNT
+};
+
+// The decoders write straight into pDest, the owner can grow it and consume what
+// was decoded so far while the decoding keeps going.
+struct DecompressSink
+{
+	char* pDest;
+	int Capacity;
+	int Size;
+	int FlushedSize;
+	void* pUserData;
+
+	// Has to make room for at least RequiredCapacity bytes keeping the content.
+	bool (*pGrowFunc)(DecompressSink* pSink, int RequiredCapacity);
+
+	// Called every time a chunk is decoded, returning false cancels the decoding.
+	bool (*pFlushFunc)(DecompressSink* pSink);
+};
+
+struct ThreadPool;
+
+CompressionType DetectCompression(const uint8_t* pData, size_t Size);
+
+// The independent blocks are decoded on at most ExtraThreadCount workers of pPool.
+bool Decompress(CompressionType Type, const uint8_t* pSrc, size_t SrcSize, DecompressSink* pSink, ThreadPool* pPool, 
+                int ExtraThreadCount);
@@ -16,9 +16,46 @@
 #define VERSION_FILE_NAME "VERSION.txt"
 #define FILE_FETCH_INTERVAL 0.5f
 #define FOLDER_FETCH_INTERVAL 2.f
+#define WATCHED_FILE_FETCH_INTERVAL 5.f
 #define CONSOLAS_FONT_SIZE 14 
 #define MAX_EXTRA_THREADS 31
 #define MAX_REMEMBER_PATHS 5
+#define SPARSE_LINE_INDEX_INTERVAL 64
+#define MAX_SPARSE_LINE_INDEX_INTERVAL 1024
+#define SPLIT_LINE_SIZE_KB 64
+#define MIN_SPLIT_LINE_SIZE_KB 4
+#define MAX_SPLIT_LINE_SIZE_KB 16384
+#define LOAD_FILE_CHUNK_SIZE Megabytes(16)
+#define FETCH_FILE_CHUNK_SIZE Megabytes(1)
+#define SAVE_FILE_BATCH_LINES 65536
+#define GATHER_MIN_LINES_PER_THREAD 8192
+#define GATHER_PROGRESS_LINES 4096
+#define BACKGROUND_COPY_MIN_LINES 262144
+#define MAX_COPY_SIZE_MB 4096
+#define FOLDER_FILES_RESERVE 64
+#define STREAM_FILE_START_CHECK_SIZE 64
+#define TEXT_ENCODING_SAMPLE_SIZE 1024
+#define UTF16_TRANSCODE_SLICE_SIZE Kilobytes(256)
+#define LOAD_PIPELINE_DEPTH 2
+#define FILTER_CHUNK_SIZE Kilobytes(256)
+#define SIDECAR_INDEX_EXTENSION ".ctidx"
+#define SIDECAR_INDEX_MAGIC 0x58495443 // CTIX
+#define SIDECAR_INDEX_VERSION 2
+#define SIDECAR_MAX_FILTERS 8
+#define SIDECAR_SAMPLED_BLOCKS_COUNT 16
+#define SIDECAR_SAMPLED_BLOCK_SIZE Kilobytes(4)
+#define FILTER_MIN_PARALLEL_SECONDS 0.0002f
+#define FILTER_MIN_MEASURE_SIZE Kilobytes(64)
+#define FILTER_MAX_BLOCKING_SECONDS 0.004f
+#define FILTER_JOB_BATCH_CHUNKS 4
+#define FIND_SLICE_LINES 4096
+#define FIND_FRAME_SECONDS 0.008f
+#define FIND_TYPING_DELAY 0.15f
+#define HIGHLIGHT_CACHE_LINES 512
+#define HIGHLIGHT_WHOLE_LINE_SIZE 16384
+#define HIGHLIGHT_WINDOW_MARGIN 4096
+#define THREAD_COUNT_KNEE_RATIO 0.9f
+#define THREAD_COUNT_REGRESSION_RATIO 0.75f
 
 #define max(a,b) (((a) > (b)) ? (a) : (b))
 #define min(a,b) (((a) < (b)) ? (a) : (b))
@@ -55,9 +92,11 @@ void CrazyLog::Init(PlatformContext* pPlatformCtx)
 	SelectionSize = 1.f;
 	FileContentFetchCooldown = -1.f;
 	FolderFetchCooldown = -1.f;
+	FindTypingCooldown = -1.f;
 	PeekScrollValue = -1.f;
 	FindScrollValue = -1.f;
 	FiltredScrollValue = -1.f;
+	FilterSecondsPerByte = 0.000000001f;
 	EnableMask = 0xFFFFFFFF;
 	ImGui::StyleColorsClassic();
 	
@@ -65,6 +104,10 @@ void CrazyLog::Init(PlatformContext* pPlatformCtx)
 	style->Colors[ImGuiCol_MenuBarBg] = style->Colors[ImGuiCol_FrameBg];
 	
 	FileContentFetchSlider = FILE_FETCH_INTERVAL;
+	SparseLineIndexInterval = SPARSE_LINE_INDEX_INTERVAL;
+	SplitLineSizeKB = SPLIT_LINE_SIZE_KB;
+	LineIndexStride = 1;
+	LastResolvedLineNo = -1;
 	MaxExtraThreadCount = max(0, std::thread::hardware_concurrency() - 1);
 
 	bShouldRememberLastSession = true;
@@ -73,6 +116,10 @@ void CrazyLog::Init(PlatformContext* pPlatformCtx)
 	bIsMultithreadEnabled = true;
 	SelectedExtraThreadCount = clamp(3, MaxExtraThreadCount, 0);
 	
+	// Until the settings say it was already tuned on this machine.
+	bIsAutoThreadCountEnabled = true;
+	bWantsToTuneThreadCount = true;
+	
 	for (unsigned i = 0; i < RITT_COUNT; ++i)
 	{
 		avRecentInputText[i].resize(MAX_REMEMBER_PATHS, { 0 });
@@ -80,13 +127,44 @@ void CrazyLog::Init(PlatformContext* pPlatformCtx)
 	}
 	
 	bIsAVXEnabled = true;
+	bIsLineSplitEnabled = true;
+	bIsMemoryMappingEnabled = true;
 	
 	GetVersions(pPlatformCtx);
 	SetLastCommand("LAST COMMAND");
 }
 
+void CrazyLog::Shutdown(PlatformContext* pPlatformCtx)
+{
+	// Every job runs its tasks on the pool, none can be left running once it stops.
+	CancelSaveFile();
+	CancelCopyLines();
+	CancelFilterLines();
+	CancelLoadFile();
+	SaveSidecarIndex(pPlatformCtx);
+	StopThreadPool(&WorkerPool);
+	
+	if (LoadJob.pReadAheadMutex)
+	{
+		IM_DELETE(LoadJob.pReadAheadChanged);
+		IM_DELETE(LoadJob.pReadAheadMutex);
+		LoadJob.pReadAheadChanged = nullptr;
+		LoadJob.pReadAheadMutex = nullptr;
+	}
+	
+	ClearHighlightCache();
+	HighlightCache.vNeedles.clear();
+}
+
 void CrazyLog::Clear()
 {
+	CancelSaveFile();
+	CancelCopyLines();
+	CancelFilterLines();
+	CancelLoadFile();
+	CloseStreamFile();
+	UnmapLog(false);
+	
 	bIsPeeking = false;
 	bFileLoaded = false;
 	bWantsToSavePreset = false;
@@ -94,9 +172,14 @@ void CrazyLog::Clear()
 	Buf.clear();
 	vLineOffsets.clear();
 	vLineOffsets.push_back(0);
+	vSplitLines.clear();
+	vLogSegments.clear();
+	LinesCount = 1;
+	LastResolvedLineNo = -1;
 
 	ClearCache();
 	ClearFindCache(false);
+	ClearHighlightCache();
 	
 	SetLastCommand("LOG CLEARED");
 }
@@ -150,31 +233,225 @@ void CrazyLog::LoadClipboard()
 	LastChangeReason = TMCR_PasteFromClipboard;
 }
 
-bool CrazyLog::FetchFile(PlatformContext* pPlatformCtx) 
+bool CrazyLog::FetchFile(PlatformContext* pPlatformCtx, bool bCheckIdentity) 
 {
-	if (aFilePathToLoad[0] == 0)
+	// There is no way to stream the compressed files.
+	if (aFilePathToLoad[0] == 0 || bIsLoadingFile || bIsSavingFile || bIsCopyingLines || bIsFilteringLines || 
+	    LoadJob.Compression != CT_None)
 		return false;
 	
-	// IMP(matiasp): 
-	// Avoid virtual alloc, use scratch alloc.
-	// keep the file open to avoid read/alloc the entire content.
-	FileContent File = pPlatformCtx->pReadFileFunc(aFilePathToLoad);
-	bool bNewContent = false;
-	if(File.pFile)
+	// NOTE(matiasp): Asking the handle we already have is way cheaper than opening the file by its path and 
+	// reading its start, so if nothing was appended we are done unless we were told it could have been replaced.
+	if (pStreamFileHandle && !bCheckIdentity)
 	{
-		bNewContent = ((int)File.Size - LastFetchFileSize) > 0;
-		if (bNewContent) {
-			AddLog((const char*)File.pFile + LastFetchFileSize, (int)File.Size - LastFetchFileSize);
-			LastFetchFileSize = (int)File.Size;
-		}
+		uint64_t OpenFileSize = 0;
+		if (pPlatformCtx->pGetOpenFileSizeFunc(pStreamFileHandle, &OpenFileSize) && OpenFileSize == (uint64_t)LastFetchFileSize)
+			return false;
+	}
+	
+	// It could be in the middle of being replaced, we will look again in the next fetch.
+	FileIdentity CurrentIdentity = { 0 };
+	if (!pPlatformCtx->pGetFileIdentityFunc(aFilePathToLoad, &CurrentIdentity))
+		return false;
+	
+	// The handle we have keeps pointing to the old file.
+	bool bWasReplaced = CurrentIdentity.FileId != StreamFileIdentity.FileId || 
+		CurrentIdentity.CreationTime != StreamFileIdentity.CreationTime;
+	if (bWasReplaced)
+		CloseStreamFile();
+	
+	// Keep the file open between fetches, so each one only reads what was appended since the last one.
+	if (!pStreamFileHandle)
+	{
+		size_t FileSize = 0;
+		pStreamFileHandle = pPlatformCtx->pOpenFileFunc(aFilePathToLoad, &FileSize);
+		pCloseFileFunc = pPlatformCtx->pCloseFileFunc;
 		
-		pPlatformCtx->pFreeFileContentFunc(&File);
+		if (!pStreamFileHandle)
+			return false;
+	}
+	
+	UnmapLog(true);
+	
+	bool bWasTruncated = !bWasReplaced && 
+		(CurrentIdentity.Size < (uint64_t)LastFetchFileSize || HasStreamFileStartChanged(pPlatformCtx));
+	
+	if (bWasReplaced || bWasTruncated)
+	{
+		StreamFileIdentity = CurrentIdentity;
+		
+		// The rotated files could have changed too, so the whole set is loaded again.
+		if (vLogSegments.Size > 0)
+			return LoadFolderFiles(pPlatformCtx);
+		
+		ResetStreamedLog();
+		DetectStreamFileEncoding(pPlatformCtx);
+		SetLastCommand(bWasReplaced ? "FILE REPLACED, STREAMING IT AGAIN" : "FILE TRUNCATED, STREAMING IT AGAIN");
 	}
 	
+	// NOTE(matiasp): Same limit as loading it, the line offsets would wrap once the log gets to 2GB.
+	// UTF-16 can take up to one and a half times as much once transcoded.
+	int64_t AppendedSize = (int64_t)CurrentIdentity.Size - LastFetchFileSize;
+	int64_t GrownSize = (int64_t)Buf.size() + (LogEncoding == TE_UTF8 ? AppendedSize : AppendedSize * 2) + (int64_t)FETCH_FILE_CHUNK_SIZE;
+	if (CurrentIdentity.Size >= INT_MAX || GrownSize >= INT_MAX)
+	{
+		SetLastCommand("FILES OF 2GB OR MORE ARE NOT SUPPORTED");
+		return false;
+	}
+	
+	int OldSize = Buf.size();
+	int ContentSize = OldSize;
+	size_t BytesRead = 0;
+	do
+	{
+		BytesRead = ReadStreamFileChunk(pPlatformCtx, &ContentSize);
+	} while (BytesRead == FETCH_FILE_CHUNK_SIZE);
+	
+	Buf.Buf[ContentSize] = 0;
+	
+	bool bNewContent = ContentSize > OldSize;
+	if (bNewContent)
+	{
+		IndexLines(OldSize);
+		bAlreadyCached = false;
+	}
 	
 	return bNewContent;
 }
 
+// Appends to the log the next chunk of the streamed file, returns how many bytes of the file were read.
+size_t CrazyLog::ReadStreamFileChunk(PlatformContext* pPlatformCtx, int* pContentSize)
+{
+	int ContentSize = *pContentSize;
+	
+	if (LogEncoding == TE_UTF8)
+	{
+		// Read straight into the end of the log buffer, the null terminator gets stomped and written back after.
+		int RequiredCapacity = ContentSize + (int)FETCH_FILE_CHUNK_SIZE + 1;
+		if (RequiredCapacity > Buf.Buf.Capacity)
+			Buf.Buf.reserve(Buf.Buf._grow_capacity(RequiredCapacity));
+		
+		size_t BytesRead = pPlatformCtx->pReadFileChunkFunc(pStreamFileHandle, LastFetchFileSize, 
+		                                                    Buf.Buf.Data + ContentSize, FETCH_FILE_CHUNK_SIZE);
+		
+		// The invalid UTF-8 gets replaced once it's indexed, so keep how the start was before that.
+		if (LastFetchFileSize == LogBOMSize)
+			KeepStreamFileStart(Buf.Buf.Data + ContentSize, (int)BytesRead);
+		
+		// Keep the size updated so growing the buffer carries over what we already read.
+		*pContentSize = ContentSize + (int)BytesRead;
+		LastFetchFileSize += (int)BytesRead;
+		Buf.Buf.Size = *pContentSize + 1;
+		
+		return BytesRead;
+	}
+	
+	// UTF-16 goes through a scratch buffer first, the log only gets the transcoded text.
+	vStreamTranscodeBuf.resize((int)FETCH_FILE_CHUNK_SIZE);
+	size_t BytesRead = pPlatformCtx->pReadFileChunkFunc(pStreamFileHandle, LastFetchFileSize, 
+	                                                    vStreamTranscodeBuf.Data, FETCH_FILE_CHUNK_SIZE);
+	
+	// Worst case every code unit turns into 3 bytes, plus the room the transcoding wants for the last one.
+	int RequiredCapacity = ContentSize + ((int)BytesRead / 2) * 3 + 4 + 1;
+	if (RequiredCapacity > Buf.Buf.Capacity)
+		Buf.Buf.reserve(Buf.Buf._grow_capacity(RequiredCapacity));
+	
+	int TranscodedSize = 0;
+	int ConsumedSize = TranscodeUTF16ToUTF8(vStreamTranscodeBuf.Data, (int)BytesRead, Buf.Buf.Data + ContentSize, 
+	                                        Buf.Buf.Capacity - ContentSize - 1, &TranscodedSize, LogEncoding, false, bIsAVXEnabled);
+	
+	// A pair cut by the writer is read again in the next fetch.
+	*pContentSize = ContentSize + TranscodedSize;
+	LastFetchFileSize += ConsumedSize;
+	Buf.Buf.Size = *pContentSize + 1;
+	
+	return BytesRead;
+}
+
+// Catches the file being truncated and written again past the size we had before we looked at it.
+bool CrazyLog::HasStreamFileStartChanged(PlatformContext* pPlatformCtx)
+{
+	// The transcoded text can't be compared with the file, only the size tells.
+	if (LogEncoding != TE_UTF8)
+		return false;
+	
+	char aFileStart[STREAM_FILE_START_CHECK_SIZE];
+	int CheckSize = min((int)sizeof(aFileStart), LastFetchFileSize - LogBOMSize);
+	if (CheckSize < StreamFileStartSize)
+		return true;
+	
+	if (CheckSize <= 0)
+		return false;
+	
+	// NOTE(matiasp): The log could have the invalid UTF-8 of the start already replaced, so the file is 
+	// compared with the hash of what was read from it. When the loaded log had some replaced that's 
+	// not known, so what the file has now is the best there is.
+	size_t BytesRead = pPlatformCtx->pReadFileChunkFunc(pStreamFileHandle, LogBOMSize, aFileStart, CheckSize);
+	if ((int)BytesRead < CheckSize || 
+	    (StreamFileStartSize > 0 && HashString(aFileStart, aFileStart + StreamFileStartSize) != StreamFileStartHash))
+		return true;
+	
+	// Same start, what was appended to it since then is checked from now on.
+	KeepStreamFileStart(aFileStart, CheckSize);
+	return false;
+}
+
+void CrazyLog::KeepStreamFileStart(const char* pFileStart, int Size)
+{
+	StreamFileStartSize = min(Size, STREAM_FILE_START_CHECK_SIZE);
+	StreamFileStartHash = HashString(pFileStart, pFileStart + StreamFileStartSize);
+}
+
+// The new content is not always encoded like the old one.
+void CrazyLog::DetectStreamFileEncoding(PlatformContext* pPlatformCtx)
+{
+	uint8_t aSample[TEXT_ENCODING_SAMPLE_SIZE];
+	size_t SampleSize = pPlatformCtx->pReadFileChunkFunc(pStreamFileHandle, 0, aSample, sizeof(aSample));
+	
+	LogEncoding = DetectTextEncoding(aSample, SampleSize, &LogBOMSize);
+	LastFetchFileSize = LogBOMSize;
+}
+
+// NOTE(matiasp): Starts the log again from scratch without freeing anything, 
+// the new content is likely to end up about the same size as the old one.
+void CrazyLog::ResetStreamedLog()
+{
+	Buf.Buf.resize(1);
+	Buf.Buf[0] = 0;
+	
+	vLineOffsets.resize(1);
+	vSplitLines.resize(0);
+	LinesCount = 1;
+	LastResolvedLineNo = -1;
+	LastFetchFileSize = 0;
+	StreamFileStartSize = 0;
+	
+	vFiltredLinesCached.resize(0);
+	FiltredLinesCount = 0;
+	bAlreadyCached = false;
+	
+	vFindFiltredLinesCached.resize(0);
+	FindFiltredProccesedLinesCount = 0;
+	CurrentFindFiltredIdx = 0;
+	
+	vFindFullViewLinesCached.resize(0);
+	vFindFullViewNarrowLines.resize(0);
+	FindFullViewProccesedLinesCount = 0;
+	FindFullViewNarrowedLinesCount = 0;
+	CurrentFindFullViewIdx = 0;
+	
+	ClearHighlightCache();
+}
+
+void CrazyLog::CloseStreamFile()
+{
+	if (!pStreamFileHandle)
+		return;
+	
+	pCloseFileFunc(pStreamFileHandle);
+	pStreamFileHandle = nullptr;
+}
+
 void CrazyLog::SearchLatestFile(PlatformContext* pPlatformCtx)
 {
 	if (aFolderQueryName[0] == 0)
@@ -189,7 +466,11 @@ void CrazyLog::SearchLatestFile(PlatformContext* pPlatformCtx)
 		strcpy_s(aFilePathToLoad, sizeof(aFilePathToLoad), OutLastFileData.aFilePath);
 		memcpy(&LastLoadedFileData, &OutLastFileData, sizeof(FileData));
 			
-		bStreamMode = LoadFile(pPlatformCtx);
+		// A new file means the old one got rotated, so the whole set is loaded again.
+		if (SelectedTargetMode == TM_StreamAllFilesFromFolder)
+			bStreamMode = LoadFolderFiles(pPlatformCtx);
+		else
+			bStreamMode = LoadFile(pPlatformCtx);
 		
 		if (bStreamMode)
 			FileContentFetchCooldown = FILE_FETCH_INTERVAL;
@@ -198,148 +479,2121 @@ void CrazyLog::SearchLatestFile(PlatformContext* pPlatformCtx)
 	FolderFetchCooldown = FOLDER_FETCH_INTERVAL;
 }
 
-void CrazyLog::SaveFilteredView(PlatformContext* pPlatformCtx, char* pFilePath)
+// Starts watching the folder of the current query, so we know right away when a file 
+// is written or a new one shows up instead of waiting for the next poll.
+void CrazyLog::WatchFolder(PlatformContext* pPlatformCtx)
 {
-	if (vFiltredLinesCached.Size == 0)
+	UnwatchFolder(pPlatformCtx);
+	
+	if (aFolderQueryName[0] != 0)
+		pFolderWatcher = pPlatformCtx->pWatchFolderFunc(aFolderQueryName);
+}
+
+void CrazyLog::UnwatchFolder(PlatformContext* pPlatformCtx)
+{
+	if (!pFolderWatcher)
 		return;
 	
-	FileContent TempFileContent;
-	void* pFileHandle = pPlatformCtx->pGetFileHandleFunc(pFilePath, 2 /* CREATE_ALWAYS */);
+	pPlatformCtx->pUnwatchFolderFunc(pFolderWatcher);
+	pFolderWatcher = nullptr;
+}
+
+// NOTE(matiasp): A line longer than MaxLineSize is split in virtual lines, so a log that is one huge line
+// still gets filtered across all the threads and drawn a piece at a time. It's split at the multiples of
+// MaxLineSize counting from the start of the buffer, so where a line is split only depends on the bytes 
+// around it and the filter chunks can start anywhere.
+// Returns where the virtual line that starts at pLineStart gets split, pEnd if that's not before it.
+static const char* FindLineSplit(const char* pBuf, const char* pLineStart, const char* pEnd, int MaxLineSize)
+{
+	// Far enough that going back to the start of its character still leaves something in the line.
+	int64_t SplitOffset = (((int64_t)(pLineStart - pBuf) + 4 + MaxLineSize - 1) / MaxLineSize) * MaxLineSize;
+	if (SplitOffset >= pEnd - pBuf)
+		return pEnd;
 	
-	const char* pBuf = Buf.begin();
-	const char* pBufEnd = Buf.end();
+	return FindUTF8IncompleteStart((char*)pLineStart, (char*)pBuf + SplitOffset);
+}
+
+// Where the virtual line that starts at pLineStart ends, its line end or where it gets split.
+// pEnd has to be a line start or the end of the text, up to pBufEnd is looked at to know if the line is too long.
+static const char* FindVirtualLineEnd(const char* pBuf, const char* pBufEnd, const char* pLineStart, const char* pEnd,
+                                      int MaxLineSize, bool bUseAVX)
+{
+	if (MaxLineSize == 0)
+		return FindNewLine(pLineStart, pEnd, bUseAVX);
 	
-	for (size_t i = 0; i < vFiltredLinesCached.Size; i++)
+	// The rest of a line that was split is split too.
+	bool bIsSplit = pLineStart > pBuf && pLineStart[-1] != '\n';
+	if (!bIsSplit)
 	{
-		int LineNo = vFiltredLinesCached[(int)i];
-		const char* pLineStart = pBuf + vLineOffsets[LineNo];
-		const char* pLineEnd = (LineNo + 1 < vLineOffsets.Size) ? (pBuf + vLineOffsets[LineNo + 1] - 1) : pBufEnd;
-		
-		TempFileContent.pFile = (void*)pLineStart;
-		TempFileContent.Size = (pLineEnd + 1) - pLineStart;
-		
-		bool bShouldClose = i == (vFiltredLinesCached.Size - 1);
-		pPlatformCtx->pStreamFileFunc(&TempFileContent, pFileHandle, bShouldClose);
+		// Most lines are short, looking for the line end is enough to know it.
+		const char* pLookEnd = pBufEnd - pLineStart > MaxLineSize ? pLineStart + MaxLineSize + 1 : pBufEnd;
+		const char* pLineEnd = FindNewLine(pLineStart, pLookEnd, bUseAVX);
+		if (pLineEnd != pLookEnd || pLookEnd == pBufEnd)
+			return min(pLineEnd, pEnd);
 	}
+	
+	return FindNewLine(pLineStart, FindLineSplit(pBuf, pLineStart, pEnd, MaxLineSize), bUseAVX);
 }
 
-bool CrazyLog::LoadFile(PlatformContext* pPlatformCtx) 
+// Where the next line starts, a split line goes on right where the virtual one ends.
+static const char* SkipLineEnd(const char* pLineEnd, const char* pEnd)
 {
-	if (aFilePathToLoad[0] == 0)
-		return false;
-		
-	bIsPeeking = false;
+	return (pLineEnd < pEnd && *pLineEnd == '\n') ? pLineEnd + 1 : pLineEnd;
+}
+
+static bool IsSplitLineEnd(const char* pLineEnd, const char* pBufEnd)
+{
+	return pLineEnd < pBufEnd && *pLineEnd != '\n';
+}
+
+// Where the line being indexed at pLineStart gets split before pKnownEnd, null if it doesn't or if what
+// is there of it can't tell yet. Everything before pKnownEnd has to be sanitized and without line ends.
+static char* FindKnownLineSplit(char* pBuf, char* pLineStart, char* pKnownEnd, int MaxLineSize)
+{
+	bool bIsSplit = (pLineStart > pBuf && pLineStart[-1] != '\n') || pKnownEnd - pLineStart > MaxLineSize;
+	if (MaxLineSize == 0 || !bIsSplit)
+		return nullptr;
+	
+	char* pSplit = (char*)FindLineSplit(pBuf, pLineStart, pKnownEnd, MaxLineSize);
+	return pSplit != pKnownEnd ? pSplit : nullptr;
+}
+
+// Copies the given lines one after the other, each one ending with a line end unless the next one goes on 
+// with the same split line. NextLineNo is the line gathered after the last one, -1 if there is none.
+// Without a destination it only measures how much room they need.
+// Thread safe, it doesn't touch the last resolved line like GetLineRange.
+static size_t GatherLines(const CrazyLog* pLog, const int* pLines, int Count, int NextLineNo, char* pDest, 
+                          std::atomic<int>* pProgress, const std::atomic<bool>* pShouldCancel)
+{
+	const char* pBufEnd = pLog->Buf.end();
+	const int Stride = pLog->LineIndexStride;
+	size_t Size = 0;
 	
-	FileContent File = pPlatformCtx->pReadFileFunc(aFilePathToLoad);
-	if(File.pFile)
+	int PrevLineNo = -1;
+	const char* pPrevLineEnd = nullptr;
+	for (int i = 0; i < Count; i++)
 	{
-		bFileLoaded = true;
+		int LineNo = pLines[i];
+		const char* pLineStart;
 		
-		SetLog((const char*)File.pFile, (int)File.Size);
-		pPlatformCtx->pFreeFileContentFunc(&File);
+		// The lines are sorted, so in sparse mode keep walking from the previous one
+		// if it's closer than the checkpoint.
+		if (Stride > 1 && PrevLineNo >= (LineNo / Stride) * Stride)
+		{
+			pLineStart = SkipLineEnd(pPrevLineEnd, pBufEnd);
+			for (int j = LineNo - PrevLineNo - 1; j > 0; j--)
+				pLineStart = pLog->FindNextLineStart(pLineStart);
+		}
+		else
+		{
+			pLineStart = pLog->FindLineStart(LineNo);
+		}
+		
+		const char* pLineEnd = pLog->FindLineEnd(LineNo, pLineStart);
+		size_t LineSize = pLineEnd - pLineStart;
+		
+		int FollowingLineNo = i + 1 < Count ? pLines[i + 1] : NextLineNo;
+		bool bGoesOn = FollowingLineNo == LineNo + 1 && IsSplitLineEnd(pLineEnd, pBufEnd);
+		
+		if (pDest)
+		{
+			memcpy(pDest + Size, pLineStart, LineSize);
+			if (!bGoesOn)
+				pDest[Size + LineSize] = '\n';
+		}
+		
+		Size += LineSize + (bGoesOn ? 0 : 1);
+		PrevLineNo = LineNo;
+		pPrevLineEnd = pLineEnd;
 		
-		LastFetchFileSize = (int)File.Size;
+		if ((i + 1) % GATHER_PROGRESS_LINES == 0)
+		{
+			if (pProgress)
+				*pProgress += GATHER_PROGRESS_LINES;
+			
+			// Whoever wanted the lines doesn't want them anymore, what we have is thrown away.
+			if (pShouldCancel && *pShouldCancel)
+				return Size;
+		}
 	}
 	
-	SetLastCommand("FILE LOADED");
+	if (pProgress)
+		*pProgress += Count % GATHER_PROGRESS_LINES;
 	
-	return File.Size > 0;
+	return Size;
 }
 
-void CrazyLog::LoadFilters(PlatformContext* pPlatformCtx)
-{	
-	const char* NoneFilterName = "NONE";
-	NamedFilter NoneFilter = { 0 };
-	strcpy_s(NoneFilter.aName, sizeof(NoneFilter.aName), NoneFilterName);
+struct GatherTask
+{
+	const CrazyLog* pLog;
+	const int* pLines;
+	int Count;
+	int NextLineNo;
+	size_t Offset;
+	size_t Size;
+	char* pDest;
+	std::atomic<int>* pProgress;
+	const std::atomic<bool>* pShouldCancel;
+};
+
+static void MeasureGatherTask(void* pUserData, int TaskIdx)
+{
+	GatherTask* pTask = (GatherTask*)pUserData + TaskIdx;
+	pTask->Size = GatherLines(pTask->pLog, pTask->pLines, pTask->Count, pTask->NextLineNo, nullptr, nullptr, pTask->pShouldCancel);
+}
+
+static void CopyGatherTask(void* pUserData, int TaskIdx)
+{
+	GatherTask* pTask = (GatherTask*)pUserData + TaskIdx;
+	GatherLines(pTask->pLog, pTask->pLines, pTask->Count, pTask->NextLineNo, pTask->pDest + pTask->Offset, 
+	            pTask->pProgress, pTask->pShouldCancel);
+}
+
+// NOTE(matiasp): Measures first so the output is allocated once with the exact size,
+// then every thread copies its slice of lines straight into its place.
+// Returns -1 without copying anything if the result would be bigger than MaxSize.
+// Once pShouldCancel is set it returns -1 as soon as it can, with whatever it got to copy.
+static int GatherLinesMT(const CrazyLog* pLog, const int* pLines, int Count, int NextLineNo, ThreadPool* pPool, 
+                         int ExtraThreadCount, size_t MaxSize, std::atomic<int>* pProgress, 
+                         const std::atomic<bool>* pShouldCancel, ImVector<char>* pvOut)
+{
+	int TaskCount = min(min(ExtraThreadCount, MAX_EXTRA_THREADS) + 1, max(1, Count / GATHER_MIN_LINES_PER_THREAD));
 	
-	FileContent File = pPlatformCtx->pReadFileFunc(FILTERS_FILE_NAME);
-	if (File.pFile) 
+	GatherTask aTasks[MAX_EXTRA_THREADS + 1];
+	
+	int LinesPerTask = Count / TaskCount;
+	for (int i = 0; i < TaskCount; i++)
 	{
-		cJSON * pJsonRoot = cJSON_ParseWithLength((char*)File.pFile, File.Size);
-		cJSON * pFiltersArray = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "Filters");
-		cJSON * pFilter = nullptr;
-		cJSON * pColor = nullptr;
-		cJSON * pEnabled = nullptr;
-		
-		unsigned FiltersCounter = 1;
-		int FiltersCount = cJSON_GetArraySize(pFiltersArray);
-		LoadedFilters.resize(FiltersCount + 1, { 0 });
+		aTasks[i].pLog = pLog;
+		aTasks[i].pLines = pLines + (i * LinesPerTask);
+		aTasks[i].Count = i == TaskCount - 1 ? Count - (i * LinesPerTask) : LinesPerTask;
+		aTasks[i].NextLineNo = i == TaskCount - 1 ? NextLineNo : pLines[(i + 1) * LinesPerTask];
+		aTasks[i].pProgress = pProgress;
+		aTasks[i].pShouldCancel = pShouldCancel;
+	}
+	
+	RunPoolTasks(pPool, MeasureGatherTask, aTasks, TaskCount, ExtraThreadCount);
+	if (pShouldCancel && *pShouldCancel)
+		return -1;
+	
+	size_t TotalSize = 0;
+	for (int i = 0; i < TaskCount; i++)
+	{
+		aTasks[i].Offset = TotalSize;
+		TotalSize += aTasks[i].Size;
+	}
+	
+	if (TotalSize > min(MaxSize, (size_t)INT_MAX))
+		return -1;
+	
+	pvOut->reserve((int)TotalSize);
+	pvOut->resize((int)TotalSize);
+	
+	for (int i = 0; i < TaskCount; i++)
+		aTasks[i].pDest = pvOut->Data;
+	
+	RunPoolTasks(pPool, CopyGatherTask, aTasks, TaskCount, ExtraThreadCount);
+	if (pShouldCancel && *pShouldCancel)
+		return -1;
+	
+	return (int)TotalSize;
+}
+
+static void WriteSaveBatch(SaveFileJob* pJob, ImVector<char>* pvBatch)
+{
+	FileContent BatchContent;
+	BatchContent.pFile = pvBatch->Data;
+	BatchContent.Size = pvBatch->Size;
+	
+	if (!pJob->pStreamFileFunc(&BatchContent, pJob->pFileHandle, false))
+		pJob->bFailed = true;
+}
+
+// NOTE(matiasp): Gathers the next batch of lines while the previous one is being written, 
+// so we are not paying a write per line anymore and the disk is never waiting on us.
+static void SaveFileLines(SaveFileJob* pJob)
+{
+	ImVector<char> avBatches[2];
+	std::thread WriteThread;
+	int CurrentBatch = 0;
+	int GatheredLinesCount = 0;
+	
+	while (GatheredLinesCount < pJob->vLines.Size && !pJob->bShouldCancel)
+	{
+		int BatchLinesCount = min(SAVE_FILE_BATCH_LINES, pJob->vLines.Size - GatheredLinesCount);
 		
-		//Add dummy so we can reset the selection
-		LoadedFilters[0] = NoneFilter;
+		// A split line that goes on in the next batch doesn't end in this one.
+		int NextIdx = GatheredLinesCount + BatchLinesCount;
+		int NextLineNo = NextIdx < pJob->vLines.Size ? pJob->vLines[NextIdx] : -1;
+		int BatchSize = GatherLinesMT(pJob->pLog, pJob->vLines.Data + GatheredLinesCount, BatchLinesCount, NextLineNo,
+		                              pJob->pWorkerPool, pJob->ExtraThreadCount, INT_MAX, nullptr, &pJob->bShouldCancel, 
+		                              &avBatches[CurrentBatch]);
 		
-		cJSON_ArrayForEach(pFilter, pFiltersArray)
+		if (WriteThread.joinable())
 		{
-			cJSON * pFilterName = cJSON_GetObjectItemCaseSensitive(pFilter, "key");
-			cJSON * pFilterValue = cJSON_GetObjectItemCaseSensitive(pFilter, "value");
-			
-			NamedFilter* pNamedFilter = &LoadedFilters[FiltersCounter];
-			strcpy_s(pNamedFilter->aName, sizeof(pNamedFilter->aName), pFilterName->valuestring);
-			strcpy_s(pNamedFilter->Filter.aInputBuf, sizeof(pNamedFilter->Filter.aInputBuf),  pFilterValue->valuestring);
-			
-			cJSON * pColorArray = cJSON_GetObjectItemCaseSensitive(pFilter, "colors");
-			cJSON * pEnableMaskArray = cJSON_GetObjectItemCaseSensitive(pFilter, "enable_mask");
-			
-			int ColorsCount = cJSON_GetArraySize(pColorArray);
-			int EnablesCount = cJSON_GetArraySize(pColorArray);
-			pNamedFilter->Filter.vSettings.resize(max(ColorsCount, EnablesCount));
-			
-			unsigned ColorCounter = 0;
-			cJSON_ArrayForEach(pColor, pColorArray)
-			{
-				ImVec4 Color;
-				StringUtils::HexToRGB(pColor->valuestring, &Color.x);
-				Color.x /= 255;
-				Color.y /= 255;
-				Color.z /= 255;
-				Color.w /= 255;
-				
-				pNamedFilter->Filter.vSettings[ColorCounter].Color = Color;
-				ColorCounter++;
-			}
-			
-#if SAVE_ENABLE_MASK
-			unsigned EnablesCounter = 0;
-			cJSON_ArrayForEach(pEnabled, pEnableMaskArray)
-			{
-				pNamedFilter->Filter.vSettings[EnablesCounter].bIsEnabled = cJSON_IsTrue(pEnabled);
-				EnablesCounter++;
-			}
-#endif
-			
-			pNamedFilter->Filter.Build(&vDefaultColors, false);
-			
-			FiltersCounter++;
+			WriteThread.join();
+			pJob->SavedLinesCount = GatheredLinesCount;
 		}
 		
-		free(pJsonRoot);
-		pPlatformCtx->pFreeFileContentFunc(&File);
-	}
-	else
-	{
-		LoadedFilters.reserve_discard(1);
-		LoadedFilters.resize(0);
+		if (BatchSize < 0)
+			pJob->bFailed = true;
 		
-		LoadedFilters.push_back(NoneFilter);
+		if (pJob->bFailed)
+			break;
+		
+		WriteThread = std::thread(WriteSaveBatch, pJob, &avBatches[CurrentBatch]);
+		
+		GatheredLinesCount += BatchLinesCount;
+		CurrentBatch = (CurrentBatch + 1) % 2;
 	}
+	
+	if (WriteThread.joinable())
+		WriteThread.join();
+	
+	pJob->SavedLinesCount = GatheredLinesCount;
+	pJob->pCloseFileFunc(pJob->pFileHandle);
+	pJob->bIsRunning = false;
 }
 
-void CrazyLog::SaveLoadedFilters(PlatformContext* pPlatformCtx) 
+void CrazyLog::SaveFilteredView(PlatformContext* pPlatformCtx, char* pFilePath)
 {
-	FileContent OutFile = {0};
+	if (vFiltredLinesCached.Size == 0 || bIsLoadingFile || bIsFilteringLines)
+		return;
 	
-	cJSON * pJsonRoot = cJSON_CreateObject();
-	cJSON * pJsonFilterArray = cJSON_CreateArray();
-	cJSON * pFilterValue = nullptr;
-	cJSON * pFilterName = nullptr;
-	cJSON * pFilterColor = nullptr;
-	cJSON * pFilterEnabled = nullptr;
+	CancelSaveFile();
 	
-	cJSON * pFilterObj = nullptr;
-	cJSON_AddItemToObject(pJsonRoot, "Filters", pJsonFilterArray);
+	// We are about to overwrite the file we have open, so our content can't depend on it anymore.
+	if (strcmp(pFilePath, aFilePathToLoad) == 0)
+	{
+		CloseStreamFile();
+		UnmapLog(true);
+	}
 	
-	// Start from 1 to skip the NONE filter
-	for (unsigned i = 1; i < (unsigned)LoadedFilters.size(); ++i)
+	void* pFileHandle = pPlatformCtx->pGetFileHandleFunc(pFilePath, 2 /* CREATE_ALWAYS */);
+	if (!pFileHandle)
+	{
+		SetLastCommand("FAILED TO SAVE FILE");
+		return;
+	}
+	
+	// The filter can run again while we save, so work with a copy of the result.
+	SaveJob.vLines.resize(vFiltredLinesCached.Size);
+	memcpy(SaveJob.vLines.Data, vFiltredLinesCached.Data, vFiltredLinesCached.Size * sizeof(int));
+	
+	SaveJob.pFileHandle = pFileHandle;
+	SaveJob.pStreamFileFunc = pPlatformCtx->pStreamFileFunc;
+	SaveJob.pCloseFileFunc = pPlatformCtx->pCloseFileFunc;
+	SaveJob.pLog = this;
+	SaveJob.pWorkerPool = &WorkerPool;
+	SaveJob.ExtraThreadCount = bIsMultithreadEnabled ? SelectedExtraThreadCount : 0;
+	SaveJob.bFailed = false;
+	SaveJob.bShouldCancel = false;
+	SaveJob.SavedLinesCount = 0;
+	SaveJob.bIsRunning = true;
+	
+	bIsSavingFile = true;
+	std::thread(SaveFileLines, &SaveJob).detach();
+	
+	SetLastCommand("SAVING FILE");
+}
+
+void CrazyLog::UpdateSaveFile(PlatformContext* pPlatformCtx)
+{
+	if (!bIsSavingFile)
+		return;
+	
+	if (SaveJob.bIsRunning)
+	{
+		SetLastCommand("SAVING FILE");
+		return;
+	}
+	
+	bIsSavingFile = false;
+	SetLastCommand(SaveJob.bFailed ? "FAILED TO SAVE FILE" : "FILE SAVED");
+	
+	if (bReloadAfterSave)
+	{
+		bReloadAfterSave = false;
+		LoadFile(pPlatformCtx);
+	}
+}
+
+void CrazyLog::CancelSaveFile()
+{
+	SaveJob.bShouldCancel = true;
+	while (SaveJob.bIsRunning)
+		std::this_thread::yield();
+	
+	bIsSavingFile = false;
+	bReloadAfterSave = false;
+}
+
+static void CopyLines(CopyLinesJob* pJob)
+{
+	pJob->CopiedSize = GatherLinesMT(pJob->pLog, pJob->vLines.Data, pJob->vLines.Size, -1, pJob->pWorkerPool, 
+	                                 pJob->ExtraThreadCount, pJob->MaxSize, &pJob->CopiedLinesCount, &pJob->bShouldCancel, 
+	                                 &pJob->vText);
+	pJob->bIsRunning = false;
+}
+
+void CrazyLog::CopyFilteredLines()
+{
+	// Half a filter result is not what anyone wants to copy.
+	if (vFiltredLinesCached.Size == 0 || bIsCopyingLines || bIsFilteringLines)
+		return;
+	
+	size_t MaxSize = MaxCopySizeMB > 0 ? (size_t)MaxCopySizeMB * 1024 * 1024 : (size_t)INT_MAX;
+	int ExtraThreadCount = bIsMultithreadEnabled ? SelectedExtraThreadCount : 0;
+	
+	// While loading the buffer can move under the thread feet, besides small copies are not worth it.
+	if (vFiltredLinesCached.Size < BACKGROUND_COPY_MIN_LINES || bIsLoadingFile)
+	{
+		ImVector<char> vText;
+		int Size = GatherLinesMT(this, vFiltredLinesCached.Data, vFiltredLinesCached.Size, -1, &WorkerPool, ExtraThreadCount, 
+		                         MaxSize, nullptr, nullptr, &vText);
+		SetClipboardLines(&vText, Size);
+		return;
+	}
+	
+	// The filter can run again while we copy, so work with a copy of the result.
+	CopyJob.vLines.resize(vFiltredLinesCached.Size);
+	memcpy(CopyJob.vLines.Data, vFiltredLinesCached.Data, vFiltredLinesCached.Size * sizeof(int));
+	
+	CopyJob.pLog = this;
+	CopyJob.pWorkerPool = &WorkerPool;
+	CopyJob.ExtraThreadCount = ExtraThreadCount;
+	CopyJob.MaxSize = MaxSize;
+	CopyJob.CopiedSize = 0;
+	CopyJob.CopiedLinesCount = 0;
+	CopyJob.bShouldCancel = false;
+	CopyJob.bIsRunning = true;
+	
+	bIsCopyingLines = true;
+	std::thread(CopyLines, &CopyJob).detach();
+	
+	SetLastCommand("COPYING LINES");
+}
+
+void CrazyLog::UpdateCopyLines()
+{
+	if (!bIsCopyingLines)
+		return;
+	
+	if (CopyJob.bIsRunning)
+	{
+		SetLastCommand("COPYING LINES");
+		return;
+	}
+	
+	bIsCopyingLines = false;
+	SetClipboardLines(&CopyJob.vText, CopyJob.CopiedSize);
+	
+	// Don't hold on a big chunk of memory that could be the size of the whole log.
+	CopyJob.vText.clear();
+}
+
+void CrazyLog::CancelCopyLines()
+{
+	CopyJob.bShouldCancel = true;
+	while (CopyJob.bIsRunning)
+		std::this_thread::yield();
+	
+	bIsCopyingLines = false;
+	CopyJob.vText.clear();
+}
+
+void CrazyLog::SetClipboardLines(ImVector<char>* pvText, int Size)
+{
+	if (Size < 0)
+	{
+		char aWarning[64];
+		snprintf(aWarning, sizeof(aWarning), "NOT COPIED, BIGGER THAN %i MB", MaxCopySizeMB);
+		SetLastCommand(aWarning);
+		return;
+	}
+	
+	// The last line end is not needed, so that's the room for the null terminator.
+	pvText->Data[Size - 1] = '\0';
+	ImGui::SetClipboardText(pvText->Data);
+	
+	SetLastCommand("LINES COPIED");
+}
+
+// NOTE(matiasp): The lines are handed out in chunks of about the same bytes instead of the same lines count,
+// so a few huge lines don't keep one thread busy while the rest are done. Whoever is free takes the next one.
+struct FilterChunk
+{
+	const char* pStart;
+	const char* pEnd;
+	ImVector<int> vLines; // Relative to the first line of the chunk.
+	int LinesCount;
+	
+	// Avoid false sharing when increasing the Size/Capacity of the vectors of the chunks next to each other.
+	char aPadding[128];
+};
+
+struct FilterChunksTask
+{
+	const CrazyTextFilter* pFilter;
+	FilterChunk* pChunks;
+	const std::atomic<bool>* pShouldStop; // Null when nothing can stop it.
+	bool bUseAVX;
+	
+	// Where the lines end depends on where the buffer starts, see FindLineSplit.
+	const char* pBuf;
+	const char* pBufEnd;
+	int MaxLineSize;
+	
+	// When set the lines are looking for this text instead of passing the filter.
+	const char* pFindText;
+	int FindTextLen;
+};
+
+// Same case insensitive search the filter does for each of its words.
+static bool LineContainsText(const char* pLineStart, const char* pLineEnd, const char* pBufEnd, 
+                             const char* pText, int TextLen, bool bUseAVX)
+{
+	if (bUseAVX)
+		return HaystackContainsNeedleAVX(pLineStart, pLineEnd - pLineStart, pText, TextLen, pBufEnd);
+	
+	return ImStristr(pLineStart, pLineEnd, pText, pText + TextLen) != nullptr;
+}
+
+// The first line start from pPos on, or pEnd. Only the bytes around pPos are looked at.
+static const char* FindLineStartAfter(const char* pBuf, const char* pBufEnd, const char* pPos, const char* pEnd,
+                                      int MaxLineSize, bool bUseAVX)
+{
+	if (MaxLineSize == 0)
+		return min(FindNewLine(pPos, pEnd, bUseAVX) + 1, pEnd);
+	
+	const char* pLookEnd = pBufEnd - pPos > MaxLineSize ? pPos + MaxLineSize + 1 : pBufEnd;
+	const char* pLineEnd = FindNewLine(pPos, pLookEnd, bUseAVX);
+	
+	// Found the line end, the line is split only if it doesn't start after the split size before it.
+	bool bIsSplit = pLineEnd == pLookEnd && pLookEnd != pBufEnd;
+	if (!bIsSplit)
+	{
+		const char* pLookStart = pLineEnd - pBuf > MaxLineSize ? pLineEnd - MaxLineSize : pBuf;
+		const char* pLineStart = pPos;
+		while (pLineStart > pLookStart && pLineStart[-1] != '\n')
+			pLineStart--;
+		
+		bIsSplit = pLineStart > pBuf && pLineStart[-1] != '\n';
+	}
+	
+	if (!bIsSplit)
+		return min(pLineEnd + 1, pEnd);
+	
+	// Every split of the line is a line start, unless the line ends before it.
+	return SkipLineEnd(FindNewLine(pPos, FindLineSplit(pBuf, pPos, pEnd, MaxLineSize), bUseAVX), pEnd);
+}
+
+// Every chunk starts right after a line end or where a line is split, a line bigger than a chunk 
+// gets a chunk of its own. Returns where the last chunk ends, that's pEnd unless it ran out of chunks before.
+static const char* SplitFilterChunks(const char* pBuf, const char* pBufEnd, const char* pStart, const char* pEnd, 
+                                     int MaxLineSize, bool bUseAVX, int MaxChunksCount, ImVector<FilterChunk>* pvChunks)
+{
+	pvChunks->resize(0);
+	
+	const char* pChunkStart = pStart;
+	while (pChunkStart < pEnd && pvChunks->Size < MaxChunksCount)
+	{
+		const char* pChunkEnd = pEnd;
+		if (pEnd - pChunkStart > FILTER_CHUNK_SIZE)
+			pChunkEnd = FindLineStartAfter(pBuf, pBufEnd, pChunkStart + FILTER_CHUNK_SIZE, pEnd, MaxLineSize, bUseAVX);
+		
+		FilterChunk Chunk;
+		memset(&Chunk, 0, sizeof(Chunk));
+		Chunk.pStart = pChunkStart;
+		Chunk.pEnd = pChunkEnd;
+		pvChunks->push_back(Chunk);
+		
+		pChunkStart = pChunkEnd;
+	}
+	
+	return pChunkStart;
+}
+
+static void FilterChunkTask(void* pUserData, int TaskIdx)
+{
+	FilterChunksTask* pTask = (FilterChunksTask*)pUserData;
+	FilterChunk* pChunk = &pTask->pChunks[TaskIdx];
+	const std::atomic<bool>* pShouldStop = pTask->pShouldStop;
+	
+	int LinesCount = 0;
+	const char* pLineStart = pChunk->pStart;
+	
+	while (pLineStart < pChunk->pEnd && (!pShouldStop || !*pShouldStop))
+	{
+		const char* pLineEnd = FindVirtualLineEnd(pTask->pBuf, pTask->pBufEnd, pLineStart, pChunk->pEnd, 
+		                                          pTask->MaxLineSize, pTask->bUseAVX);
+		bool bPass = pTask->pFindText ? 
+			LineContainsText(pLineStart, pLineEnd, pChunk->pEnd, pTask->pFindText, pTask->FindTextLen, pTask->bUseAVX) :
+			pTask->pFilter->PassFilter(pLineStart, pLineEnd, pChunk->pEnd, pTask->bUseAVX);
+		
+		if (bPass)
+			pChunk->vLines.push_back(LinesCount);
+		
+		LinesCount++;
+		pLineStart = SkipLineEnd(pLineEnd, pChunk->pEnd);
+	}
+	
+	pChunk->LinesCount = LinesCount;
+}
+
+// Appends the lines that passed in order, returns how many lines the chunks had.
+static int MergeFilterChunks(ImVector<FilterChunk>* pvChunks, int FirstLineNo, ImVector<int>* pvOut)
+{
+	int TotalSize = pvOut->Size;
+	for (int i = 0; i < pvChunks->Size; i++)
+		TotalSize += (*pvChunks)[i].vLines.Size;
+	
+	int OutIdx = pvOut->Size;
+	pvOut->resize(TotalSize);
+	
+	int LineNo = FirstLineNo;
+	for (int i = 0; i < pvChunks->Size; i++)
+	{
+		FilterChunk& Chunk = (*pvChunks)[i];
+		for (int j = 0; j < Chunk.vLines.Size; j++)
+			(*pvOut)[OutIdx++] = LineNo + Chunk.vLines[j];
+		
+		LineNo += Chunk.LinesCount;
+	}
+	
+	return LineNo - FirstLineNo;
+}
+
+static void FreeFilterChunks(ImVector<FilterChunk>* pvChunks)
+{
+	for (int i = 0; i < pvChunks->Size; i++)
+		(*pvChunks)[i].vLines.clear();
+	
+	pvChunks->clear();
+}
+
+static void LockLoadJob(LoadFileJob* pJob)
+{
+	while (pJob->bIsLocked.exchange(true, std::memory_order_acquire))
+		std::this_thread::yield();
+}
+
+static void UnlockLoadJob(LoadFileJob* pJob)
+{
+	pJob->bIsLocked.store(false, std::memory_order_release);
+}
+
+static void PrefaultPages(const char* pStart, const char* pEnd, LoadFileJob* pJob)
+{
+	// Touching a byte per page is enough to bring it into memory.
+	volatile int Sink = 0;
+	for (const char* pPage = pStart; pPage < pEnd && !pJob->bShouldCancel; pPage += 4096)
+		Sink += *pPage;
+}
+
+// The lines published since the last pass, they get filtered on the pool while the load thread goes on.
+struct LoadFilterPass
+{
+	ImVector<FilterChunk> vChunks;
+	FilterChunksTask Task;
+	PoolTaskBatch* pBatch;
+	int FirstLineNo;
+};
+
+// Waits for the last pass to be filtered and commits its lines, the load thread helps with what is left of it.
+static void WaitForLoadFilter(LoadFileJob* pJob)
+{
+	LoadFilterPass* pPass = pJob->pFilterPass;
+	if (!pPass)
+		return;
+	
+	FinishPoolTasks(pJob->pWorkerPool, pPass->pBatch);
+	
+	// Some chunks didn't get to the end, the main thread doesn't want these anyway.
+	if (!pJob->bStopFiltering)
+	{
+		LockLoadJob(pJob);
+		pJob->FiltredLinesCount = pPass->FirstLineNo + MergeFilterChunks(&pPass->vChunks, pPass->FirstLineNo, &pJob->vPendingFiltredLines);
+		UnlockLoadJob(pJob);
+	}
+	
+	FreeFilterChunks(&pPass->vChunks);
+	IM_DELETE(pPass);
+	pJob->pFilterPass = nullptr;
+}
+
+// NOTE(matiasp): The lines of the last chunk get filtered on the pool while we go on loading 
+// the next one, waiting for the previous pass first keeps the results in order.
+static void FilterPublishedLines(LoadFileJob* pJob)
+{
+	// Only we write it, no need to lock for reading it.
+	int PublishedSize = pJob->PublishedSize;
+	if (!pJob->bFilterLines || pJob->bStopFiltering || PublishedSize == pJob->NextFilterOffset)
+		return;
+	
+	WaitForLoadFilter(pJob);
+	
+	// What comes after the published lines is still being loaded.
+	const char* pBuf = pJob->pDest;
+	const char* pBufEnd = pBuf + PublishedSize;
+	
+	LoadFilterPass* pPass = IM_NEW(LoadFilterPass)();
+	SplitFilterChunks(pBuf, pBufEnd, pBuf + pJob->NextFilterOffset, pBufEnd, pJob->MaxLineSize, pJob->bUseAVX, INT_MAX, &pPass->vChunks);
+	
+	// Canceling the load stops the filtering too.
+	FilterChunksTask Task = { &pJob->Filter, pPass->vChunks.Data, &pJob->bStopFiltering, pJob->bUseAVX, 
+	                          pBuf, pBufEnd, pJob->MaxLineSize };
+	pPass->Task = Task;
+	pPass->FirstLineNo = pJob->NextFilterLineNo;
+	pPass->pBatch = StartPoolTasks(pJob->pWorkerPool, FilterChunkTask, &pPass->Task, pPass->vChunks.Size, pJob->ExtraThreadCount);
+	pJob->pFilterPass = pPass;
+	
+	// The last line starts at the published size, so everything before it is complete.
+	pJob->NextFilterOffset = PublishedSize;
+	pJob->NextFilterLineNo = pJob->IndexedLinesCount - 1;
+}
+
+static void AppendInts(ImVector<int>* pvDest, const ImVector<int>* pvSrc)
+{
+	if (pvSrc->Size == 0)
+		return;
+	
+	int OldSize = pvDest->Size;
+	pvDest->resize(OldSize + pvSrc->Size);
+	memcpy(pvDest->Data + OldSize, pvSrc->Data, pvSrc->Size * sizeof(int));
+}
+
+// Hands over to the main thread the offsets in vChunkLineOffsets, the split lines in vChunkSplitLines
+// and the lines counted so far.
+static void PublishChunkLineOffsets(LoadFileJob* pJob, int LinesCount, int LastLineStart, int SegmentsCount)
+{
+	LockLoadJob(pJob);
+	
+	AppendInts(&pJob->vPendingLineOffsets, &pJob->vChunkLineOffsets);
+	AppendInts(&pJob->vPendingSplitLines, &pJob->vChunkSplitLines);
+	
+	pJob->PendingLinesCount += LinesCount - pJob->IndexedLinesCount;
+	if (LastLineStart != -1)
+		pJob->PublishedSize = LastLineStart;
+	
+	pJob->PublishedSegmentsCount = SegmentsCount;
+	
+	UnlockLoadJob(pJob);
+	
+	pJob->IndexedLinesCount = LinesCount;
+	
+	FilterPublishedLines(pJob);
+}
+
+// Indexes the lines loaded since the last call and publishes the complete ones,
+// so the main thread never sees a line that is still being loaded.
+// The invalid UTF-8 gets replaced on the same pass, before the main thread gets to see it.
+static void PublishLoadedChunk(LoadFileJob* pJob, int LoadedSize, bool bIsLast)
+{
+	char* pBuf = pJob->pDest;
+	char* pCursor = pBuf + pJob->IndexedSize;
+	char* pLineStart = pBuf + pJob->IndexedLineStart;
+	int LinesCount = pJob->IndexedLinesCount;
+	int LastLineStart = -1;
+	
+	// A character cut by the end of the chunk is checked once the rest of it is loaded.
+	char* pChunkEnd = bIsLast ? pBuf + LoadedSize : FindUTF8IncompleteStart(pCursor, pBuf + LoadedSize);
+	
+	pJob->vChunkLineOffsets.resize(0);
+	pJob->vChunkSplitLines.resize(0);
+	while (true)
+	{
+		char* pLineEnd = FindNewLineSanitizeUTF8(pCursor, pChunkEnd, pJob->bUseAVX, &pJob->bReplacedInvalidUTF8);
+		
+		// A line that is still being loaded gets split as far as what we have of it goes.
+		char* pSplit = FindKnownLineSplit(pBuf, pLineStart, pLineEnd, pJob->MaxLineSize);
+		if (pSplit)
+		{
+			pJob->vChunkSplitLines.push_back(LinesCount);
+			pLineStart = pSplit;
+			pCursor = pLineEnd;
+		}
+		else if (pLineEnd != pChunkEnd)
+		{
+			pLineStart = pLineEnd + 1;
+			pCursor = pLineStart;
+		}
+		else
+		{
+			break;
+		}
+		
+		LastLineStart = (int)(pLineStart - pBuf);
+		
+		if (LinesCount % pJob->LineIndexStride == 0)
+			pJob->vChunkLineOffsets.push_back(LastLineStart);
+		
+		LinesCount++;
+	}
+	
+	PublishChunkLineOffsets(pJob, LinesCount, LastLineStart, pJob->PublishedSegmentsCount);
+	pJob->IndexedSize = (int)(pChunkEnd - pBuf);
+	pJob->IndexedLineStart = (int)(pLineStart - pBuf);
+}
+
+// Wakes up whoever is waiting on the read ahead, the other side moved or the load got canceled.
+static void SignalReadAhead(LoadFileJob* pJob)
+{
+	if (!pJob->pReadAheadMutex)
+		return;
+	
+	// NOTE(matiasp): Taking the lock makes sure the waiter is either still checking or already parked, not in between.
+	{
+		std::lock_guard<std::mutex> Lock(*pJob->pReadAheadMutex);
+	}
+	pJob->pReadAheadChanged->notify_all();
+}
+
+// Reads the whole file into the log buffer, at most LOAD_PIPELINE_DEPTH chunks ahead of the indexing.
+static void ReadFileAhead(LoadFileJob* pJob)
+{
+	char* pBuf = pJob->pDest;
+	int ReadSize = 0;
+	
+	std::unique_lock<std::mutex> Lock(*pJob->pReadAheadMutex);
+	while (ReadSize < pJob->FileSize && !pJob->bShouldCancel)
+	{
+		if (ReadSize - pJob->ReadAheadConsumedSize >= LOAD_PIPELINE_DEPTH * LOAD_FILE_CHUNK_SIZE)
+		{
+			pJob->pReadAheadChanged->wait(Lock);
+			continue;
+		}
+		
+		Lock.unlock();
+		
+		int ChunkSize = (int)min(LOAD_FILE_CHUNK_SIZE, pJob->FileSize - ReadSize);
+		size_t BytesRead = pJob->pReadFileChunkFunc(pJob->pFileHandle, pJob->BOMSize + ReadSize, pBuf + ReadSize, ChunkSize);
+		
+		Lock.lock();
+		
+		if (BytesRead == 0)
+			break;
+		
+		ReadSize += (int)BytesRead;
+		pJob->ReadAheadSize = ReadSize;
+		pJob->pReadAheadChanged->notify_all();
+	}
+	
+	pJob->bReadAheadFinished = true;
+	pJob->pReadAheadChanged->notify_all();
+}
+
+// Returns how much of the chunk at ReadSize was read already, 0 once there is nothing else to read.
+static size_t WaitForReadAhead(LoadFileJob* pJob, int ReadSize, int ChunkSize)
+{
+	std::unique_lock<std::mutex> Lock(*pJob->pReadAheadMutex);
+	while (pJob->ReadAheadSize == ReadSize && !pJob->bReadAheadFinished && !pJob->bShouldCancel)
+		pJob->pReadAheadChanged->wait(Lock);
+	
+	return (size_t)min(pJob->ReadAheadSize - ReadSize, ChunkSize);
+}
+
+// Lets the read ahead know the chunks before ConsumedSize are indexed, so it can go on reading.
+static void ConsumeReadAhead(LoadFileJob* pJob, int ConsumedSize)
+{
+	{
+		std::lock_guard<std::mutex> Lock(*pJob->pReadAheadMutex);
+		pJob->ReadAheadConsumedSize = ConsumedSize;
+	}
+	pJob->pReadAheadChanged->notify_all();
+}
+
+// Reads the file straight into the log buffer chunk by chunk, indexing the lines as it goes.
+// NOTE(matiasp): It's a pipeline, while we index a chunk the next one is being read and the previous one filtered.
+static int LoadPlainFile(LoadFileJob* pJob)
+{
+	char* pBuf = pJob->pDest;
+	int ReadSize = 0;
+	
+	// With a mapped view the content is already there, we only pay the page faults while indexing it.
+	// The extra threads take care of the faults ahead of us, the first chunk is left to the indexing.
+	std::thread aPrefaultThreads[MAX_EXTRA_THREADS];
+	int PrefaultThreadCount = pJob->bIsMapped ? min(pJob->PrefaultThreadCount, MAX_EXTRA_THREADS) : 0;
+	if (PrefaultThreadCount > 0 && pJob->FileSize > LOAD_FILE_CHUNK_SIZE)
+	{
+		int PrefaultStart = (int)LOAD_FILE_CHUNK_SIZE;
+		int SliceSize = (pJob->FileSize - PrefaultStart) / PrefaultThreadCount;
+		for (int i = 0; i < PrefaultThreadCount; i++)
+		{
+			const char* pSliceStart = pBuf + PrefaultStart + (i * SliceSize);
+			const char* pSliceEnd = i == PrefaultThreadCount - 1 ? pBuf + pJob->FileSize : pSliceStart + SliceSize;
+			aPrefaultThreads[i] = std::thread(PrefaultPages, pSliceStart, pSliceEnd, pJob);
+		}
+	}
+	else if (pJob->bIsMapped)
+	{
+		pJob->pPrefetchMemoryFunc(pBuf, (int)min(LOAD_FILE_CHUNK_SIZE, pJob->FileSize));
+	}
+	
+	// Without a view the reading is on us, so another thread takes care of it.
+	std::thread ReadAheadThread;
+	bool bReadAhead = !pJob->bIsMapped && pJob->FileSize > LOAD_FILE_CHUNK_SIZE;
+	if (bReadAhead)
+	{
+		pJob->ReadAheadSize = 0;
+		pJob->ReadAheadConsumedSize = 0;
+		pJob->bReadAheadFinished = false;
+		ReadAheadThread = std::thread(ReadFileAhead, pJob);
+	}
+	
+	while (ReadSize < pJob->FileSize && !pJob->bShouldCancel)
+	{
+		int ChunkSize = (int)min(LOAD_FILE_CHUNK_SIZE, pJob->FileSize - ReadSize);
+		size_t BytesRead = ChunkSize;
+		
+		if (pJob->bIsMapped)
+		{
+			// Let the OS read ahead the next chunk while we index this one.
+			int NextChunkSize = (int)min(LOAD_FILE_CHUNK_SIZE, pJob->FileSize - (ReadSize + ChunkSize));
+			if (PrefaultThreadCount == 0 && NextChunkSize > 0)
+				pJob->pPrefetchMemoryFunc(pBuf + ReadSize + ChunkSize, NextChunkSize);
+		}
+		else if (bReadAhead)
+		{
+			BytesRead = WaitForReadAhead(pJob, ReadSize, ChunkSize);
+			if (BytesRead == 0)
+				break;
+		}
+		else
+		{
+			BytesRead = pJob->pReadFileChunkFunc(pJob->pFileHandle, pJob->BOMSize + ReadSize, pBuf + ReadSize, ChunkSize);
+			if (BytesRead == 0)
+				break;
+		}
+		
+		ReadSize += (int)BytesRead;
+		PublishLoadedChunk(pJob, ReadSize, false);
+		
+		if (bReadAhead)
+			ConsumeReadAhead(pJob, ReadSize);
+	}
+	
+	for (int i = 0; i < PrefaultThreadCount; i++)
+	{
+		if (aPrefaultThreads[i].joinable())
+			aPrefaultThreads[i].join();
+	}
+	
+	if (ReadAheadThread.joinable())
+		ReadAheadThread.join();
+	
+	PublishLoadedChunk(pJob, ReadSize, true);
+	
+	return ReadSize;
+}
+
+// NOTE(matiasp): The main thread keeps reading the buffer it has, so instead of reallocating it
+// we hand over a bigger copy that it will pick up in the next UpdateLoadFile.
+static bool GrowLoadBuffer(DecompressSink* pSink, int RequiredCapacity)
+{
+	LoadFileJob* pJob = (LoadFileJob*)pSink->pUserData;
+	
+	// The filtering is still reading the buffer we are about to let go.
+	WaitForLoadFilter(pJob);
+	
+	// One extra byte so the main thread always has room for the null terminator.
+	int64_t NewCapacity = max((int64_t)RequiredCapacity + 1, (int64_t)pSink->Capacity + pSink->Capacity / 2);
+	NewCapacity = min(NewCapacity, (int64_t)INT_MAX);
+	
+	char* pNewDest = (char*)IM_ALLOC((size_t)NewCapacity);
+	if (!pNewDest)
+	{
+		pJob->bOutOfMemory = true;
+		return false;
+	}
+	
+	memcpy(pNewDest, pSink->pDest, pSink->Size);
+	
+	LockLoadJob(pJob);
+	
+	// The main thread never got to see the previous one, so it's still ours to free.
+	if (pJob->pGrownDest)
+		IM_FREE(pJob->pGrownDest);
+	
+	pJob->pGrownDest = pNewDest;
+	pJob->GrownDestCapacity = (int)NewCapacity;
+	
+	UnlockLoadJob(pJob);
+	
+	pJob->pDest = pNewDest;
+	pSink->pDest = pNewDest;
+	pSink->Capacity = (int)NewCapacity;
+	
+	return true;
+}
+
+static bool FlushLoadBuffer(DecompressSink* pSink)
+{
+	LoadFileJob* pJob = (LoadFileJob*)pSink->pUserData;
+	PublishLoadedChunk(pJob, pSink->Size, false);
+	
+	return !pJob->bShouldCancel;
+}
+
+// The compressed file is way smaller than the log, so it's read whole and then decoded
+// straight into the log buffer, publishing the lines every time a chunk is decoded.
+// The file is under 2GB, LoadFile doesn't take anything bigger.
+static int LoadCompressedFile(LoadFileJob* pJob)
+{
+	uint8_t* pSrc = (uint8_t*)IM_ALLOC(pJob->FileSize);
+	if (!pSrc)
+	{
+		pJob->bOutOfMemory = true;
+		PublishLoadedChunk(pJob, 0, true);
+		return 0;
+	}
+	
+	int ReadSize = 0;
+	
+	while (ReadSize < pJob->FileSize && !pJob->bShouldCancel)
+	{
+		int ChunkSize = (int)min(LOAD_FILE_CHUNK_SIZE, pJob->FileSize - ReadSize);
+		size_t BytesRead = pJob->pReadFileChunkFunc(pJob->pFileHandle, ReadSize, pSrc + ReadSize, ChunkSize);
+		if (BytesRead == 0)
+			break;
+		
+		ReadSize += (int)BytesRead;
+	}
+	
+	DecompressSink Sink = { 0 };
+	Sink.pDest = pJob->pDest;
+	Sink.Capacity = pJob->DestCapacity;
+	Sink.pUserData = pJob;
+	Sink.pGrowFunc = GrowLoadBuffer;
+	Sink.pFlushFunc = FlushLoadBuffer;
+	
+	bool bDecompressed = ReadSize == pJob->FileSize &&
+		Decompress(pJob->Compression, pSrc, ReadSize, &Sink, pJob->pWorkerPool, pJob->ExtraThreadCount);
+	
+	pJob->bDecompressFailed = !bDecompressed && !pJob->bShouldCancel && !pJob->bOutOfMemory;
+	IM_FREE(pSrc);
+	
+	// Leave room for the null terminator.
+	if (Sink.Size + 1 > Sink.Capacity && !GrowLoadBuffer(&Sink, Sink.Size + 1))
+		Sink.Size = Sink.Capacity - 1;
+	
+	PublishLoadedChunk(pJob, Sink.Size, true);
+	
+	return Sink.Size;
+}
+
+// NOTE(matiasp): Read chunk by chunk into a scratch buffer and transcoded straight into the log buffer,
+// indexing every slice right after transcoding it while it's still in the cache.
+// Mostly ASCII logs end up at half the size of the file, that is what was reserved, anything else grows it.
+static int LoadUTF16File(LoadFileJob* pJob, int* pOutLoadedFileSize)
+{
+	char* pSrc = (char*)IM_ALLOC(LOAD_FILE_CHUNK_SIZE);
+	
+	DecompressSink Sink = { 0 };
+	Sink.pDest = pJob->pDest;
+	Sink.Capacity = pJob->DestCapacity;
+	Sink.pUserData = pJob;
+	
+	int ReadSize = 0;
+	int PendingSize = 0;
+	bool bOutOfMemory = false;
+	
+	while (ReadSize < pJob->FileSize && !pJob->bShouldCancel && !bOutOfMemory)
+	{
+		int ChunkSize = (int)min(LOAD_FILE_CHUNK_SIZE - PendingSize, pJob->FileSize - ReadSize);
+		size_t BytesRead = pJob->pReadFileChunkFunc(pJob->pFileHandle, pJob->BOMSize + ReadSize, pSrc + PendingSize, ChunkSize);
+		if (BytesRead == 0)
+			break;
+		
+		ReadSize += (int)BytesRead;
+		
+		int SrcSize = PendingSize + (int)BytesRead;
+		int SrcIdx = 0;
+		bool bIsLastChunk = ReadSize == pJob->FileSize;
+		
+		while (SrcIdx < SrcSize && !bOutOfMemory)
+		{
+			int SliceSize = (int)min(UTF16_TRANSCODE_SLICE_SIZE, SrcSize - SrcIdx);
+			bool bReachesChunkEnd = SrcIdx + SliceSize == SrcSize;
+			
+			// Leave room for the null terminator.
+			int TranscodedSize = 0;
+			int ConsumedSize = TranscodeUTF16ToUTF8(pSrc + SrcIdx, SliceSize, Sink.pDest + Sink.Size, Sink.Capacity - Sink.Size - 1, 
+			                                        &TranscodedSize, pJob->Encoding, bIsLastChunk && bReachesChunkEnd, pJob->bUseAVX);
+			
+			SrcIdx += ConsumedSize;
+			Sink.Size += TranscodedSize;
+			PublishLoadedChunk(pJob, Sink.Size, false);
+			
+			if (ConsumedSize < SliceSize)
+			{
+				// Either the log is full or what is left is a pair cut by the end of the chunk.
+				bool bIsFull = Sink.Capacity - Sink.Size - 1 < 4;
+				if (bIsFull)
+					bOutOfMemory = !GrowLoadBuffer(&Sink, Sink.Size + (int)UTF16_TRANSCODE_SLICE_SIZE);
+				else if (bReachesChunkEnd)
+					break;
+			}
+		}
+		
+		PendingSize = SrcSize - SrcIdx;
+		memmove(pSrc, pSrc + SrcIdx, PendingSize);
+	}
+	
+	IM_FREE(pSrc);
+	
+	PublishLoadedChunk(pJob, Sink.Size, true);
+	
+	*pOutLoadedFileSize = pJob->BOMSize + ReadSize - PendingSize;
+	return Sink.Size;
+}
+
+// Reads one of the files of the folder into its place in the log and finds all its line starts.
+static void LoadSegmentFile(LoadFileJob* pJob, LoadSegment* pSegment)
+{
+	char* pBuf = pJob->pDest + pSegment->Offset;
+	int ReadSize = 0;
+	
+	while (ReadSize < pSegment->FileSize && !pJob->bShouldCancel)
+	{
+		int ChunkSize = (int)min(LOAD_FILE_CHUNK_SIZE, pSegment->FileSize - ReadSize);
+		size_t BytesRead = pJob->pReadFileChunkFunc(pSegment->pFileHandle, ReadSize, pBuf + ReadSize, ChunkSize);
+		if (BytesRead == 0)
+			break;
+		
+		ReadSize += (int)BytesRead;
+	}
+	
+	pJob->pCloseFileFunc(pSegment->pFileHandle);
+	pSegment->pFileHandle = nullptr;
+	
+	// The file got smaller since we looked at it, don't leave garbage in its place.
+	if (ReadSize < pSegment->FileSize)
+		memset(pBuf + ReadSize, ' ', pSegment->FileSize - ReadSize);
+	
+	int SegmentSize = pSegment->FileSize;
+	if (pSegment->bNeedsLineEnd)
+		pBuf[SegmentSize++] = '\n';
+	
+	// The file starts right after a line end, so the lines are split the same as if it was loaded alone.
+	char* pCursor = pBuf;
+	char* pLineStart = pBuf;
+	char* pSegmentEnd = pBuf + SegmentSize;
+	while (!pJob->bShouldCancel)
+	{
+		char* pLineEnd = FindNewLineSanitizeUTF8(pCursor, pSegmentEnd, pJob->bUseAVX);
+		
+		char* pSplit = FindKnownLineSplit(pJob->pDest, pLineStart, pLineEnd, pJob->MaxLineSize);
+		if (pSplit)
+		{
+			pLineStart = pSplit;
+			pCursor = pLineEnd;
+		}
+		else if (pLineEnd != pSegmentEnd)
+		{
+			pLineStart = pLineEnd + 1;
+			pCursor = pLineStart;
+		}
+		else
+		{
+			break;
+		}
+		
+		pSegment->vLineOffsets.push_back((int)(pLineStart - pJob->pDest));
+	}
+}
+
+// The line numbers depend on the files before, so the segments are published in order.
+static void PublishLoadedSegment(LoadFileJob* pJob, int SegmentIdx)
+{
+	LoadSegment* pSegment = &pJob->vLoadSegments[SegmentIdx];
+	ImVector<int>& vLineOffsets = pSegment->vLineOffsets;
+	int LinesCount = pJob->IndexedLinesCount;
+	
+	pJob->vChunkLineOffsets.resize(0);
+	pJob->vChunkSplitLines.resize(0);
+	for (int i = 0; i < vLineOffsets.Size; i++)
+	{
+		if (LinesCount % pJob->LineIndexStride == 0)
+			pJob->vChunkLineOffsets.push_back(vLineOffsets[i]);
+		
+		// Only a split leaves a line start that doesn't come after a line end.
+		if (pJob->MaxLineSize > 0 && pJob->pDest[vLineOffsets[i] - 1] != '\n')
+			pJob->vChunkSplitLines.push_back(LinesCount);
+		
+		LinesCount++;
+	}
+	
+	// The first line starts right after the last line end of the previous file.
+	pSegment->FirstLineNo = pJob->IndexedLinesCount - 1;
+	
+	int LastLineStart = vLineOffsets.Size > 0 ? vLineOffsets.back() : -1;
+	PublishChunkLineOffsets(pJob, LinesCount, LastLineStart, SegmentIdx + 1);
+	
+	vLineOffsets.clear();
+}
+
+// NOTE(matiasp): Every file is read and indexed by its own thread, then they are published 
+// in order while the rest of them are still loading.
+static int LoadFolderSegments(LoadFileJob* pJob)
+{
+	std::thread aThreads[MAX_EXTRA_THREADS];
+	int SegmentsCount = pJob->vLoadSegments.Size;
+	int BatchSize = min(pJob->ExtraThreadCount, MAX_EXTRA_THREADS) + 1;
+	
+	for (int BatchStart = 0; BatchStart < SegmentsCount; BatchStart += BatchSize)
+	{
+		int BatchEnd = min(BatchStart + BatchSize, SegmentsCount);
+		for (int i = BatchStart + 1; i < BatchEnd; i++)
+			aThreads[i - BatchStart - 1] = std::thread(LoadSegmentFile, pJob, &pJob->vLoadSegments[i]);
+		
+		LoadSegmentFile(pJob, &pJob->vLoadSegments[BatchStart]);
+		PublishLoadedSegment(pJob, BatchStart);
+		
+		for (int i = BatchStart + 1; i < BatchEnd; i++)
+		{
+			aThreads[i - BatchStart - 1].join();
+			PublishLoadedSegment(pJob, i);
+		}
+	}
+	
+	LoadSegment& LastSegment = pJob->vLoadSegments.back();
+	return LastSegment.Offset + LastSegment.FileSize;
+}
+
+static void LoadFileChunks(LoadFileJob* pJob)
+{
+	int LoadedSize = 0;
+	int LoadedFileSize = 0;
+	if (pJob->vLoadSegments.Size > 0)
+		LoadedSize = LoadFolderSegments(pJob);
+	else if (pJob->Compression != CT_None)
+		LoadedSize = LoadCompressedFile(pJob);
+	else if (pJob->Encoding != TE_UTF8)
+		LoadedSize = LoadUTF16File(pJob, &LoadedFileSize);
+	else
+		LoadedSize = LoadPlainFile(pJob);
+	
+	// Streaming goes on from there, the transcoded text doesn't match the size of the file.
+	if (pJob->Encoding == TE_UTF8)
+		LoadedFileSize = pJob->BOMSize + LoadedSize;
+	
+	// The last line is left to the main thread, it knows if it's complete.
+	WaitForLoadFilter(pJob);
+	
+	LockLoadJob(pJob);
+	
+	// The last line doesn't need a line end to be complete once we reach the end.
+	pJob->PublishedSize = LoadedSize;
+	pJob->LoadedFileSize = LoadedFileSize;
+	pJob->bFinished = true;
+	
+	UnlockLoadJob(pJob);
+	
+	if (pJob->pFileHandle)
+		pJob->pCloseFileFunc(pJob->pFileHandle);
+	
+	pJob->bIsRunning = false;
+}
+
+static void AdoptGrownLoadBuffer(LoadFileJob* pJob, ImGuiTextBuffer* pBuf)
+{
+	if (!pJob->pGrownDest)
+		return;
+	
+	// It already has everything we had.
+	IM_FREE(pBuf->Buf.Data);
+	pBuf->Buf.Data = pJob->pGrownDest;
+	pBuf->Buf.Capacity = pJob->GrownDestCapacity;
+	pJob->pGrownDest = nullptr;
+}
+
+static bool GetSidecarIndexPath(const char* pLogPath, char* pOutPath, size_t PathCapacity)
+{
+	int PathSize = snprintf(pOutPath, PathCapacity, "%s" SIDECAR_INDEX_EXTENSION, pLogPath);
+	return PathSize > 0 && PathSize < (int)PathCapacity;
+}
+
+// NOTE(matiasp): Hashing the whole file would cost as much as indexing it, a few blocks spread over it 
+// are enough to tell apart a file that was rewritten keeping the same size and time.
+static uint32_t HashSampledBlocks(const char* pContent, size_t ContentSize)
+{
+	size_t BlockSize = min((size_t)SIDECAR_SAMPLED_BLOCK_SIZE, ContentSize);
+	uint32_t Hash = 0;
+	
+	for (int i = 0; i < SIDECAR_SAMPLED_BLOCKS_COUNT; i++)
+	{
+		// The last one ends right at the end, that's where logs usually change.
+		size_t BlockStart = i == SIDECAR_SAMPLED_BLOCKS_COUNT - 1 ? ContentSize - BlockSize : 
+			((ContentSize - BlockSize) / (SIDECAR_SAMPLED_BLOCKS_COUNT - 1)) * i;
+		
+		Hash = HashString(pContent + BlockStart, pContent + BlockStart + BlockSize, Hash);
+	}
+	
+	return Hash;
+}
+
+static uint64_t GetFilterEnableMask(const CrazyTextFilter* pFilter)
+{
+	uint64_t EnableMask = 0;
+	for (int i = 0; i < pFilter->vSettings.Size && i < 64; i++)
+	{
+		if (pFilter->vSettings[i].bIsEnabled)
+			EnableMask |= 1ull << i;
+	}
+	
+	return EnableMask;
+}
+
+// The platform reads and writes at most 4GB at once.
+static bool ReadSidecarBlock(PlatformContext* pPlatformCtx, void* pHandle, uint64_t Offset, void* pDest, size_t Size)
+{
+	size_t ReadSize = 0;
+	while (ReadSize < Size)
+	{
+		size_t ChunkSize = min(Size - ReadSize, (size_t)LOAD_FILE_CHUNK_SIZE);
+		size_t BytesRead = pPlatformCtx->pReadFileChunkFunc(pHandle, Offset + ReadSize, (char*)pDest + ReadSize, ChunkSize);
+		if (BytesRead == 0)
+			return false;
+		
+		ReadSize += BytesRead;
+	}
+	
+	return true;
+}
+
+// The sidecar is just a file on disk, what it says about the lines is not trusted until it makes sense.
+static bool IsAscendingInRange(const int* pValues, int Count, int MinValue, int MaxValue)
+{
+	int PrevValue = MinValue - 1;
+	for (int i = 0; i < Count; i++)
+	{
+		int Value = pValues[i];
+		if (Value <= PrevValue || Value > MaxValue)
+			return false;
+		
+		PrevValue = Value;
+	}
+	
+	return true;
+}
+
+static bool WriteSidecarBlock(PlatformContext* pPlatformCtx, void* pHandle, const void* pData, size_t Size)
+{
+	for (size_t WrittenSize = 0; WrittenSize < Size; WrittenSize += (size_t)LOAD_FILE_CHUNK_SIZE)
+	{
+		FileContent Block;
+		Block.pFile = (char*)pData + WrittenSize;
+		Block.Size = min(Size - WrittenSize, (size_t)LOAD_FILE_CHUNK_SIZE);
+		
+		if (!pPlatformCtx->pStreamFileFunc(&Block, pHandle, false))
+			return false;
+	}
+	
+	return true;
+}
+
+// Returns the size of the filter entry at Offset, 0 past the last one or when it doesn't fit the log.
+static int ReadSidecarFilter(const ImVector<char>& vFilters, int Offset, int LinesCount, SidecarFilterHeader* pOutHeader)
+{
+	if (Offset + (int)sizeof(SidecarFilterHeader) > vFilters.Size)
+		return 0;
+	
+	memcpy(pOutHeader, vFilters.Data + Offset, sizeof(SidecarFilterHeader));
+	pOutHeader->aInputBuf[ArrayCount(pOutHeader->aInputBuf) - 1] = 0;
+	
+	if (pOutHeader->FiltredLinesCount < 0 || pOutHeader->FiltredLinesCount > LinesCount)
+		return 0;
+	
+	int LinesSize = pOutHeader->FiltredLinesCount * (int)sizeof(int);
+	if (LinesSize > vFilters.Size - Offset - (int)sizeof(SidecarFilterHeader))
+		return 0;
+	
+	// The results go straight to the views, every line has to be in the log and in order.
+	const int* pLines = (const int*)(vFilters.Data + Offset + sizeof(SidecarFilterHeader));
+	if (!IsAscendingInRange(pLines, pOutHeader->FiltredLinesCount, 0, LinesCount - 1))
+		return 0;
+	
+	return (int)sizeof(SidecarFilterHeader) + LinesSize;
+}
+
+bool CrazyLog::LoadFile(PlatformContext* pPlatformCtx) 
+{
+	if (aFilePathToLoad[0] == 0)
+		return false;
+		
+	bIsPeeking = false;
+	
+	CancelSaveFile();
+	CancelCopyLines();
+	CancelFilterLines();
+	CancelLoadFile();
+	SaveSidecarIndex(pPlatformCtx);
+	CloseStreamFile();
+	
+	size_t FileSize = 0;
+	void* pFileHandle = pPlatformCtx->pOpenFileFunc(aFilePathToLoad, &FileSize);
+	if (!pFileHandle)
+	{
+		SetLastCommand("FILE LOADED");
+		return false;
+	}
+	
+	// NOTE(matiasp): The line offsets are ints, a file this big would wrap them.
+	if (FileSize >= INT_MAX)
+	{
+		pPlatformCtx->pCloseFileFunc(pFileHandle);
+		SetLastCommand("FILES OF 2GB OR MORE ARE NOT SUPPORTED");
+		return false;
+	}
+	
+	// So streaming can tell if the file gets replaced after this.
+	memset(&StreamFileIdentity, 0, sizeof(StreamFileIdentity));
+	pPlatformCtx->pGetFileIdentityFunc(aFilePathToLoad, &StreamFileIdentity);
+	StreamFileStartSize = 0;
+	
+	// The start of the file tells how it's compressed and how the text is encoded.
+	uint8_t aSample[TEXT_ENCODING_SAMPLE_SIZE] = { 0 };
+	size_t SampleSize = pPlatformCtx->pReadFileChunkFunc(pFileHandle, 0, aSample, sizeof(aSample));
+	CompressionType Compression = DetectCompression(aSample, SampleSize);
+	
+	if (Compression == CT_Zstd)
+	{
+		pPlatformCtx->pCloseFileFunc(pFileHandle);
+		SetLastCommand("ZSTD COMPRESSION IS NOT SUPPORTED");
+		return false;
+	}
+	
+	int BOMSize = 0;
+	TextEncoding Encoding = Compression == CT_None ? DetectTextEncoding(aSample, SampleSize, &BOMSize) : TE_UTF8;
+	
+	// NOTE(matiasp): Static files are used straight from the mapped view, no copy at all.
+	// Streamed files keep growing so those are read into our own buffer, also the view 
+	// would prevent the writer from truncating the file.
+	// UTF-16 can't be used as it is, it's transcoded into our own buffer.
+	MappedFile NewMappedFile = { 0 };
+	bool bIsMapped = Compression == CT_None && Encoding == TE_UTF8 && bIsMemoryMappingEnabled && 
+		SelectedTargetMode == TM_StaticText && pPlatformCtx->pMapFileFunc(aFilePathToLoad, &NewMappedFile);
+	
+	if (bIsMapped)
+	{
+		pPlatformCtx->pCloseFileFunc(pFileHandle);
+		pFileHandle = nullptr;
+		FileSize = NewMappedFile.Size;
+	}
+	
+	// The BOM never makes it into the log.
+	size_t ContentSize = FileSize - BOMSize;
+	
+	bFileLoaded = false;
+	
+	UnmapLog(false);
+	Buf.Buf.clear();
+	
+	if (bIsMapped)
+	{
+		MappedLog = NewMappedFile;
+		pUnmapFileFunc = pPlatformCtx->pUnmapFileFunc;
+		
+		// The view already has the null terminator right after the content.
+		Buf.Buf.Data = (char*)MappedLog.pView + BOMSize;
+		Buf.Buf.Capacity = (int)ContentSize + 1;
+		Buf.Buf.Size = 1;
+	}
+	else
+	{
+		// NOTE(matiasp): Reserve the whole file upfront so the load thread can write into it 
+		// while we keep drawing the lines that are already indexed.
+		// The decompressed size is unknown, the load thread will hand over a bigger buffer.
+		int ReserveSize = 1;
+		if (Compression == CT_None)
+			ReserveSize = Encoding == TE_UTF8 ? (int)ContentSize + 1 : (int)(ContentSize / 2) + 1;
+		
+		Buf.Buf.reserve(ReserveSize);
+		Buf.Buf.resize(1);
+		Buf.Buf[0] = 0;
+	}
+	
+	LogEncoding = Encoding;
+	LogBOMSize = BOMSize;
+	
+	RebuildLineIndex();
+	
+	ClearCache();
+	ClearFindCache(false);
+	ClearHighlightCache();
+	
+	vLogSegments.resize(0);
+	LoadJob.vLoadSegments.resize(0);
+	
+	// Only a log that is the file as it is can have a sidecar index.
+	aSidecarLogPath[0] = 0;
+	vSidecarFilters.resize(0);
+	if (bIsMapped && bIsSidecarIndexEnabled)
+	{
+		strcpy_s(aSidecarLogPath, sizeof(aSidecarLogPath), aFilePathToLoad);
+		
+		memset(&SidecarHeader, 0, sizeof(SidecarHeader));
+		SidecarHeader.Magic = SIDECAR_INDEX_MAGIC;
+		SidecarHeader.Version = SIDECAR_INDEX_VERSION;
+		SidecarHeader.FileSize = StreamFileIdentity.Size;
+		SidecarHeader.LastWriteTime = StreamFileIdentity.LastWriteTime;
+		SidecarHeader.SampledBlocksHash = HashSampledBlocks(Buf.Buf.Data, ContentSize);
+		SidecarHeader.BOMSize = BOMSize;
+		SidecarHeader.LineIndexStride = LineIndexStride;
+		SidecarHeader.MaxLineSize = MaxLineSize;
+		
+		if (LoadSidecarIndex(pPlatformCtx, ContentSize))
+		{
+			bFileLoaded = true;
+			bSidecarIndexDirty = false;
+			LastFetchFileSize = (int)FileSize;
+			KeepStreamFileStart(Buf.begin(), (int)ContentSize);
+			
+			SetLastCommand("FILE LOADED FROM SIDECAR INDEX");
+			return FileSize > 0;
+		}
+		
+		bSidecarIndexDirty = true;
+	}
+	
+	StartLoadJob(pPlatformCtx, pFileHandle, ContentSize, Compression, Encoding, BOMSize, bIsMapped);
+	
+	return FileSize > 0;
+}
+
+// Loads every file that matches the folder query as a single log, from the oldest to the newest.
+// Only the newest one keeps being streamed.
+bool CrazyLog::LoadFolderFiles(PlatformContext* pPlatformCtx)
+{
+	if (aFolderQueryName[0] == 0)
+		return false;
+	
+	bIsPeeking = false;
+	
+	CancelSaveFile();
+	CancelCopyLines();
+	CancelFilterLines();
+	CancelLoadFile();
+	SaveSidecarIndex(pPlatformCtx);
+	CloseStreamFile();
+	
+	ImVector<FileData> vFolderFiles;
+	vFolderFiles.resize(FOLDER_FILES_RESERVE);
+	
+	int FolderFilesCount = 0;
+	while ((FolderFilesCount = pPlatformCtx->pListFolderFilesFunc(aFolderQueryName, vFolderFiles.Data, vFolderFiles.Size)) > vFolderFiles.Size)
+		vFolderFiles.resize(FolderFilesCount);
+	
+	vFolderFiles.resize(FolderFilesCount);
+	
+	vLogSegments.resize(0);
+	LoadJob.vLoadSegments.resize(0);
+	
+	for (int i = 0; i < vFolderFiles.Size; i++)
+	{
+		size_t FileSize = 0;
+		void* pFileHandle = pPlatformCtx->pOpenFileFunc(vFolderFiles[i].aFilePath, &FileSize);
+		if (!pFileHandle)
+			continue;
+		
+		// Rotated files are sometimes compressed, those can't be put next to the others as they are.
+		uint8_t aMagic[4] = { 0 };
+		size_t MagicSize = pPlatformCtx->pReadFileChunkFunc(pFileHandle, 0, aMagic, sizeof(aMagic));
+		
+		char LastChar = '\n';
+		if (FileSize > 0)
+			pPlatformCtx->pReadFileChunkFunc(pFileHandle, FileSize - 1, &LastChar, 1);
+		
+		// Same for UTF-16, the BOM is all we can look at here.
+		int BOMSize = 0;
+		if (FileSize == 0 || FileSize >= INT_MAX || DetectCompression(aMagic, MagicSize) != CT_None ||
+		    DetectTextEncoding(aMagic, MagicSize, &BOMSize) != TE_UTF8)
+		{
+			pPlatformCtx->pCloseFileFunc(pFileHandle);
+			continue;
+		}
+		
+		LoadJob.vLoadSegments.push_back(LoadSegment());
+		LoadSegment& NewLoadSegment = LoadJob.vLoadSegments.back();
+		NewLoadSegment.pFileHandle = pFileHandle;
+		NewLoadSegment.FileSize = (int)FileSize;
+		NewLoadSegment.bNeedsLineEnd = LastChar != '\n';
+		
+		vLogSegments.push_back(LogSegment());
+		LogSegment& NewLogSegment = vLogSegments.back();
+		NewLogSegment.FirstLineNo = INT_MAX;
+		strcpy_s(NewLogSegment.aFilePath, sizeof(NewLogSegment.aFilePath), vFolderFiles[i].aFilePath);
+	}
+	
+	// Keep the newest files that fit in the log.
+	int64_t TotalSize = 0;
+	int FirstSegmentIdx = LoadJob.vLoadSegments.Size;
+	while (FirstSegmentIdx > 0 && TotalSize + LoadJob.vLoadSegments[FirstSegmentIdx - 1].FileSize + 2 < INT_MAX)
+	{
+		FirstSegmentIdx--;
+		TotalSize += LoadJob.vLoadSegments[FirstSegmentIdx].FileSize + 1;
+	}
+	
+	for (int i = 0; i < FirstSegmentIdx; i++)
+		pPlatformCtx->pCloseFileFunc(LoadJob.vLoadSegments[i].pFileHandle);
+	
+	LoadJob.vLoadSegments.erase(LoadJob.vLoadSegments.begin(), LoadJob.vLoadSegments.begin() + FirstSegmentIdx);
+	vLogSegments.erase(vLogSegments.begin(), vLogSegments.begin() + FirstSegmentIdx);
+	
+	if (vLogSegments.Size == 0)
+	{
+		SetLastCommand("NO FILES TO LOAD");
+		return false;
+	}
+	
+	// The newest one is the one being written, it doesn't need a line end after it.
+	LoadJob.vLoadSegments.back().bNeedsLineEnd = false;
+	
+	TotalSize = 0;
+	for (int i = 0; i < vLogSegments.Size; i++)
+	{
+		LoadJob.vLoadSegments[i].Offset = (int)TotalSize;
+		vLogSegments[i].Offset = (int)TotalSize;
+		TotalSize += LoadJob.vLoadSegments[i].FileSize + (LoadJob.vLoadSegments[i].bNeedsLineEnd ? 1 : 0);
+	}
+	
+	strcpy_s(aFilePathToLoad, sizeof(aFilePathToLoad), vLogSegments.back().aFilePath);
+	
+	memset(&StreamFileIdentity, 0, sizeof(StreamFileIdentity));
+	pPlatformCtx->pGetFileIdentityFunc(aFilePathToLoad, &StreamFileIdentity);
+	StreamFileStartSize = 0;
+	
+	// The files are put together as they are, a BOM included.
+	LogEncoding = TE_UTF8;
+	LogBOMSize = 0;
+	
+	bFileLoaded = false;
+	
+	UnmapLog(false);
+	Buf.Buf.clear();
+	Buf.Buf.reserve((int)TotalSize + 1);
+	Buf.Buf.resize(1);
+	Buf.Buf[0] = 0;
+	
+	RebuildLineIndex();
+	
+	ClearCache();
+	ClearFindCache(false);
+	ClearHighlightCache();
+	
+	StartLoadJob(pPlatformCtx, nullptr, (size_t)TotalSize, CT_None, TE_UTF8, 0, false);
+	
+	return true;
+}
+
+void CrazyLog::StartLoadJob(PlatformContext* pPlatformCtx, void* pFileHandle, size_t FileSize, CompressionType Compression, 
+                            TextEncoding Encoding, int BOMSize, bool bIsMapped)
+{
+	LoadJob.pFileHandle = pFileHandle;
+	LoadJob.pReadFileChunkFunc = pPlatformCtx->pReadFileChunkFunc;
+	LoadJob.pCloseFileFunc = pPlatformCtx->pCloseFileFunc;
+	LoadJob.pPrefetchMemoryFunc = pPlatformCtx->pPrefetchMemoryFunc;
+	LoadJob.pDest = Buf.Buf.Data;
+	LoadJob.DestCapacity = Buf.Buf.Capacity;
+	LoadJob.FileSize = (int)FileSize;
+	LoadJob.LineIndexStride = LineIndexStride;
+	LoadJob.MaxLineSize = MaxLineSize;
+	LoadJob.PrefaultThreadCount = bIsParallelPrefaultEnabled && bIsMultithreadEnabled ? SelectedExtraThreadCount : 0;
+	LoadJob.ExtraThreadCount = bIsMultithreadEnabled ? SelectedExtraThreadCount : 0;
+	LoadJob.pWorkerPool = &WorkerPool;
+	LoadJob.Compression = Compression;
+	LoadJob.Encoding = Encoding;
+	LoadJob.BOMSize = BOMSize;
+	LoadJob.bUseAVX = bIsAVXEnabled;
+	LoadJob.bIsMapped = bIsMapped;
+	
+	if (!LoadJob.pReadAheadMutex)
+	{
+		LoadJob.pReadAheadMutex = IM_NEW(std::mutex)();
+		LoadJob.pReadAheadChanged = IM_NEW(std::condition_variable)();
+	}
+	
+	LoadJob.bDecompressFailed = false;
+	LoadJob.bOutOfMemory = false;
+	LoadJob.bReplacedInvalidUTF8 = false;
+	LoadJob.IndexedSize = 0;
+	LoadJob.IndexedLineStart = 0;
+	LoadJob.IndexedLinesCount = 1;
+	LoadJob.vPendingLineOffsets.resize(0);
+	LoadJob.vPendingSplitLines.resize(0);
+	LoadJob.PendingLinesCount = 0;
+	LoadJob.PublishedSize = 0;
+	LoadJob.pGrownDest = nullptr;
+	LoadJob.PublishedSegmentsCount = 0;
+	LoadJob.LoadedFileSize = 0;
+	LoadJob.bFinished = false;
+	LoadJob.bShouldCancel = false;
+	LoadJob.bIsRunning = true;
+	
+	// NOTE(matiasp): With a filter already set (like opening a file with a preset) the lines are filtered
+	// as they are loaded, so we don't wait for the whole file to start filtering.
+	LoadJob.bFilterLines = AnyFilterActive();
+	LoadJob.Filter = Filter;
+	LoadJob.bStopFiltering = false;
+	LoadJob.NextFilterOffset = 0;
+	LoadJob.NextFilterLineNo = 0;
+	LoadJob.vPendingFiltredLines.resize(0);
+	LoadJob.FiltredLinesCount = 0;
+	
+	bIsLoadingFile = true;
+	bIsLoadJobFiltering = LoadJob.bFilterLines;
+	LoadJobFiltredLinesCount = FiltredLinesCount;
+	
+	// Not worth to spawn a thread for a single chunk, compressed files can expand into many.
+	if (Compression == CT_None && FileSize <= LOAD_FILE_CHUNK_SIZE)
+		LoadFileChunks(&LoadJob);
+	else
+		std::thread(LoadFileChunks, &LoadJob).detach();
+	
+	UpdateLoadFile();
+}
+
+// Appends to the log the lines that the load thread indexed since the last frame.
+void CrazyLog::UpdateLoadFile()
+{
+	if (!bIsLoadingFile)
+		return;
+	
+	LockLoadJob(&LoadJob);
+	
+	AdoptGrownLoadBuffer(&LoadJob, &Buf);
+	
+	int PendingOffsetsCount = LoadJob.vPendingLineOffsets.Size;
+	if (PendingOffsetsCount > 0)
+	{
+		int OldSize = vLineOffsets.Size;
+		vLineOffsets.resize(OldSize + PendingOffsetsCount);
+		memcpy(vLineOffsets.Data + OldSize, LoadJob.vPendingLineOffsets.Data, PendingOffsetsCount * sizeof(int));
+		LoadJob.vPendingLineOffsets.resize(0);
+	}
+	
+	AppendInts(&vSplitLines, &LoadJob.vPendingSplitLines);
+	LoadJob.vPendingSplitLines.resize(0);
+	
+	for (int i = 0; i < LoadJob.PublishedSegmentsCount; i++)
+		vLogSegments[i].FirstLineNo = LoadJob.vLoadSegments[i].FirstLineNo;
+	
+	if (IsLoadJobFiltering())
+	{
+		int PendingFiltredCount = LoadJob.vPendingFiltredLines.Size;
+		if (PendingFiltredCount > 0)
+		{
+			int OldSize = vFiltredLinesCached.Size;
+			vFiltredLinesCached.resize(OldSize + PendingFiltredCount);
+			memcpy(vFiltredLinesCached.Data + OldSize, LoadJob.vPendingFiltredLines.Data, PendingFiltredCount * sizeof(int));
+		}
+		
+		FiltredLinesCount = LoadJob.FiltredLinesCount;
+		LoadJobFiltredLinesCount = FiltredLinesCount;
+	}
+	
+	LoadJob.vPendingFiltredLines.resize(0);
+	
+	int NewLinesCount = LoadJob.PendingLinesCount;
+	int PublishedSize = LoadJob.PublishedSize;
+	int LoadedFileSize = LoadJob.LoadedFileSize;
+	bool bFinished = LoadJob.bFinished;
+	LoadJob.PendingLinesCount = 0;
+	
+	UnlockLoadJob(&LoadJob);
+	
+	if (NewLinesCount > 0 || PublishedSize != Buf.size())
+	{
+		LinesCount += NewLinesCount;
+		Buf.Buf.Size = PublishedSize + 1;
+		bAlreadyCached = false;
+	}
+	
+	if (bFinished)
+	{
+		// The load thread is not touching the buffer anymore, so now we can null terminate it.
+		if (!MappedLog.pView)
+			Buf.Buf[PublishedSize] = 0;
+		
+		bIsLoadingFile = false;
+		bFileLoaded = true;
+		
+		// The lines after the ones the load job filtered are on us now.
+		bIsLoadJobFiltering = false;
+		bAlreadyCached = false;
+		
+		// Loading from the sidecar index skips replacing the invalid UTF-8, so this log can't have one.
+		if (LoadJob.bReplacedInvalidUTF8)
+			aSidecarLogPath[0] = 0;
+		
+		// Only the newest file is streamed.
+		LastFetchFileSize = vLogSegments.Size > 0 ? PublishedSize - vLogSegments.back().Offset : LoadedFileSize;
+		
+		// Unless some invalid UTF-8 was replaced, the start of the log is still what the file had.
+		StreamFileStartSize = 0;
+		if (LogEncoding == TE_UTF8 && !LoadJob.bReplacedInvalidUTF8)
+		{
+			int StreamedOffset = vLogSegments.Size > 0 ? vLogSegments.back().Offset : 0;
+			KeepStreamFileStart(Buf.begin() + StreamedOffset, PublishedSize - StreamedOffset);
+		}
+		
+		if (LoadJob.bOutOfMemory)
+			SetLastCommand("NOT ENOUGH MEMORY TO LOAD FILE");
+		else if (LoadJob.bDecompressFailed)
+			SetLastCommand("FAILED TO DECOMPRESS FILE");
+		else
+			SetLastCommand(LoadJob.Encoding != TE_UTF8 ? "FILE LOADED, TRANSCODED FROM UTF-16" : "FILE LOADED");
+	}
+	else
+	{
+		SetLastCommand("LOADING FILE");
+	}
+}
+
+static bool IsSameFilter(const CrazyTextFilter* pFilter, const CrazyTextFilter* pOther)
+{
+	bool bSameFilter = strcmp(pFilter->aInputBuf, pOther->aInputBuf) == 0 && 
+		pFilter->vSettings.Size == pOther->vSettings.Size;
+	
+	for (int i = 0; bSameFilter && i < pFilter->vSettings.Size; i++)
+		bSameFilter = pFilter->vSettings[i].bIsEnabled == pOther->vSettings[i].bIsEnabled;
+	
+	return bSameFilter;
+}
+
+// The load job filters the lines while the filter stays the one it took.
+bool CrazyLog::IsLoadJobFiltering()
+{
+	if (!bIsLoadJobFiltering)
+		return false;
+	
+	// Whoever reset the filtered lines wants them filtered again.
+	if (!IsSameFilter(&Filter, &LoadJob.Filter) || FiltredLinesCount != LoadJobFiltredLinesCount)
+	{
+		LoadJob.bStopFiltering = true;
+		bIsLoadJobFiltering = false;
+		
+		FiltredLinesCount = 0;
+		bAlreadyCached = false;
+	}
+	
+	return bIsLoadJobFiltering;
+}
+
+void CrazyLog::CancelLoadFile()
+{
+	LoadJob.bShouldCancel = true;
+	LoadJob.bStopFiltering = true;
+	SignalReadAhead(&LoadJob);
+	while (LoadJob.bIsRunning)
+		std::this_thread::yield();
+	
+	bIsLoadJobFiltering = false;
+	
+	if (bIsLoadingFile)
+	{
+		bIsLoadingFile = false;
+		AdoptGrownLoadBuffer(&LoadJob, &Buf);
+		
+		// Don't stomp the content of the view, the buffer is going to be discarded anyway.
+		if (!MappedLog.pView)
+			Buf.Buf[Buf.size()] = 0;
+	}
+}
+
+// The log buffer can be pointing to a mapped view, ImGui can't grow or free that memory.
+void CrazyLog::UnmapLog(bool bKeepContent)
+{
+	if (!MappedLog.pView)
+		return;
+	
+	// From now on the log is not the file as it is.
+	aSidecarLogPath[0] = 0;
+	
+	char* pOwnedBuf = nullptr;
+	int OwnedSize = 0;
+	if (bKeepContent)
+	{
+		OwnedSize = Buf.Buf.Size;
+		pOwnedBuf = (char*)IM_ALLOC(OwnedSize);
+		memcpy(pOwnedBuf, Buf.Buf.Data, OwnedSize);
+	}
+	
+	Buf.Buf.Data = pOwnedBuf;
+	Buf.Buf.Size = OwnedSize;
+	Buf.Buf.Capacity = OwnedSize;
+	
+	pUnmapFileFunc(&MappedLog);
+}
+
+// Takes the line index from the sidecar instead of indexing the log, it's only trusted 
+// when it matches the size, the time and the sampled blocks of the file.
+bool CrazyLog::LoadSidecarIndex(PlatformContext* pPlatformCtx, size_t ContentSize)
+{
+	char aSidecarPath[MAX_PATH * 2];
+	if (!GetSidecarIndexPath(aSidecarLogPath, aSidecarPath, sizeof(aSidecarPath)))
+		return false;
+	
+	size_t SidecarSize = 0;
+	void* pSidecarHandle = pPlatformCtx->pOpenFileFunc(aSidecarPath, &SidecarSize);
+	if (!pSidecarHandle)
+		return false;
+	
+	SidecarIndexHeader Header = { 0 };
+	bool bIsValid = SidecarSize >= sizeof(Header) && ReadSidecarBlock(pPlatformCtx, pSidecarHandle, 0, &Header, sizeof(Header)) &&
+		Header.Magic == SidecarHeader.Magic && Header.Version == SidecarHeader.Version &&
+		Header.FileSize == SidecarHeader.FileSize && Header.LastWriteTime == SidecarHeader.LastWriteTime &&
+		Header.SampledBlocksHash == SidecarHeader.SampledBlocksHash && Header.BOMSize == SidecarHeader.BOMSize &&
+		Header.LineIndexStride == LineIndexStride && Header.MaxLineSize == MaxLineSize && Header.LinesCount > 0 &&
+		Header.LineOffsetsCount == (Header.LinesCount - 1) / LineIndexStride + 1 &&
+		Header.SplitLinesCount >= 0 && Header.SplitLinesCount < Header.LinesCount;
+	
+	size_t OffsetsSize = bIsValid ? Header.LineOffsetsCount * sizeof(int) : 0;
+	size_t SplitLinesSize = bIsValid ? Header.SplitLinesCount * sizeof(int) : 0;
+	size_t IndexSize = sizeof(Header) + OffsetsSize + SplitLinesSize;
+	bIsValid = bIsValid && IndexSize <= SidecarSize;
+	
+	if (bIsValid)
+	{
+		vLineOffsets.resize(Header.LineOffsetsCount);
+		bIsValid = ReadSidecarBlock(pPlatformCtx, pSidecarHandle, sizeof(Header), vLineOffsets.Data, OffsetsSize) &&
+			vLineOffsets[0] == 0 && IsAscendingInRange(vLineOffsets.Data, vLineOffsets.Size, 0, (int)ContentSize);
+	}
+	
+	if (bIsValid && SplitLinesSize > 0)
+	{
+		vSplitLines.resize(Header.SplitLinesCount);
+		bIsValid = ReadSidecarBlock(pPlatformCtx, pSidecarHandle, sizeof(Header) + OffsetsSize, vSplitLines.Data, SplitLinesSize) &&
+			IsAscendingInRange(vSplitLines.Data, vSplitLines.Size, 1, Header.LinesCount - 1);
+	}
+	
+	// The filter entries are checked when those are used.
+	if (bIsValid)
+	{
+		vSidecarFilters.resize((int)(SidecarSize - IndexSize));
+		bIsValid = ReadSidecarBlock(pPlatformCtx, pSidecarHandle, IndexSize, vSidecarFilters.Data, vSidecarFilters.Size);
+	}
+	
+	pPlatformCtx->pCloseFileFunc(pSidecarHandle);
+	
+	if (!bIsValid)
+	{
+		vSidecarFilters.resize(0);
+		RebuildLineIndex();
+		return false;
+	}
+	
+	LinesCount = Header.LinesCount;
+	Buf.Buf.Size = (int)ContentSize + 1;
+	
+	return true;
+}
+
+// Writes the sidecar index when the line index or the results of the current filter are not in it yet.
+void CrazyLog::SaveSidecarIndex(PlatformContext* pPlatformCtx)
+{
+	if (aSidecarLogPath[0] == 0 || !bFileLoaded || bIsLoadingFile)
+		return;
+	
+	// Rebuilt with another interval since it was loaded.
+	if (SidecarHeader.LineIndexStride != LineIndexStride)
+	{
+		SidecarHeader.LineIndexStride = LineIndexStride;
+		bSidecarIndexDirty = true;
+	}
+	
+	// Same with the long lines split at another size.
+	if (SidecarHeader.MaxLineSize != MaxLineSize)
+	{
+		SidecarHeader.MaxLineSize = MaxLineSize;
+		bSidecarIndexDirty = true;
+	}
+	
+	// Only the results that cover the whole log are worth keeping.
+	bool bHasNewFilter = AnyFilterActive() && FiltredLinesCount == LinesCount && FindSidecarFilter() == -1;
+	if (!bSidecarIndexDirty && !bHasNewFilter)
+		return;
+	
+	// Don't write the index of a file that changed after we loaded it.
+	FileIdentity Identity = { 0 };
+	if (!pPlatformCtx->pGetFileIdentityFunc(aSidecarLogPath, &Identity) || 
+	    Identity.Size != SidecarHeader.FileSize || Identity.LastWriteTime != SidecarHeader.LastWriteTime)
+		return;
+	
+	char aSidecarPath[MAX_PATH * 2];
+	if (!GetSidecarIndexPath(aSidecarLogPath, aSidecarPath, sizeof(aSidecarPath)))
+		return;
+	
+	// The newest filter goes first, the oldest ones fall off.
+	ImVector<char> vFilters;
+	int FiltersCount = 0;
+	if (bHasNewFilter)
+	{
+		SidecarFilterHeader FilterHeader;
+		memset(&FilterHeader, 0, sizeof(FilterHeader));
+		strcpy_s(FilterHeader.aInputBuf, sizeof(FilterHeader.aInputBuf), Filter.aInputBuf);
+		FilterHeader.EnableMask = GetFilterEnableMask(&Filter);
+		FilterHeader.FiltredLinesCount = vFiltredLinesCached.Size;
+		
+		int LinesSize = vFiltredLinesCached.Size * (int)sizeof(int);
+		vFilters.resize((int)sizeof(FilterHeader) + LinesSize);
+		memcpy(vFilters.Data, &FilterHeader, sizeof(FilterHeader));
+		memcpy(vFilters.Data + sizeof(FilterHeader), vFiltredLinesCached.Data, LinesSize);
+		FiltersCount++;
+	}
+	
+	SidecarFilterHeader OldFilterHeader;
+	int KeptSize = 0;
+	int EntrySize = 0;
+	while (FiltersCount < SIDECAR_MAX_FILTERS && 
+	       (EntrySize = ReadSidecarFilter(vSidecarFilters, KeptSize, LinesCount, &OldFilterHeader)) > 0)
+	{
+		KeptSize += EntrySize;
+		FiltersCount++;
+	}
+	
+	int NewFiltersSize = vFilters.Size;
+	vFilters.resize(NewFiltersSize + KeptSize);
+	memcpy(vFilters.Data + NewFiltersSize, vSidecarFilters.Data, KeptSize);
+	
+	SidecarHeader.LinesCount = LinesCount;
+	SidecarHeader.LineOffsetsCount = vLineOffsets.Size;
+	SidecarHeader.SplitLinesCount = vSplitLines.Size;
+	SidecarHeader.FiltersCount = FiltersCount;
+	
+	void* pSidecarHandle = pPlatformCtx->pGetFileHandleFunc(aSidecarPath, 2 /* CREATE_ALWAYS */);
+	if (!pSidecarHandle)
+		return;
+	
+	bool bWritten = WriteSidecarBlock(pPlatformCtx, pSidecarHandle, &SidecarHeader, sizeof(SidecarHeader)) &&
+		WriteSidecarBlock(pPlatformCtx, pSidecarHandle, vLineOffsets.Data, vLineOffsets.Size * sizeof(int)) &&
+		WriteSidecarBlock(pPlatformCtx, pSidecarHandle, vSplitLines.Data, vSplitLines.Size * sizeof(int)) &&
+		WriteSidecarBlock(pPlatformCtx, pSidecarHandle, vFilters.Data, vFilters.Size);
+	
+	pPlatformCtx->pCloseFileFunc(pSidecarHandle);
+	
+	// A sidecar that was cut short gets discarded when it's loaded.
+	if (bWritten)
+	{
+		vSidecarFilters.swap(vFilters);
+		bSidecarIndexDirty = false;
+	}
+}
+
+// Returns where the entry with the results of the current filter starts in vSidecarFilters, -1 if there is none.
+int CrazyLog::FindSidecarFilter()
+{
+	uint64_t EnableMask = GetFilterEnableMask(&Filter);
+	
+	SidecarFilterHeader FilterHeader;
+	int Offset = 0;
+	int EntrySize = 0;
+	while ((EntrySize = ReadSidecarFilter(vSidecarFilters, Offset, LinesCount, &FilterHeader)) > 0)
+	{
+		if (FilterHeader.EnableMask == EnableMask && strcmp(FilterHeader.aInputBuf, Filter.aInputBuf) == 0)
+			return Offset;
+		
+		Offset += EntrySize;
+	}
+	
+	return -1;
+}
+
+void CrazyLog::LoadFilters(PlatformContext* pPlatformCtx)
+{	
+	const char* NoneFilterName = "NONE";
+	NamedFilter NoneFilter = { 0 };
+	strcpy_s(NoneFilter.aName, sizeof(NoneFilter.aName), NoneFilterName);
+	
+	FileContent File = pPlatformCtx->pReadFileFunc(FILTERS_FILE_NAME);
+	if (File.pFile) 
+	{
+		cJSON * pJsonRoot = cJSON_ParseWithLength((char*)File.pFile, File.Size);
+		cJSON * pFiltersArray = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "Filters");
+		cJSON * pFilter = nullptr;
+		cJSON * pColor = nullptr;
+		cJSON * pEnabled = nullptr;
+		
+		unsigned FiltersCounter = 1;
+		int FiltersCount = cJSON_GetArraySize(pFiltersArray);
+		LoadedFilters.resize(FiltersCount + 1, { 0 });
+		
+		//Add dummy so we can reset the selection
+		LoadedFilters[0] = NoneFilter;
+		
+		cJSON_ArrayForEach(pFilter, pFiltersArray)
+		{
+			cJSON * pFilterName = cJSON_GetObjectItemCaseSensitive(pFilter, "key");
+			cJSON * pFilterValue = cJSON_GetObjectItemCaseSensitive(pFilter, "value");
+			
+			NamedFilter* pNamedFilter = &LoadedFilters[FiltersCounter];
+			strcpy_s(pNamedFilter->aName, sizeof(pNamedFilter->aName), pFilterName->valuestring);
+			strcpy_s(pNamedFilter->Filter.aInputBuf, sizeof(pNamedFilter->Filter.aInputBuf),  pFilterValue->valuestring);
+			
+			cJSON * pColorArray = cJSON_GetObjectItemCaseSensitive(pFilter, "colors");
+			cJSON * pEnableMaskArray = cJSON_GetObjectItemCaseSensitive(pFilter, "enable_mask");
+			
+			int ColorsCount = cJSON_GetArraySize(pColorArray);
+			int EnablesCount = cJSON_GetArraySize(pColorArray);
+			pNamedFilter->Filter.vSettings.resize(max(ColorsCount, EnablesCount));
+			
+			unsigned ColorCounter = 0;
+			cJSON_ArrayForEach(pColor, pColorArray)
+			{
+				ImVec4 Color;
+				StringUtils::HexToRGB(pColor->valuestring, &Color.x);
+				Color.x /= 255;
+				Color.y /= 255;
+				Color.z /= 255;
+				Color.w /= 255;
+				
+				pNamedFilter->Filter.vSettings[ColorCounter].Color = Color;
+				ColorCounter++;
+			}
+			
+#if SAVE_ENABLE_MASK
+			unsigned EnablesCounter = 0;
+			cJSON_ArrayForEach(pEnabled, pEnableMaskArray)
+			{
+				pNamedFilter->Filter.vSettings[EnablesCounter].bIsEnabled = cJSON_IsTrue(pEnabled);
+				EnablesCounter++;
+			}
+#endif
+			
+			pNamedFilter->Filter.Build(&vDefaultColors, false);
+			
+			FiltersCounter++;
+		}
+		
+		free(pJsonRoot);
+		pPlatformCtx->pFreeFileContentFunc(&File);
+	}
+	else
+	{
+		LoadedFilters.reserve_discard(1);
+		LoadedFilters.resize(0);
+		
+		LoadedFilters.push_back(NoneFilter);
+	}
+}
+
+void CrazyLog::SaveLoadedFilters(PlatformContext* pPlatformCtx) 
+{
+	FileContent OutFile = {0};
+	
+	cJSON * pJsonRoot = cJSON_CreateObject();
+	cJSON * pJsonFilterArray = cJSON_CreateArray();
+	cJSON * pFilterValue = nullptr;
+	cJSON * pFilterName = nullptr;
+	cJSON * pFilterColor = nullptr;
+	cJSON * pFilterEnabled = nullptr;
+	
+	cJSON * pFilterObj = nullptr;
+	cJSON_AddItemToObject(pJsonRoot, "Filters", pJsonFilterArray);
+	
+	// Start from 1 to skip the NONE filter
+	for (unsigned i = 1; i < (unsigned)LoadedFilters.size(); ++i)
 	{
 		pFilterObj = cJSON_CreateObject();
 		
@@ -399,14 +2653,14 @@ void CrazyLog::RestoreLastSession(TargetMode LastTargetMode, PlatformContext* pP
 			PendingModeChange = TMCR_RecentSelected;
 		}
 		
-	} else if (LastTargetMode == TM_StreamLastModifiedFileFromFolder) {
+	} else if (LastTargetMode == TM_StreamLastModifiedFileFromFolder || LastTargetMode == TM_StreamAllFilesFromFolder) {
 		ImVector<RecentInputText>& vRecentStreamPaths = avRecentInputText[RITT_StreamPath];
 		int StreamPathsTail = aRecentInputTextTail[RITT_StreamPath];
 
 		if (StreamPathsTail != -1) {
 			memcpy(aFolderQueryName, vRecentStreamPaths[StreamPathsTail].aText, sizeof(RecentInputText::aText));
 						
-			SelectedTargetMode = TM_StreamLastModifiedFileFromFolder;
+			SelectedTargetMode = LastTargetMode;
 			PendingModeChange = TMCR_RecentSelected;
 		}
 		
@@ -453,6 +2707,58 @@ void CrazyLog::LoadSettings(PlatformContext* pPlatformCtx) {
 		if (pSelectedThreadCount)
 			SelectedExtraThreadCount = min(MaxExtraThreadCount, (int)pSelectedThreadCount->valuedouble);
 		
+		cJSON * pIsAutoThreadCountEnabled = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "is_auto_thread_count_enabled");
+		if (pIsAutoThreadCountEnabled)
+			bIsAutoThreadCountEnabled = cJSON_IsTrue(pIsAutoThreadCountEnabled);
+		
+		cJSON * pAutoThreadCount = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "auto_thread_count");
+		cJSON * pAutoThreadCountCores = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "auto_thread_count_cores");
+		cJSON * pAutoThreadCountSpeedup = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "auto_thread_count_speedup");
+		if (pAutoThreadCount && pAutoThreadCountCores && pAutoThreadCountSpeedup)
+		{
+			AutoExtraThreadCount = (int)pAutoThreadCount->valuedouble;
+			AutoThreadCountCores = (int)pAutoThreadCountCores->valuedouble;
+			AutoThreadCountSpeedup = (int)pAutoThreadCountSpeedup->valuedouble;
+			
+			// The settings file came from another machine, what it measured there is worth nothing here.
+			bWantsToTuneThreadCount = AutoThreadCountCores != MaxExtraThreadCount + 1;
+		}
+		
+		if (bIsAutoThreadCountEnabled && !bWantsToTuneThreadCount)
+			ApplyAutoThreadCount();
+		
+		cJSON * pIsSparseLineIndexEnabled = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "is_sparse_line_index_enabled");
+		if (pIsSparseLineIndexEnabled)
+			bIsSparseLineIndexEnabled = cJSON_IsTrue(pIsSparseLineIndexEnabled);
+		
+		cJSON * pSparseLineIndexInterval = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "sparse_line_index_interval");
+		if (pSparseLineIndexInterval)
+			SparseLineIndexInterval = clamp((int)pSparseLineIndexInterval->valuedouble, MAX_SPARSE_LINE_INDEX_INTERVAL, 2);
+		
+		cJSON * pIsLineSplitEnabled = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "is_line_split_enabled");
+		if (pIsLineSplitEnabled)
+			bIsLineSplitEnabled = cJSON_IsTrue(pIsLineSplitEnabled);
+		
+		cJSON * pSplitLineSizeKB = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "split_line_size_kb");
+		if (pSplitLineSizeKB)
+			SplitLineSizeKB = clamp((int)pSplitLineSizeKB->valuedouble, MAX_SPLIT_LINE_SIZE_KB, MIN_SPLIT_LINE_SIZE_KB);
+		
+		cJSON * pIsMemoryMappingEnabled = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "is_memory_mapping_enabled");
+		if (pIsMemoryMappingEnabled)
+			bIsMemoryMappingEnabled = cJSON_IsTrue(pIsMemoryMappingEnabled);
+		
+		cJSON * pIsParallelPrefaultEnabled = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "is_parallel_prefault_enabled");
+		if (pIsParallelPrefaultEnabled)
+			bIsParallelPrefaultEnabled = cJSON_IsTrue(pIsParallelPrefaultEnabled);
+		
+		cJSON * pIsSidecarIndexEnabled = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "is_sidecar_index_enabled");
+		if (pIsSidecarIndexEnabled)
+			bIsSidecarIndexEnabled = cJSON_IsTrue(pIsSidecarIndexEnabled);
+		
+		cJSON * pMaxCopySizeMB = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "max_copy_size_mb");
+		if (pMaxCopySizeMB)
+			MaxCopySizeMB = clamp((int)pMaxCopySizeMB->valuedouble, MAX_COPY_SIZE_MB, 0);
+		
 		cJSON * pColorArray = cJSON_GetObjectItemCaseSensitive(pJsonRoot, "default_colors");
 		
 		// Load by default some colors if non are stored 
@@ -845,16 +3151,15 @@ void CrazyLog::SaveFilter(PlatformContext* pPlatformCtx, int FilterIdx, CrazyTex
 // This method will append to the buffer
 void CrazyLog::AddLog(const char* pFileContent, int FileSize) 
 {
+	CancelSaveFile();
+	CancelCopyLines();
+	CancelFilterLines();
+	UnmapLog(true);
+	
 	int OldSize = Buf.size();
 	Buf.append(pFileContent, pFileContent + FileSize);
 	
-	for (int NewSize = Buf.size(); OldSize < NewSize; OldSize++)
-	{
-		if (Buf[OldSize] == '\n')
-		{
-			vLineOffsets.push_back(OldSize + 1);
-		}
-	}
+	IndexLines(OldSize);
 	
 	bAlreadyCached = false;
 }
@@ -862,27 +3167,249 @@ void CrazyLog::AddLog(const char* pFileContent, int FileSize)
 // This method will stomp the old buffer;
 void CrazyLog::SetLog(const char* pFileContent, int FileSize) 
 {
+	CancelSaveFile();
+	CancelCopyLines();
+	CancelFilterLines();
+	CancelLoadFile();
+	CloseStreamFile();
+	UnmapLog(false);
+	
 	Buf.Buf.clear();
-	vLineOffsets.clear();
 	
-	Buf.append(pFileContent, pFileContent + FileSize);
-	vLineOffsets.push_back(0);
+	// NOTE(matiasp): UTF-16 gets transcoded while it's copied in, anything else is copied as it is
+	// and the invalid UTF-8 is replaced while indexing the lines.
+	int BOMSize = 0;
+	TextEncoding Encoding = DetectTextEncoding((const uint8_t*)pFileContent, (size_t)FileSize, &BOMSize);
+	if (Encoding == TE_UTF8)
+	{
+		Buf.append(pFileContent + BOMSize, pFileContent + FileSize);
+	}
+	else
+	{
+		// Worst case every code unit turns into 3 bytes.
+		int SrcSize = FileSize - BOMSize;
+		Buf.Buf.reserve((SrcSize / 2) * 3 + 4 + 1);
+		
+		int TranscodedSize = 0;
+		TranscodeUTF16ToUTF8(pFileContent + BOMSize, SrcSize, Buf.Buf.Data, Buf.Buf.Capacity - 1, &TranscodedSize, 
+		                     Encoding, true, bIsAVXEnabled);
+		
+		Buf.Buf.resize(TranscodedSize + 1);
+		Buf.Buf[TranscodedSize] = 0;
+	}
+	
+	vLogSegments.resize(0);
+	LogEncoding = TE_UTF8;
+	LogBOMSize = 0;
+	
+	RebuildLineIndex();
 	
-	int old_size = 0;
-	for (int new_size = Buf.size(); old_size < new_size; old_size++)
+	// Nothing else is coming, so a character cut by the end is not valid either.
+	if (Buf.Buf.Data)
 	{
-		if (Buf[old_size] == '\n')
-		{
-			vLineOffsets.push_back(old_size + 1);
-		}
+		char* pBufEnd = Buf.Buf.Data + Buf.size();
+		FindNewLineSanitizeUTF8(FindUTF8IncompleteStart(Buf.Buf.Data, pBufEnd), pBufEnd, bIsAVXEnabled);
 	}
 	
 	// Reset the cache and reserve the max amount needed
 	ClearCache();
 	ClearFindCache(false);
-	vFiltredLinesCached.reserve_discard(vLineOffsets.Size);
-	vFindFullViewLinesCached.reserve_discard(vLineOffsets.Size);
-	vFindFiltredLinesCached.reserve_discard(vLineOffsets.Size);
+	ClearHighlightCache();
+	
+	// NOTE(matiasp): With the sparse index we are trying to save memory, 
+	// so let the caches grow only as much as the results need.
+	if (LineIndexStride == 1)
+	{
+		vFiltredLinesCached.reserve_discard(LinesCount);
+		vFindFullViewLinesCached.reserve_discard(LinesCount);
+		vFindFiltredLinesCached.reserve_discard(LinesCount);
+	}
+}
+
+// Index the lines found between FromOffset and the end of the buffer.
+// NOTE(matiasp): The invalid UTF-8 gets replaced on the way, a character cut by the end
+// of the buffer is checked in the next call once the rest of it arrives.
+void CrazyLog::IndexLines(int FromOffset)
+{
+	char* pBuf = Buf.Buf.Data;
+	if (!pBuf)
+		return;
+	
+	char* pCursor = FindUTF8IncompleteStart(pBuf, pBuf + FromOffset);
+	char* pIndexEnd = FindUTF8IncompleteStart(pCursor, pBuf + Buf.size());
+	
+	// The last line could have to be split now that more of it is here.
+	char* pLineStart = (char*)FindLineStart(LinesCount - 1);
+	
+	while (true)
+	{
+		char* pLineEnd = FindNewLineSanitizeUTF8(pCursor, pIndexEnd, bIsAVXEnabled);
+		
+		char* pSplit = FindKnownLineSplit(pBuf, pLineStart, pLineEnd, MaxLineSize);
+		if (pSplit)
+		{
+			vSplitLines.push_back(LinesCount);
+			pLineStart = pSplit;
+			pCursor = pLineEnd;
+		}
+		else if (pLineEnd != pIndexEnd)
+		{
+			pLineStart = pLineEnd + 1;
+			pCursor = pLineStart;
+		}
+		else
+		{
+			break;
+		}
+		
+		// Sparse mode only keeps a checkpoint every LineIndexStride lines.
+		if (LinesCount % LineIndexStride == 0)
+			vLineOffsets.push_back((int)(pLineStart - pBuf));
+		
+		LinesCount++;
+	}
+}
+
+void CrazyLog::RebuildLineIndex()
+{
+	LineIndexStride = bIsSparseLineIndexEnabled ? max(2, SparseLineIndexInterval) : 1;
+	MaxLineSize = bIsLineSplitEnabled ? (int)Kilobytes(SplitLineSizeKB) : 0;
+	LastResolvedLineNo = -1;
+	
+	vLineOffsets.resize(0);
+	vLineOffsets.push_back(0);
+	vSplitLines.resize(0);
+	LinesCount = 1;
+	
+	IndexLines(0);
+}
+
+// Thread safe, in sparse mode it will scan forward from the closest checkpoint.
+const char* CrazyLog::FindLineStart(int LineNo) const
+{
+	const char* pBuf = Buf.begin();
+	if (LineIndexStride == 1)
+		return pBuf + vLineOffsets[LineNo];
+	
+	const char* pLineStart = pBuf + vLineOffsets[LineNo / LineIndexStride];
+	for (int i = LineNo % LineIndexStride; i > 0; i--)
+		pLineStart = FindNextLineStart(pLineStart);
+	
+	return pLineStart;
+}
+
+const char* CrazyLog::FindLineEnd(int LineNo, const char* pLineStart) const
+{
+	if (LineIndexStride == 1)
+	{
+		if (LineNo + 1 >= LinesCount)
+			return Buf.end();
+		
+		// A split line goes on right where the next one starts.
+		const char* pNextLineStart = Buf.begin() + vLineOffsets[LineNo + 1];
+		return pNextLineStart[-1] == '\n' ? pNextLineStart - 1 : pNextLineStart;
+	}
+	
+	return FindVirtualLineEnd(Buf.begin(), Buf.end(), pLineStart, Buf.end(), MaxLineSize, bIsAVXEnabled);
+}
+
+// Thread safe, walks to the next line the same way the lines were indexed.
+const char* CrazyLog::FindNextLineStart(const char* pLineStart) const
+{
+	const char* pBufEnd = Buf.end();
+	return SkipLineEnd(FindVirtualLineEnd(Buf.begin(), pBufEnd, pLineStart, pBufEnd, MaxLineSize, bIsAVXEnabled), pBufEnd);
+}
+
+// The line number in the file of the line that was split into LineNo, pOutIsSplit tells if it goes on from the one before.
+int CrazyLog::GetFileLineNo(int LineNo, bool* pOutIsSplit) const
+{
+	// How many of the split lines come up to LineNo.
+	int Low = 0;
+	int High = vSplitLines.Size;
+	while (Low < High)
+	{
+		int Mid = (Low + High) / 2;
+		if (vSplitLines[Mid] <= LineNo)
+			Low = Mid + 1;
+		else
+			High = Mid;
+	}
+	
+	*pOutIsSplit = Low > 0 && vSplitLines[Low - 1] == LineNo;
+	return LineNo - Low;
+}
+
+// Only meant to be used from the main thread, since it remembers the last resolved line.
+void CrazyLog::GetLineRange(int LineNo, const char** ppLineStart, const char** ppLineEnd)
+{
+	const char* pLineStart = nullptr;
+	
+	if (LineIndexStride > 1)
+	{
+		// The views walk the lines in order, so resume from the last resolved line 
+		// if it's closer than the checkpoint.
+		int CheckpointLineNo = (LineNo / LineIndexStride) * LineIndexStride;
+		if (LastResolvedLineNo >= CheckpointLineNo && LastResolvedLineNo <= LineNo)
+		{
+			pLineStart = Buf.begin() + LastResolvedLineOffset;
+			for (int i = LineNo - LastResolvedLineNo; i > 0; i--)
+				pLineStart = FindNextLineStart(pLineStart);
+		}
+		else
+		{
+			pLineStart = FindLineStart(LineNo);
+		}
+		
+		LastResolvedLineNo = LineNo;
+		LastResolvedLineOffset = (int)(pLineStart - Buf.begin());
+	}
+	else
+	{
+		pLineStart = FindLineStart(LineNo);
+	}
+	
+	*ppLineStart = pLineStart;
+	*ppLineEnd = FindLineEnd(LineNo, pLineStart);
+}
+
+// Which file of the folder the line comes from, -1 if it was not loaded from a folder.
+int CrazyLog::FindLogSegment(int LineNo) const
+{
+	int Low = 0;
+	int High = vLogSegments.Size - 1;
+	int Found = -1;
+	while (Low <= High)
+	{
+		int Mid = (Low + High) / 2;
+		if (vLogSegments[Mid].FirstLineNo <= LineNo)
+		{
+			Found = Mid;
+			Low = Mid + 1;
+		}
+		else
+		{
+			High = Mid - 1;
+		}
+	}
+	
+	return Found;
+}
+
+// Index of the first of the sorted lines that is LineNo or comes after it, vLines.Size if there is none.
+static int FindFirstLineIdx(const ImVector<int>* pvLines, int LineNo)
+{
+	int Low = 0;
+	int High = pvLines->Size;
+	while (Low < High)
+	{
+		int Mid = Low + (High - Low) / 2;
+		if ((*pvLines)[Mid] < LineNo)
+			Low = Mid + 1;
+		else
+			High = Mid;
+	}
+	
+	return Low;
 }
 
 void CrazyLog::ClearFindCache(bool bOnlyFilter) {
@@ -894,7 +3421,9 @@ void CrazyLog::ClearFindCache(bool bOnlyFilter) {
 	if (bOnlyFilter) return;
 	
 	vFindFullViewLinesCached.clear();
+	vFindFullViewNarrowLines.clear();
 	FindFullViewProccesedLinesCount = 0;
+	FindFullViewNarrowedLinesCount = 0;
 	CurrentFindFullViewIdx = 0;
 }
 
@@ -907,6 +3436,9 @@ void CrazyLog::ClearCache() {
 
 void CrazyLog::PreDraw(PlatformContext* pPlatformCtx)
 {
+	// Only grows, so the workers are already parked when the thread count is bumped or after a hot reload.
+	GrowThreadPool(&WorkerPool, SelectedExtraThreadCount);
+	
 	if (bWantsToScaleFont)
 	{
 		bWantsToScaleFont = false;
@@ -947,6 +3479,11 @@ void CrazyLog::Draw(float DeltaTime, PlatformContext* pPlatformCtx, const char*
 		}
 	}
 	
+	UpdateLoadFile();
+	UpdateSaveFile(pPlatformCtx);
+	UpdateCopyLines();
+	UpdateFilterLines(pPlatformCtx);
+	
 	DrawMainBar(DeltaTime, pPlatformCtx);
 	
 	//=============================================================
@@ -1045,9 +3582,9 @@ void CrazyLog::Draw(float DeltaTime, PlatformContext* pPlatformCtx, const char*
 			{
 				CurrentSelectionMode = SM_Normal;
 				Selection.Start = { 0, 0 };
-				if (vLineOffsets.size()) {
-					size_t Column = Buf.end() - (Buf.begin() + vLineOffsets[vLineOffsets.size() - 1]);
-					Selection.End = { vLineOffsets.size() - 1, (int)Column };
+				if (LinesCount) {
+					size_t Column = Buf.end() - FindLineStart(LinesCount - 1);
+					Selection.End = { LinesCount - 1, (int)Column };
 				} else {
 					Selection.End = { 0, 0 };
 				}
@@ -1094,26 +3631,29 @@ void CrazyLog::Draw(float DeltaTime, PlatformContext* pPlatformCtx, const char*
 			ImGuiTextBuffer CopyBuffer;
 			if (!bIsPeeking && AnyFilterActive()) // Copy Filtred view 
 			{
-				const char* pSelectionStart = vLineOffsets.size() > Selection.Start.Line ? 
-					Buf.begin() + vLineOffsets[Selection.Start.Line] + Selection.Start.Column : nullptr;
+				const char* pSelectionStart = LinesCount > Selection.Start.Line ? 
+					FindLineStart(Selection.Start.Line) + Selection.Start.Column : nullptr;
 
-				const char* pSelectionEnd = vLineOffsets.size() > Selection.End.Line ? 
-					Buf.begin() + vLineOffsets[Selection.End.Line] + Selection.End.Column : nullptr;
+				const char* pSelectionEnd = LinesCount > Selection.End.Line ? 
+					FindLineStart(Selection.End.Line) + Selection.End.Column : nullptr;
 
-				for (int j = 0; j < vFiltredLinesCached.size(); j++) {
+				for (int j = FindFirstLineIdx(&vFiltredLinesCached, Selection.Start.Line); j < vFiltredLinesCached.size(); j++) {
 		
 					int FilteredLineNo = vFiltredLinesCached[j];
-					if (FilteredLineNo < Selection.Start.Line)
-						continue;
 
-					const char* pFilteredLineStart = Buf.begin() + vLineOffsets[FilteredLineNo];
-					const char* pFilteredLineEnd = FilteredLineNo + 1 < vLineOffsets.Size ? (Buf.begin() + vLineOffsets[FilteredLineNo + 1] - 1) : Buf.end();
+					const char* pFilteredLineStart;
+					const char* pFilteredLineEnd;
+					GetLineRange(FilteredLineNo, &pFilteredLineStart, &pFilteredLineEnd);
 
 					const char* pStart = max(pSelectionStart, pFilteredLineStart);
 					const char* pEnd = min(pSelectionEnd, pFilteredLineEnd);
+					
+					// A split line that goes on in the next filtered line is still the same line.
+					bool bGoesOn = j + 1 < vFiltredLinesCached.size() && vFiltredLinesCached[j + 1] == FilteredLineNo + 1 &&
+						IsSplitLineEnd(pFilteredLineEnd, Buf.end());
 
 					CopyBuffer.append(pStart, pEnd);
-					if (pEnd != pSelectionEnd)
+					if (pEnd != pSelectionEnd && !bGoesOn)
 						CopyBuffer.append(&g_LineEndTerminator);
 
 					if (pEnd == pSelectionEnd) {
@@ -1123,8 +3663,8 @@ void CrazyLog::Draw(float DeltaTime, PlatformContext* pPlatformCtx, const char*
 			}
 			else // Copy from full view
 			{
-				const char* pSelectionStart = vLineOffsets.size() > Selection.Start.Line ? Buf.begin() + vLineOffsets[Selection.Start.Line] + Selection.Start.Column : nullptr;
-				const char* pSelectionEnd = vLineOffsets.size() > Selection.End.Line ? Buf.begin() + vLineOffsets[Selection.End.Line] + Selection.End.Column : nullptr;
+				const char* pSelectionStart = LinesCount > Selection.Start.Line ? FindLineStart(Selection.Start.Line) + Selection.Start.Column : nullptr;
+				const char* pSelectionEnd = LinesCount > Selection.End.Line ? FindLineStart(Selection.End.Line) + Selection.End.Column : nullptr;
 
 				CopyBuffer.append(pSelectionStart, pSelectionEnd);
 			}
@@ -1156,21 +3696,14 @@ void CrazyLog::Draw(float DeltaTime, PlatformContext* pPlatformCtx, const char*
 		else if (bWantsToCopy)
 		{
 			if (!bIsPeeking && AnyFilterActive()) // Copy Filtred view 
+			{
+				CopyFilteredLines();
+			}
+			else if (bIsLoadingFile) // Copy from full view, the buffer is not null terminated yet.
 			{
 				ImGuiTextBuffer CopyBuffer;
-				for (int j = 0; j < vFiltredLinesCached.size(); j++) {
-					int FilteredLineNo = vFiltredLinesCached[j];
-
-					const char* pFilteredLineStart = Buf.begin() + vLineOffsets[FilteredLineNo];
-					const char* pFilteredLineEnd = FilteredLineNo + 1 < vLineOffsets.Size ? (Buf.begin() + vLineOffsets[FilteredLineNo + 1] - 1) : Buf.end();
-
-					CopyBuffer.append(pFilteredLineStart, pFilteredLineEnd);
-					if (FilteredLineNo != vFiltredLinesCached.size() - 1)
-						CopyBuffer.append(&g_LineEndTerminator);
-				}
-
+				CopyBuffer.append(Buf.begin(), Buf.end());
 				ImGui::SetClipboardText(CopyBuffer.begin());
-
 			}
 			else // Copy from full view
 			{
@@ -1220,246 +3753,773 @@ void CrazyLog::Draw(float DeltaTime, PlatformContext* pPlatformCtx, const char*
 			FindLines(pPlatformCtx);
 		}
 		
-		if (!bIsPeeking && AnyFilterActive())
+		UpdateHighlightCache();
+		
+		if (!bIsPeeking && AnyFilterActive())
+		{
+			DrawFiltredView(pPlatformCtx);
+		}
+		else
+		{
+			DrawFullView(pPlatformCtx);
+		}
+
+		HandleMouseInputs();
+		
+		if (OneTimeScrollValue > -1.f) {
+			ImGui::SetScrollY(OneTimeScrollValue);
+		}
+		
+		// Keep up at the bottom of the scroll region if we were already at the bottom at the beginning of the frame.
+		// Using a scrollbar or mouse-wheel will take away from the bottom edge.
+		bWantsToSnapScroll |= (bAutoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY());
+		if (!bIsPeeking && bWantsToSnapScroll)
+			ImGui::SetScrollHereY(1.0f);
+	}
+
+	
+	ImGui::PopFont();
+	ImGui::EndChild();
+	
+	
+	
+	ImGui::SeparatorText(aLastCommand);
+	
+	ImGui::End();
+}
+
+// Filter the lines in the range [FirstLineNo, LastLineNo), walking them in order so 
+// in sparse mode we only resolve the first line from its checkpoint.
+static void FilterMT(int FirstLineNo, int LastLineNo, CrazyLog* pLog, ImVector<int>* pOut) 
+{
+	if (FirstLineNo >= LastLineNo)
+		return;
+	
+	const char* pBufEnd = pLog->Buf.end();
+	const char* pLineStart = pLog->FindLineStart(FirstLineNo);
+	
+	for (int LineNo = FirstLineNo; LineNo < LastLineNo; LineNo++)
+	{
+		const char* pLineEnd = pLog->FindLineEnd(LineNo, pLineStart);
+		
+		if (pLog->Filter.PassFilter(pLineStart, pLineEnd, pBufEnd, pLog->bIsAVXEnabled)) 
+		{
+			pOut->push_back(LineNo);
+		}
+		
+		pLineStart = SkipLineEnd(pLineEnd, pBufEnd);
+	}
+}
+
+// The lines are looked at in slices of the same count, whoever is free takes the next one.
+struct FindLinesSlice
+{
+	const CrazyLog* pLog;
+	const int* pLines;
+	int Count;
+	const char* pFindText;
+	int FindTextLen;
+	ImVector<int> vLines; // The line numbers that have the text.
+	
+	// Avoid false sharing when increasing the Size/Capacity of the vectors of the slices next to each other.
+	char aPadding[128];
+};
+
+// Thread safe, it doesn't touch the last resolved line like GetLineRange.
+static void FindLinesSliceTask(void* pUserData, int TaskIdx)
+{
+	FindLinesSlice* pSlice = (FindLinesSlice*)pUserData + TaskIdx;
+	const CrazyLog* pLog = pSlice->pLog;
+	const char* pBufEnd = pLog->Buf.end();
+	const int Stride = pLog->LineIndexStride;
+	
+	int PrevLineNo = -1;
+	const char* pPrevLineEnd = nullptr;
+	for (int i = 0; i < pSlice->Count; i++)
+	{
+		int LineNo = pSlice->pLines[i];
+		const char* pLineStart;
+		
+		// The lines are sorted, so in sparse mode keep walking from the previous one
+		// if it's closer than the checkpoint.
+		if (Stride > 1 && PrevLineNo >= (LineNo / Stride) * Stride)
+		{
+			pLineStart = SkipLineEnd(pPrevLineEnd, pBufEnd);
+			for (int j = LineNo - PrevLineNo - 1; j > 0; j--)
+				pLineStart = pLog->FindNextLineStart(pLineStart);
+		}
+		else
+		{
+			pLineStart = pLog->FindLineStart(LineNo);
+		}
+		
+		const char* pLineEnd = pLog->FindLineEnd(LineNo, pLineStart);
+		if (LineContainsText(pLineStart, pLineEnd, pBufEnd, pSlice->pFindText, pSlice->FindTextLen, pLog->bIsAVXEnabled))
+			pSlice->vLines.push_back(LineNo);
+		
+		PrevLineNo = LineNo;
+		pPrevLineEnd = pLineEnd;
+	}
+}
+
+// Appends in order the lines of the sorted pLines that have the text.
+static void FindInLinesMT(const CrazyLog* pLog, const int* pLines, int Count, const char* pText, int TextLen, 
+                          ThreadPool* pPool, int ExtraThreadCount, ImVector<int>* pvOut)
+{
+	if (Count == 0)
+		return;
+	
+	int SlicesCount = (Count + FIND_SLICE_LINES - 1) / FIND_SLICE_LINES;
+	
+	ImVector<FindLinesSlice> vSlices;
+	vSlices.resize(SlicesCount);
+	memset(vSlices.Data, 0, SlicesCount * sizeof(FindLinesSlice));
+	
+	for (int i = 0; i < SlicesCount; i++)
+	{
+		FindLinesSlice& Slice = vSlices[i];
+		Slice.pLog = pLog;
+		Slice.pLines = pLines + (i * FIND_SLICE_LINES);
+		Slice.Count = min(FIND_SLICE_LINES, Count - (i * FIND_SLICE_LINES));
+		Slice.pFindText = pText;
+		Slice.FindTextLen = TextLen;
+	}
+	
+	RunPoolTasks(pPool, FindLinesSliceTask, vSlices.Data, SlicesCount, ExtraThreadCount);
+	
+	for (int i = 0; i < SlicesCount; i++)
+	{
+		ImVector<int>& vLines = vSlices[i].vLines;
+		if (vLines.Size > 0)
+		{
+			int OldSize = pvOut->Size;
+			pvOut->resize(OldSize + vLines.Size);
+			memcpy(pvOut->Data + OldSize, vLines.Data, vLines.Size * sizeof(int));
+		}
+		
+		vLines.clear();
+	}
+	
+	vSlices.clear();
+}
+
+// Looks at the lines from *pLookedLinesCount until the frame runs out of time, returns false if it did.
+static bool FindInLinesForFrame(CrazyLog* pLog, const ImVector<int>* pvLines, int* pLookedLinesCount, ImVector<int>* pvOut,
+                                LARGE_INTEGER TimestampBeforeFind, PlatformContext* pPlatformCtx)
+{
+	int ExtraThreadCount = pLog->bIsMultithreadEnabled ? pLog->SelectedExtraThreadCount : 0;
+	int BatchLinesCount = (min(ExtraThreadCount, MAX_EXTRA_THREADS) + 1) * FILTER_JOB_BATCH_CHUNKS * FIND_SLICE_LINES;
+	
+	while (*pLookedLinesCount < pvLines->Size) {
+		int Count = min(BatchLinesCount, pvLines->Size - *pLookedLinesCount);
+		
+		FindInLinesMT(pLog, pvLines->Data + *pLookedLinesCount, Count, pLog->aFindText, pLog->FindTextLen,
+		              &pLog->WorkerPool, ExtraThreadCount, pvOut);
+		
+		*pLookedLinesCount += Count;
+		
+		if (pPlatformCtx->pGetSecondsElapsedFunc(TimestampBeforeFind, pPlatformCtx->pGetWallClockFunc()) > FIND_FRAME_SECONDS)
+			return false;
+	}
+	
+	return true;
+}
+
+// NOTE(matiasp): Only the lines that were added since the last time are looked at, 
+// streaming only has to look at what was appended.
+// A huge log is looked at over a few frames, so typing doesn't wait for the whole log
+// and a new find text drops what was left of the old one.
+void CrazyLog::FindLines(PlatformContext* pPlatformCtx) 
+{
+	LARGE_INTEGER TimestampBeforeFind = pPlatformCtx->pGetWallClockFunc();
+	
+	int ExtraThreadCount = bIsMultithreadEnabled ? SelectedExtraThreadCount : 0;
+	int ThreadsCount = min(ExtraThreadCount, MAX_EXTRA_THREADS) + 1;
+	
+	// The lines it narrows come before the ones that were not looked at yet.
+	bool bHasTimeLeft = FindInLinesForFrame(this, &vFindFullViewNarrowLines, &FindFullViewNarrowedLinesCount, 
+	                                        &vFindFullViewLinesCached, TimestampBeforeFind, pPlatformCtx);
+	
+	ImVector<FilterChunk> vChunks;
+	while (bHasTimeLeft && FindFullViewProccesedLinesCount < LinesCount) {
+		const char* pChunksEnd = SplitFilterChunks(Buf.begin(), Buf.end(), FindLineStart(FindFullViewProccesedLinesCount), Buf.end(), 
+		                                           MaxLineSize, bIsAVXEnabled, ThreadsCount * FILTER_JOB_BATCH_CHUNKS, &vChunks);
+		
+		FilterChunksTask Task = { nullptr, vChunks.Data, nullptr, bIsAVXEnabled, Buf.begin(), Buf.end(), MaxLineSize, 
+		                          aFindText, FindTextLen };
+		RunPoolTasks(&WorkerPool, FilterChunkTask, &Task, vChunks.Size, ExtraThreadCount);
+		
+		int ChunksLinesCount = MergeFilterChunks(&vChunks, FindFullViewProccesedLinesCount, &vFindFullViewLinesCached);
+		FreeFilterChunks(&vChunks);
+		
+		// The empty line after the last line end is not in any chunk, it can't have the text anyway.
+		if (pChunksEnd == Buf.end())
+			FindFullViewProccesedLinesCount = LinesCount;
+		else
+			FindFullViewProccesedLinesCount += ChunksLinesCount;
+		
+		bHasTimeLeft = pPlatformCtx->pGetSecondsElapsedFunc(TimestampBeforeFind, pPlatformCtx->pGetWallClockFunc()) <= FIND_FRAME_SECONDS;
+	}
+	
+	// As far as the full view got, the filtered view gets there too.
+	IntersectFindFiltredLines();
+}
+
+// NOTE(matiasp): The filtered lines are lines of the full view too, so the ones with the text are the ones in both.
+// Both are sorted, it only has to walk them together as far as the full view was looked at.
+void CrazyLog::IntersectFindFiltredLines()
+{
+	int LookedLinesCount = FindFullViewNarrowedLinesCount < vFindFullViewNarrowLines.Size ? 
+		vFindFullViewNarrowLines[FindFullViewNarrowedLinesCount] : FindFullViewProccesedLinesCount;
+	
+	int FiltredIdx = FindFiltredProccesedLinesCount;
+	if (FiltredIdx >= vFiltredLinesCached.Size || vFiltredLinesCached[FiltredIdx] >= LookedLinesCount)
+		return;
+	
+	int FindIdx = FindFirstLineIdx(&vFindFullViewLinesCached, vFiltredLinesCached[FiltredIdx]);
+	while (FiltredIdx < vFiltredLinesCached.Size && FindIdx < vFindFullViewLinesCached.Size)
+	{
+		int FiltredLineNo = vFiltredLinesCached[FiltredIdx];
+		if (FiltredLineNo >= LookedLinesCount)
+			break;
+		
+		int FindLineNo = vFindFullViewLinesCached[FindIdx];
+		if (FindLineNo < FiltredLineNo)
 		{
-			DrawFiltredView(pPlatformCtx);
+			FindIdx++;
 		}
-		else
+		else 
 		{
-			DrawFullView(pPlatformCtx);
-		}
-
-		HandleMouseInputs();
-		
-		if (OneTimeScrollValue > -1.f) {
-			ImGui::SetScrollY(OneTimeScrollValue);
+			if (FindLineNo == FiltredLineNo)
+				vFindFiltredLinesCached.push_back(FiltredLineNo);
+			
+			FiltredIdx++;
 		}
-		
-		// Keep up at the bottom of the scroll region if we were already at the bottom at the beginning of the frame.
-		// Using a scrollbar or mouse-wheel will take away from the bottom edge.
-		bWantsToSnapScroll |= (bAutoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY());
-		if (!bIsPeeking && bWantsToSnapScroll)
-			ImGui::SetScrollHereY(1.0f);
 	}
+	
+	// Once the full view hits run out nothing else up to where it looked has the text.
+	if (FindIdx >= vFindFullViewLinesCached.Size)
+		FiltredIdx = FindFirstLineIdx(&vFiltredLinesCached, LookedLinesCount);
+	
+	FindFiltredProccesedLinesCount = FiltredIdx;
+}
 
+// Typing more of the same text only has to look again at the lines that had it.
+void CrazyLog::SetFindText(const char* pText)
+{
+	int TextLen = (int)strnlen(pText, sizeof(aFindText) - 1);
+	bool bIsNarrowing = FindTextLen > 0 && TextLen > FindTextLen && 
+		ImStristr(pText, pText + TextLen, aFindText, aFindText + FindTextLen);
 	
-	ImGui::PopFont();
-	ImGui::EndChild();
+	memset(aFindText, 0, sizeof(aFindText));
+	memcpy(aFindText, pText, TextLen);
 	
+	FindTextLen = TextLen;
+	FindScrollValue = -1.f;
 	
+	CurrentFindFullViewIdx = 0;
+	CurrentFindFiltredIdx = 0;
 	
-	ImGui::SeparatorText(aLastCommand);
+	if (bIsNarrowing)
+	{
+		NarrowFindLines();
+	}
+	else
+	{
+		FindFullViewProccesedLinesCount = 0;
+		FindFullViewNarrowedLinesCount = 0;
+		vFindFullViewLinesCached.resize(0);
+		vFindFullViewNarrowLines.resize(0);
+	}
 	
-	ImGui::End();
+	// Cheap to get again from the full view hits.
+	FindFiltredProccesedLinesCount = 0;
+	vFindFiltredLinesCached.resize(0);
 }
 
-template<typename T, size_t PADDING>
-struct PaddedVector 
+// The lines that were not looked at yet are still looked at by FindLines with the new text.
+void CrazyLog::NarrowFindLines()
 {
-	ImVector<T> vPaddedVector;
-	char aPadding[PADDING > 0 ? PADDING : 1];
-};
+	// What the previous text didn't get to narrow yet goes after what it did, still in order.
+	int PendingCount = vFindFullViewNarrowLines.Size - FindFullViewNarrowedLinesCount;
+	if (PendingCount > 0)
+	{
+		int OldSize = vFindFullViewLinesCached.Size;
+		vFindFullViewLinesCached.resize(OldSize + PendingCount);
+		memcpy(vFindFullViewLinesCached.Data + OldSize, vFindFullViewNarrowLines.Data + FindFullViewNarrowedLinesCount, 
+		       PendingCount * sizeof(int));
+	}
+	
+	vFindFullViewNarrowLines.swap(vFindFullViewLinesCached);
+	vFindFullViewLinesCached.resize(0);
+	FindFullViewNarrowedLinesCount = 0;
+}
 
-static void FilterMT(int LineNo, CrazyLog* pLog, ImVector<int>* pOut) 
+bool CrazyLog::IsFindDone() const
 {
-	const char* pBuf = pLog->Buf.begin();
-	const char* pBufEnd = pLog->Buf.end();
-	
-	const char* pLineStart = pBuf + pLog->vLineOffsets[LineNo];
-	const char* pLineEnd = (LineNo + 1 < pLog->vLineOffsets.Size) 
-		? (pBuf + pLog->vLineOffsets[LineNo + 1] - 1) : pBufEnd;
+	return FindFullViewProccesedLinesCount >= LinesCount && FindFiltredProccesedLinesCount >= vFiltredLinesCached.Size &&
+		FindFullViewNarrowedLinesCount >= vFindFullViewNarrowLines.Size;
+}
+
+// Same search FindLines does, they don't overlap. The AVX one checks its candidates with ImStristr rules too.
+int CrazyLog::CountFindOccurrences(int LineNo)
+{
+	const char* pLineStart;
+	const char* pLineEnd;
+	GetLineRange(LineNo, &pLineStart, &pLineEnd);
 	
-	if (pLog->Filter.PassFilter(pLineStart, pLineEnd, pBufEnd, pLog->bIsAVXEnabled)) 
+	int Count = 0;
+	const char* pCursor = pLineStart;
+	while (const char* pMatch = ImStristr(pCursor, pLineEnd, aFindText, aFindText + FindTextLen))
 	{
-		pOut->push_back(LineNo);
+		Count++;
+		pCursor = pMatch + FindTextLen;
 	}
+	
+	return Count;
 }
 
-void CrazyLog::FindLines(PlatformContext* pPlatformCtx) 
+void CrazyLog::FilterLines(PlatformContext* pPlatformCtx)
 {
-	const char* pFindTextStart = aFindText;
-	const char* pFindTextEnd = &aFindText[FindTextLen];
-		
-	const char* pBuf = Buf.begin();
-	const char* pBufEnd = Buf.end();
+	// The load job is filtering the lines as it loads them, we get those in UpdateLoadFile.
+	if (IsLoadJobFiltering())
+	{
+		bAlreadyCached = true;
+		return;
+	}
 	
-	// TODO(Matiasp): Make this multithread + avx version of this.
-	if (FindFullViewProccesedLinesCount < vLineOffsets.Size) {
-		for (int LineNo = FindFullViewProccesedLinesCount; LineNo < vLineOffsets.Size; LineNo++)
-		{
-			const char* pLineStart = pBuf + vLineOffsets[LineNo];
-			const char* pLineEnd = (LineNo + 1 < vLineOffsets.Size) ? (pBuf + vLineOffsets[LineNo + 1] - 1) : pBufEnd;
-			if(ImStristr(pLineStart, pLineEnd, pFindTextStart, pFindTextEnd))
-				vFindFullViewLinesCached.push_back(LineNo);
-		}
-		
-		FindFullViewProccesedLinesCount = vLineOffsets.Size;
+	// Same for the filter job, we get its lines in UpdateFilterLines.
+	if (IsFilterJobRunning())
+	{
+		bAlreadyCached = true;
+		return;
 	}
 	
-	if (FindFiltredProccesedLinesCount < vFiltredLinesCached.Size) {
-		for (int i = FindFiltredProccesedLinesCount; i < vFiltredLinesCached.Size; i++)
+	// The sidecar index could have the results of this filter already.
+	if (FiltredLinesCount == 0 && vSidecarFilters.Size > 0 && aSidecarLogPath[0] != 0 && AnyFilterActive())
+	{
+		int EntryOffset = FindSidecarFilter();
+		if (EntryOffset != -1)
 		{
-			int LineNo = vFiltredLinesCached[i];
+			SidecarFilterHeader FilterHeader;
+			memcpy(&FilterHeader, vSidecarFilters.Data + EntryOffset, sizeof(FilterHeader));
+			
+			vFiltredLinesCached.resize(FilterHeader.FiltredLinesCount);
+			memcpy(vFiltredLinesCached.Data, vSidecarFilters.Data + EntryOffset + sizeof(FilterHeader), 
+			       FilterHeader.FiltredLinesCount * sizeof(int));
 			
-			const char* pLineStart = pBuf + vLineOffsets[LineNo];
-			const char* pLineEnd = (LineNo + 1 < vLineOffsets.Size) ? (pBuf + vLineOffsets[LineNo + 1] - 1) : pBufEnd;
-			if(ImStristr(pLineStart, pLineEnd, pFindTextStart, pFindTextEnd))
-				vFindFiltredLinesCached.push_back(LineNo);
+			FiltredLinesCount = LinesCount;
+			bAlreadyCached = true;
+			
+			SetLastCommand("FILTER LOADED FROM SIDECAR INDEX");
+			return;
 		}
-		
-		FindFiltredProccesedLinesCount = vFiltredLinesCached.Size;
 	}
-}
-
-void CrazyLog::FilterLines(PlatformContext* pPlatformCtx)
-{
+	
 	if (FiltredLinesCount == 0)
 	{
 		vFiltredLinesCached.resize(0);
 	}
 	
-	if (Filter.vFilters.size() > 0 && vLineOffsets.Size > 0)
+	if (Filter.vFilters.size() > 0 && LinesCount > 0)
 	{
-		if (bIsMultithreadEnabled)
+		LARGE_INTEGER TimestampBeforeFilter = pPlatformCtx->pGetWallClockFunc();
+		
+		// NOTE(matiasp): Waking the workers costs more than filtering the few lines a stream appends,
+		// so only go wide when the last filters say this one would take a while.
+		size_t PendingSize = FiltredLinesCount < LinesCount ? (size_t)(Buf.end() - FindLineStart(FiltredLinesCount)) : 0;
+		float SingleThreadSeconds = (float)PendingSize * FilterSecondsPerByte;
+		int ThreadsCount = bIsMultithreadEnabled ? SelectedExtraThreadCount + 1 : 1;
+		
+		// Too long to keep the UI waiting, it goes to the background and the lines show up as they come.
+		// Even on a single thread, that way it can still be canceled.
+		// While loading the buffer moves, the load job is the one filtering most of the time anyway.
+		if (SingleThreadSeconds / ThreadsCount > FILTER_MAX_BLOCKING_SECONDS && !bIsLoadingFile)
 		{
-			LARGE_INTEGER TimestampBeforeFilter = pPlatformCtx->pGetWallClockFunc();
-			
-			// Parallel Execution
-			{
-				const int PendingSizeToFilter = vLineOffsets.Size - FiltredLinesCount;
-				const int ItemsPerThread = PendingSizeToFilter / (SelectedExtraThreadCount + 1);
-				const int* pDataCursor = &vLineOffsets[FiltredLinesCount];
-				const int* pEnd = pDataCursor + PendingSizeToFilter;
-	
-				// Adding Padding to avoid false sharing when increasing the Size/Capacity value of the vectors 
-				PaddedVector<int,128> vThreadsBuffer[MAX_EXTRA_THREADS + 1];
-				memset(&vThreadsBuffer, 0, sizeof(vThreadsBuffer));
-	
-				std::thread aThreads[MAX_EXTRA_THREADS];
-				CrazyLog* pLog = this;
-				auto ThreadJob = [ItemsPerThread, pEnd, pLog, PendingSizeToFilter](const int* pDataCursor, ImVector<int>* pOut) -> void
-				{
-					for (int i = 0; i < ItemsPerThread; ++i) 
-					{
-						int LineNo = (PendingSizeToFilter - (int)(pEnd - &pDataCursor[i])) + pLog->FiltredLinesCount;
-						FilterMT(LineNo, pLog, pOut);
-					}
-				};
-
-				for (int i = 0; i < SelectedExtraThreadCount; ++i)
-				{
-					new(aThreads + i)std::thread(ThreadJob, pDataCursor, &vThreadsBuffer[i].vPaddedVector);
-					pDataCursor += ItemsPerThread;
-				}
-	
-				while (pDataCursor < pEnd)
-				{
-					// work in this thread too
-					int LineNo = (PendingSizeToFilter - (int)(pEnd - pDataCursor)) + pLog->FiltredLinesCount;
-					FilterMT(LineNo, pLog, &vThreadsBuffer[SelectedExtraThreadCount].vPaddedVector);
-					pDataCursor++;
-				}
-	
-				// wait until all threads finished
-				for (int i = 0; i < SelectedExtraThreadCount; ++i)
-				{
-					aThreads[i].join();
-				}
-	
-				// calculate how much I need to dump in the result buffer
-				// resize the vector with the final size
-				unsigned TotalSize = 0;
-				for (int i = 0; i < SelectedExtraThreadCount + 1; ++i)
-				{
-					TotalSize += vThreadsBuffer[i].vPaddedVector.Size;
-				}
-	
-				unsigned OriginalSize = vFiltredLinesCached.Size;
-				vFiltredLinesCached.resize(OriginalSize + TotalSize);
-	
-				// dump the new content into the filter result
-				unsigned CopiedSize = 0;
-				for (int i = 0; i < SelectedExtraThreadCount + 1; ++i)
-				{
-					if (vThreadsBuffer[i].vPaddedVector.Size == 0)
-						continue;
-		
-					memcpy(&vFiltredLinesCached[OriginalSize + CopiedSize], 
-						vThreadsBuffer[i].vPaddedVector.Data, 
-						sizeof(int) * vThreadsBuffer[i].vPaddedVector.Size);
+			StartFilterJob(pPlatformCtx, PendingSize);
+			return;
+		}
 		
-					CopiedSize += vThreadsBuffer[i].vPaddedVector.Size;
+		if (SingleThreadSeconds < FILTER_MIN_PARALLEL_SECONDS)
+			ThreadsCount = 1;
 		
-					if (CopiedSize >= TotalSize)
-						break;
-				}
-			}
-			
+		if (ThreadsCount > 1)
+		{
+			ImVector<FilterChunk> vChunks;
+			SplitFilterChunks(Buf.begin(), Buf.end(), Buf.end() - PendingSize, Buf.end(), MaxLineSize, bIsAVXEnabled, 
+			                  INT_MAX, &vChunks);
+			ThreadsCount = min(ThreadsCount, vChunks.Size);
 			
-			float FilterTime = pPlatformCtx->pGetSecondsElapsedFunc(TimestampBeforeFilter, pPlatformCtx->pGetWallClockFunc());
+			FilterChunksTask Task = { &Filter, vChunks.Data, nullptr, bIsAVXEnabled, Buf.begin(), Buf.end(), MaxLineSize };
+			RunPoolTasks(&WorkerPool, FilterChunkTask, &Task, vChunks.Size, SelectedExtraThreadCount);
 			
-			char aDeltaTimeBuffer[64];
-			snprintf(aDeltaTimeBuffer, sizeof(aDeltaTimeBuffer), "FilterTime %.5f", FilterTime);
-			SetLastCommand(aDeltaTimeBuffer);
+			int ChunksLinesCount = MergeFilterChunks(&vChunks, FiltredLinesCount, &vFiltredLinesCached);
+			FreeFilterChunks(&vChunks);
 			
+			// The empty line after the last line end is not in any chunk.
+			FilterMT(FiltredLinesCount + ChunksLinesCount, LinesCount, this, &vFiltredLinesCached);
 		}
 		else
 		{
-			LARGE_INTEGER TimestampBeforeFilter = pPlatformCtx->pGetWallClockFunc();
-			
-			const char* pBuf = Buf.begin();
-			const char* pBufEnd = Buf.end();
+			FilterMT(FiltredLinesCount, LinesCount, this, &vFiltredLinesCached);
+		}
 		
-			for (int LineNo = FiltredLinesCount; LineNo < vLineOffsets.Size; LineNo++)
-			{
-				const char* pLineStart = pBuf + vLineOffsets[LineNo];
-				const char* pLineEnd = (LineNo + 1 < vLineOffsets.Size) ? (pBuf + vLineOffsets[LineNo + 1] - 1) : pBufEnd;
-				if (Filter.PassFilter(pLineStart, pLineEnd, pBufEnd, bIsAVXEnabled)) 
-				{
-					vFiltredLinesCached.push_back(LineNo);
-				}
+		float FilterTime = pPlatformCtx->pGetSecondsElapsedFunc(TimestampBeforeFilter, pPlatformCtx->pGetWallClockFunc());
 		
-			}
-			
-			float FilterTime = pPlatformCtx->pGetSecondsElapsedFunc(TimestampBeforeFilter, pPlatformCtx->pGetWallClockFunc());
-			
-			char aDeltaTimeBuffer[64];
-			snprintf(aDeltaTimeBuffer, sizeof(aDeltaTimeBuffer), "FilterTime %.5f ", FilterTime);
-			SetLastCommand(aDeltaTimeBuffer);
-		}
+		// What it would have taken on a single thread, the next filter compares against it.
+		if (PendingSize >= FILTER_MIN_MEASURE_SIZE)
+			FilterSecondsPerByte = (FilterTime * ThreadsCount) / (float)PendingSize;
 		
+		char aDeltaTimeBuffer[64];
+		snprintf(aDeltaTimeBuffer, sizeof(aDeltaTimeBuffer), "FilterTime %.5f", FilterTime);
+		SetLastCommand(aDeltaTimeBuffer);
 	}
 	
+	FinishFilterLines();
+}
+
+// In streaming the last line could still be written, so it's not done unless it has something.
+void CrazyLog::FinishFilterLines()
+{
 	bAlreadyCached = true;
 	
-	if (bStreamMode)
+	if (bStreamMode || bIsLoadingFile)
 	{
-		const char* pLineStart = Buf.begin() + vLineOffsets[vLineOffsets.Size - 1];
+		const char* pLineStart = FindLineStart(LinesCount - 1);
 		const char* pLineEnd = Buf.end();
 		
 		// If we are streaming mode and the last line is empty, don't count it as filtered, 
 		// because is going to be written eventually and if we filtered the empty line
 		// then we will end up skipping those lines.
-		FiltredLinesCount = pLineStart == pLineEnd ? vLineOffsets.Size - 1 : vLineOffsets.Size;
+		FiltredLinesCount = pLineStart == pLineEnd ? LinesCount - 1 : LinesCount;
 	}
 	else
 	{
-		FiltredLinesCount = vLineOffsets.Size;
+		FiltredLinesCount = LinesCount;
 	}
 }
 
-void CrazyLog::SetLastCommand(const char* pLastCommand)
+static void LockFilterJob(FilterLinesJob* pJob)
+{
+	while (pJob->bIsLocked.exchange(true, std::memory_order_acquire))
+		std::this_thread::yield();
+}
+
+static void UnlockFilterJob(FilterLinesJob* pJob)
+{
+	pJob->bIsLocked.store(false, std::memory_order_release);
+}
+
+// NOTE(matiasp): Every batch of chunks is handed over as soon as it's done, so the first lines
+// show up in a frame instead of after the whole log, and a new filter doesn't wait for this one.
+static void FilterLogLines(FilterLinesJob* pJob)
+{
+	ImVector<FilterChunk> vChunks;
+	int BatchChunksCount = (min(pJob->ExtraThreadCount, MAX_EXTRA_THREADS) + 1) * FILTER_JOB_BATCH_CHUNKS;
+	const char* pBatchStart = pJob->pStart;
+	int LineNo = pJob->FirstLineNo;
+	
+	ThreadCountRamp* pRamp = &pJob->Ramp;
+	
+	while (pBatchStart < pJob->pEnd && !pJob->bShouldCancel)
+	{
+		// The first batches are the same size, each one on the thread count the ramp asks for.
+		bool bIsRampStep = pRamp->DoneStepsCount < pRamp->StepsCount;
+		int ChunksCount = bIsRampStep ? pRamp->BatchChunksCount : BatchChunksCount;
+		int ExtraThreadCount = bIsRampStep ? pRamp->aThreadsCount[pRamp->DoneStepsCount] - 1 : pJob->ExtraThreadCount;
+		
+		const char* pBatchEnd = SplitFilterChunks(pJob->pBuf, pJob->pEnd, pBatchStart, pJob->pEnd, pJob->MaxLineSize, 
+		                                          pJob->bUseAVX, ChunksCount, &vChunks);
+		
+		LARGE_INTEGER TimestampBeforeBatch = pJob->pGetWallClockFunc();
+		
+		FilterChunksTask Task = { &pJob->Filter, vChunks.Data, &pJob->bShouldCancel, pJob->bUseAVX, 
+		                          pJob->pBuf, pJob->pEnd, pJob->MaxLineSize };
+		RunPoolTasks(pJob->pWorkerPool, FilterChunkTask, &Task, vChunks.Size, ExtraThreadCount);
+		
+		// Some chunks didn't get to the end, the main thread doesn't want these anyway.
+		if (pJob->bShouldCancel)
+			break;
+		
+		// A batch cut short by the end of the log can't be compared with the others.
+		if (bIsRampStep && vChunks.Size == ChunksCount)
+		{
+			pRamp->aSeconds[pRamp->DoneStepsCount] = pJob->pGetSecondsElapsedFunc(TimestampBeforeBatch, pJob->pGetWallClockFunc());
+			pRamp->aSizes[pRamp->DoneStepsCount] = (int)(pBatchEnd - pBatchStart);
+			pRamp->DoneStepsCount++;
+		}
+		
+		LockFilterJob(pJob);
+		LineNo += MergeFilterChunks(&vChunks, LineNo, &pJob->vPendingFiltredLines);
+		pJob->FiltredLinesCount = LineNo;
+		UnlockFilterJob(pJob);
+		
+		pJob->FiltredSize = (int)(pBatchEnd - pJob->pStart);
+		
+		FreeFilterChunks(&vChunks);
+		pBatchStart = pBatchEnd;
+	}
+	
+	FreeFilterChunks(&vChunks);
+	pJob->bIsRunning = false;
+}
+
+// Filters in the background the last PendingSize bytes of the log, all the lines from FiltredLinesCount.
+void CrazyLog::StartFilterJob(PlatformContext* pPlatformCtx, size_t PendingSize)
+{
+	FilterJob.pWorkerPool = &WorkerPool;
+	FilterJob.pBuf = Buf.begin();
+	FilterJob.pStart = Buf.end() - PendingSize;
+	FilterJob.pEnd = Buf.end();
+	FilterJob.FirstLineNo = FiltredLinesCount;
+	FilterJob.MaxLineSize = MaxLineSize;
+	FilterJob.ExtraThreadCount = bIsMultithreadEnabled ? SelectedExtraThreadCount : 0;
+	FilterJob.bUseAVX = bIsAVXEnabled;
+	FilterJob.pGetWallClockFunc = pPlatformCtx->pGetWallClockFunc;
+	FilterJob.pGetSecondsElapsedFunc = pPlatformCtx->pGetSecondsElapsedFunc;
+	FilterJob.Filter = Filter;
+	FilterJob.vPendingFiltredLines.resize(0);
+	FilterJob.FiltredLinesCount = FiltredLinesCount;
+	FilterJob.FiltredSize = 0;
+	FilterJob.bShouldCancel = false;
+	FilterJob.bIsLocked = false;
+	FilterJob.bIsRunning = true;
+	
+	FilterJobFiltredLinesCount = FiltredLinesCount;
+	FilterJobTimestamp = pPlatformCtx->pGetWallClockFunc();
+	bIsFilteringLines = true;
+	bAlreadyCached = true;
+	
+	PlanThreadCountRamp(PendingSize);
+	
+	std::thread(FilterLogLines, &FilterJob).detach();
+	
+	SetLastCommand("FILTERING LINES");
+}
+
+void CrazyLog::UpdateFilterLines(PlatformContext* pPlatformCtx)
+{
+	if (!IsFilterJobRunning())
+		return;
+	
+	// Read before taking the lines, once it's done nothing else comes after them.
+	bool bFinished = !FilterJob.bIsRunning;
+	
+	LockFilterJob(&FilterJob);
+	
+	int PendingFiltredCount = FilterJob.vPendingFiltredLines.Size;
+	if (PendingFiltredCount > 0)
+	{
+		int OldSize = vFiltredLinesCached.Size;
+		vFiltredLinesCached.resize(OldSize + PendingFiltredCount);
+		memcpy(vFiltredLinesCached.Data + OldSize, FilterJob.vPendingFiltredLines.Data, PendingFiltredCount * sizeof(int));
+	}
+	
+	FilterJob.vPendingFiltredLines.resize(0);
+	FiltredLinesCount = FilterJob.FiltredLinesCount;
+	FilterJobFiltredLinesCount = FiltredLinesCount;
+	
+	UnlockFilterJob(&FilterJob);
+	
+	if (!bFinished)
+	{
+		SetLastCommand("FILTERING LINES");
+		return;
+	}
+	
+	bIsFilteringLines = false;
+	FilterJob.vPendingFiltredLines.clear();
+	
+	// The empty line after the last line end is not in any chunk.
+	FilterMT(FiltredLinesCount, LinesCount, this, &vFiltredLinesCached);
+	FinishFilterLines();
+	
+	float FilterTime = pPlatformCtx->pGetSecondsElapsedFunc(FilterJobTimestamp, pPlatformCtx->pGetWallClockFunc());
+	
+	size_t FilteredSize = FilterJob.pEnd - FilterJob.pStart;
+	if (FilteredSize >= FILTER_MIN_MEASURE_SIZE)
+		FilterSecondsPerByte = (FilterTime * (FilterJob.ExtraThreadCount + 1)) / (float)FilteredSize;
+	
+	char aDeltaTimeBuffer[64];
+	snprintf(aDeltaTimeBuffer, sizeof(aDeltaTimeBuffer), "FilterTime %.5f", FilterTime);
+	SetLastCommand(aDeltaTimeBuffer);
+	
+	TuneThreadCount(pPlatformCtx);
+}
+
+// NOTE(matiasp): Past some thread count the filter is waiting on memory instead of comparing bytes,
+// that count changes with the machine, so the first big filter measures it on its own first batches.
+// After that, the first big filter of every session checks it still pays off against a single thread.
+void CrazyLog::PlanThreadCountRamp(size_t PendingSize)
+{
+	ThreadCountRamp* pRamp = &FilterJob.Ramp;
+	memset(pRamp, 0, sizeof(*pRamp));
+	
+	if (!bIsAutoThreadCountEnabled || !bIsMultithreadEnabled || MaxExtraThreadCount == 0)
+		return;
+	
+	int MaxThreadsCount = min(MaxExtraThreadCount, MAX_EXTRA_THREADS) + 1;
+	if (bWantsToTuneThreadCount)
+	{
+		// 1, 2, 4... and always the most it has.
+		for (int ThreadsCount = 1; ThreadsCount < MaxThreadsCount && pRamp->StepsCount < (int)ArrayCount(pRamp->aThreadsCount) - 1; 
+		     ThreadsCount *= 2)
+		{
+			pRamp->aThreadsCount[pRamp->StepsCount++] = ThreadsCount;
+		}
+		
+		pRamp->aThreadsCount[pRamp->StepsCount++] = MaxThreadsCount;
+		pRamp->bIsFullRamp = true;
+	}
+	else if (!bHasCheckedThreadCount && SelectedExtraThreadCount > 0)
+	{
+		pRamp->aThreadsCount[pRamp->StepsCount++] = 1;
+		pRamp->aThreadsCount[pRamp->StepsCount++] = SelectedExtraThreadCount + 1;
+	}
+	
+	// Every thread needs a few chunks on every step, or the last one to finish is all it measures.
+	int LastThreadsCount = pRamp->aThreadsCount[max(pRamp->StepsCount - 1, 0)];
+	pRamp->BatchChunksCount = LastThreadsCount * FILTER_JOB_BATCH_CHUNKS;
+	
+	// Too small to say anything, the next one will.
+	size_t RampSize = (size_t)pRamp->StepsCount * pRamp->BatchChunksCount * FILTER_CHUNK_SIZE;
+	if (pRamp->StepsCount == 0 || RampSize > PendingSize)
+	{
+		pRamp->StepsCount = 0;
+		return;
+	}
+	
+	if (pRamp->bIsFullRamp)
+		GrowThreadPool(&WorkerPool, MaxThreadsCount - 1);
+	else
+		bHasCheckedThreadCount = true;
+}
+
+// Called once the filter job is done, it only does something if the job ran the whole ramp.
+void CrazyLog::TuneThreadCount(PlatformContext* pPlatformCtx)
+{
+	ThreadCountRamp* pRamp = &FilterJob.Ramp;
+	if (pRamp->StepsCount == 0 || pRamp->DoneStepsCount < pRamp->StepsCount)
+		return;
+	
+	// Every ramp starts on a single thread.
+	float aBytesPerSecond[ArrayCount(pRamp->aSeconds)];
+	float BestBytesPerSecond = 0.f;
+	for (int i = 0; i < pRamp->StepsCount; i++)
+	{
+		aBytesPerSecond[i] = (float)pRamp->aSizes[i] / max(pRamp->aSeconds[i], 0.000001f);
+		BestBytesPerSecond = max(BestBytesPerSecond, aBytesPerSecond[i]);
+	}
+	
+	if (pRamp->bIsFullRamp)
+	{
+		// The fewest threads that get close to the best, the rest would only fight for the memory bus.
+		int KneeIdx = 0;
+		while (aBytesPerSecond[KneeIdx] < BestBytesPerSecond * THREAD_COUNT_KNEE_RATIO)
+			KneeIdx++;
+		
+		AutoExtraThreadCount = pRamp->aThreadsCount[KneeIdx] - 1;
+		AutoThreadCountCores = MaxExtraThreadCount + 1;
+		AutoThreadCountSpeedup = (int)((aBytesPerSecond[KneeIdx] * 100.f) / aBytesPerSecond[0]);
+		bWantsToTuneThreadCount = false;
+		bHasCheckedThreadCount = true;
+		
+		SaveTypeInSettings(pPlatformCtx, "auto_thread_count", cJSON_Number, &AutoExtraThreadCount);
+		SaveTypeInSettings(pPlatformCtx, "auto_thread_count_cores", cJSON_Number, &AutoThreadCountCores);
+		SaveTypeInSettings(pPlatformCtx, "auto_thread_count_speedup", cJSON_Number, &AutoThreadCountSpeedup);
+		
+		if (bIsAutoThreadCountEnabled)
+			ApplyAutoThreadCount();
+		
+		char aTunedBuffer[64];
+		snprintf(aTunedBuffer, sizeof(aTunedBuffer), "THREAD COUNT TUNED TO %i EXTRA THREADS", AutoExtraThreadCount);
+		SetLastCommand(aTunedBuffer);
+	}
+	else
+	{
+		// Something else is eating the cores or the bandwidth now, the next big filter measures again.
+		int Speedup = (int)((aBytesPerSecond[1] * 100.f) / aBytesPerSecond[0]);
+		if (Speedup < (int)(AutoThreadCountSpeedup * THREAD_COUNT_REGRESSION_RATIO))
+			bWantsToTuneThreadCount = true;
+	}
+}
+
+void CrazyLog::ApplyAutoThreadCount()
+{
+	SelectedExtraThreadCount = min(AutoExtraThreadCount, MaxExtraThreadCount);
+}
+
+// The filter job goes on while the filter stays the one it took.
+bool CrazyLog::IsFilterJobRunning()
+{
+	if (!bIsFilteringLines)
+		return false;
+	
+	// Whoever reset the filtered lines wants them filtered again.
+	if (!IsSameFilter(&Filter, &FilterJob.Filter) || FiltredLinesCount != FilterJobFiltredLinesCount)
+	{
+		CancelFilterLines();
+		
+		FiltredLinesCount = 0;
+		bAlreadyCached = false;
+	}
+	
+	return bIsFilteringLines;
+}
+
+// The lines it already handed over stay, the filter goes on from there the next time.
+void CrazyLog::CancelFilterLines()
 {
-	snprintf(aLastCommand, sizeof(aLastCommand), "ver %s - TotalLines %i ResultLines %i - LastCommand: %s",
-	         aCurrentVersion, vLineOffsets.Size, vFiltredLinesCached.Size, pLastCommand);
+	FilterJob.bShouldCancel = true;
+	while (FilterJob.bIsRunning)
+		std::this_thread::yield();
+	
+	if (bIsFilteringLines)
+	{
+		bIsFilteringLines = false;
+		bAlreadyCached = false;
+		FilterJob.vPendingFiltredLines.clear();
+	}
 }
 
-void CrazyLog::HighlightLine(const char* pLineStart, const char* pLineEnd) 
+void CrazyLog::SetLastCommand(const char* pLastCommand)
 {
-	ImVec2 TextPos = ImGui::GetCursorScreenPos();
-	ImVec2 TextSize = ImGui::CalcTextSize(pLineStart, pLineEnd);
-	ImGui::GetWindowDrawList()->AddRectFilled(TextPos, ImVec2(TextPos.x + TextSize.x, TextPos.y + TextSize.y), 
-											  IM_COL32(66, 66, 66, 255)); 
+	if (bIsLoadingFile && LoadJob.Compression != CT_None)
+	{
+		// We don't know the decompressed size until we are done.
+		snprintf(aLastCommand, sizeof(aLastCommand), "ver %s - TotalLines %i ResultLines %i - Decompressed %i MB - LastCommand: %s",
+		         aCurrentVersion, LinesCount, vFiltredLinesCached.Size, Buf.size() / (1024 * 1024), pLastCommand);
+	}
+	else if (bIsLoadingFile)
+	{
+		int LoadedPercent = LoadJob.FileSize > 0 ? (int)(((int64_t)Buf.size() * 100) / LoadJob.FileSize) : 100;
+		snprintf(aLastCommand, sizeof(aLastCommand), "ver %s - TotalLines %i ResultLines %i - Loading %i%% - LastCommand: %s",
+		         aCurrentVersion, LinesCount, vFiltredLinesCached.Size, LoadedPercent, pLastCommand);
+	}
+	else if (bIsSavingFile)
+	{
+		int SavedPercent = SaveJob.vLines.Size > 0 ? (int)(((int64_t)SaveJob.SavedLinesCount * 100) / SaveJob.vLines.Size) : 100;
+		snprintf(aLastCommand, sizeof(aLastCommand), "ver %s - TotalLines %i ResultLines %i - Saving %i%% - LastCommand: %s",
+		         aCurrentVersion, LinesCount, vFiltredLinesCached.Size, SavedPercent, pLastCommand);
+	}
+	else if (bIsFilteringLines)
+	{
+		int FilterSize = (int)(FilterJob.pEnd - FilterJob.pStart);
+		int FilteredPercent = FilterSize > 0 ? (int)(((int64_t)FilterJob.FiltredSize * 100) / FilterSize) : 100;
+		snprintf(aLastCommand, sizeof(aLastCommand), "ver %s - TotalLines %i ResultLines %i - Filtering %i%% - LastCommand: %s",
+		         aCurrentVersion, LinesCount, vFiltredLinesCached.Size, FilteredPercent, pLastCommand);
+	}
+	else if (bIsCopyingLines)
+	{
+		int CopiedPercent = CopyJob.vLines.Size > 0 ? (int)(((int64_t)CopyJob.CopiedLinesCount * 100) / CopyJob.vLines.Size) : 100;
+		snprintf(aLastCommand, sizeof(aLastCommand), "ver %s - TotalLines %i ResultLines %i - Copying %i%% - LastCommand: %s",
+		         aCurrentVersion, LinesCount, vFiltredLinesCached.Size, CopiedPercent, pLastCommand);
+	}
+	else
+	{
+		snprintf(aLastCommand, sizeof(aLastCommand), "ver %s - TotalLines %i ResultLines %i - LastCommand: %s",
+		         aCurrentVersion, LinesCount, vFiltredLinesCached.Size, pLastCommand);
+	}
 }
 
 void CrazyLog::DrawFiltredView(PlatformContext* pPlatformCtx)
@@ -1468,15 +4528,15 @@ void CrazyLog::DrawFiltredView(PlatformContext* pPlatformCtx)
 	bool bIsCtrlressed = ImGui::IsKeyDown(ImGuiKey_LeftCtrl);
 	bool bIsAltPressed = ImGui::IsKeyDown(ImGuiKey_LeftAlt);
 
-	const char* pSelectionStart = vLineOffsets.size() > Selection.Start.Line ? Buf.begin() + vLineOffsets[Selection.Start.Line] + Selection.Start.Column : nullptr;
-	const char* pSelectionEnd = vLineOffsets.size() > Selection.End.Line ? Buf.begin() + vLineOffsets[Selection.End.Line] + Selection.End.Column : nullptr;
+	const char* pSelectionStart = LinesCount > Selection.Start.Line ? FindLineStart(Selection.Start.Line) + Selection.Start.Column : nullptr;
+	const char* pSelectionEnd = LinesCount > Selection.End.Line ? FindLineStart(Selection.End.Line) + Selection.End.Column : nullptr;
+	bool bIsWindowHovered = ImGui::IsWindowHovered();
 	
 	const char* buf = Buf.begin();
 	const char* buf_end = Buf.end();
 	ImGuiListClipper clipper;
 	clipper.Begin(vFiltredLinesCached.Size);
 	
-	TempLineMatches.vLineMatches.reserve(20);
 	char aLineNumberBuff[17] = { 0 };
 	while (clipper.Step())
 	{
@@ -1484,70 +4544,24 @@ void CrazyLog::DrawFiltredView(PlatformContext* pPlatformCtx)
 		{
 			int line_no = vFiltredLinesCached[ClipperIdx];
 			
+			DrawLogSegmentGutter(line_no, ClipperIdx > 0 ? vFiltredLinesCached[ClipperIdx - 1] : -1);
+			
 			if (bShowLineNum) {
-				snprintf(aLineNumberBuff, sizeof(aLineNumberBuff), "[%i] -", line_no);
+				// A split line shows the number of the line it comes from.
+				bool bIsSplit = false;
+				int FileLineNo = GetFileLineNo(line_no, &bIsSplit);
+				snprintf(aLineNumberBuff, sizeof(aLineNumberBuff), bIsSplit ? "[%i] +" : "[%i] -", FileLineNo);
 				ImGui::Text(aLineNumberBuff);
 				ImGui::SameLine();
 			}
 			
-			const char* pLineStart = buf + vLineOffsets[line_no];
-			const char* pLineEnd = (line_no + 1 < vLineOffsets.Size) ? (buf + vLineOffsets[line_no + 1] - 1) : buf_end;
+			const char* pLineStart;
+			const char* pLineEnd;
+			GetLineRange(line_no, &pLineStart, &pLineEnd);
 			int64_t line_size = pLineEnd - pLineStart;
-			
-			bool bIsItemHovered = false;
-			const char* pLineCursor = pLineStart;
-			
-			CacheHighlightLineMatches(pLineStart, pLineEnd, &TempLineMatches);
-			
-			if(vFindFiltredLinesCached.Size > 0 && line_no == vFindFiltredLinesCached[CurrentFindFiltredIdx])
-				HighlightLine(pLineStart, pLineEnd);
-			
-			for (int j = 0; j < TempLineMatches.vLineMatches.Size; j++)
-			{
-				uint8_t FilterIdx = TempLineMatches.vLineMatches[j].FilterIdxMatching;
-				ImVec4 FilterColor = FilterIdx != 255 ? Filter.vSettings[FilterIdx].Color : FindTextColor;
-				
-				const char* pHighlightWordBegin = pLineStart + TempLineMatches.vLineMatches[j].WordBeginOffset;
-				const char* pHighlightWordEnd = pLineStart + TempLineMatches.vLineMatches[j].WordEndOffset + 1;
-
-				if (pLineCursor <= pHighlightWordBegin) 
-				{
-					// Draw until the highlight begin
-					if (pLineCursor != pHighlightWordBegin) // Valid Case, Previous filter could end at the new word begin
-					{
-						DrawColoredRangeAndSelection(pLineCursor, pHighlightWordBegin, ImVec4(), pSelectionStart, pSelectionEnd, bIsItemHovered);
-						pLineCursor = pHighlightWordBegin;
-
-						if (pLineCursor != pLineEnd)
-							ImGui::SameLine(0.f,0.f);
-					}
-					
-					// Draw highlight 
-					DrawColoredRangeAndSelection(pHighlightWordBegin, pHighlightWordEnd, FilterColor, pSelectionStart, pSelectionEnd, bIsItemHovered);
-					pLineCursor = pHighlightWordEnd;
-
-					if (pLineCursor != pLineEnd)
-						ImGui::SameLine(0.f,0.f);
-				} 
-				else if (pLineCursor < pHighlightWordEnd) // In case a previous filter have already highlighted the begin. 
-				{
-					// Draw highlight, 
-					DrawColoredRangeAndSelection(pLineCursor, pHighlightWordEnd, FilterColor, pSelectionStart, pSelectionEnd, bIsItemHovered);
-					pLineCursor = pHighlightWordEnd;
-
-					if (pLineCursor != pLineEnd)
-						ImGui::SameLine(0.f,0.f);
-
-				}
-
-			}
-
-			// Draw after the highlights
-			if (pLineCursor != pLineEnd) // Valid Case, we could have reached the end of the buffer.
-				DrawColoredRangeAndSelection(pLineCursor, pLineEnd, ImVec4(), pSelectionStart, pSelectionEnd, bIsItemHovered);
-
-			if (bIsItemHovered)
-				MouseOverLineIdx = line_no;
+			
+			bool bIsFindLine = vFindFiltredLinesCached.Size > 0 && line_no == vFindFiltredLinesCached[CurrentFindFiltredIdx];
+			bool bIsItemHovered = DrawLogLine(line_no, pLineStart, pLineEnd, pSelectionStart, pSelectionEnd, bIsFindLine, bIsWindowHovered);
 	
 			// Peek Full Version
 			if (bIsCtrlressed && bIsItemHovered) 
@@ -1582,11 +4596,13 @@ void CrazyLog::DrawFiltredView(PlatformContext* pPlatformCtx)
 				for (int j = BottomLine; j <= TopLine; j++) {
 		
 					int FilteredLineNo = vFiltredLinesCached[j];
-					char* pFilteredLineStart = const_cast<char*>(buf + vLineOffsets[FilteredLineNo]);
-					char* pFilteredLineEnd = const_cast<char*>((FilteredLineNo + 1 < vLineOffsets.Size) ? (buf + vLineOffsets[FilteredLineNo + 1] - 1) : buf_end);
+					const char* pFilteredLineStart;
+					const char* pFilteredLineEnd;
+					GetLineRange(FilteredLineNo, &pFilteredLineStart, &pFilteredLineEnd);
 		
-					size_t Size = pFilteredLineEnd+1 - pFilteredLineStart;
+					size_t Size = pFilteredLineEnd - pFilteredLineStart;
 					bWroteOnScratch |= pPlatformCtx->ScratchMem.PushBack(Size, pFilteredLineStart) != nullptr;
+					bWroteOnScratch |= pPlatformCtx->ScratchMem.PushBack(1, &g_LineEndTerminator) != nullptr;
 				}
 	
 				if (bWroteOnScratch) {
@@ -1629,8 +4645,6 @@ void CrazyLog::DrawFiltredView(PlatformContext* pPlatformCtx)
 			
 	}
 	
-	TempLineMatches.vLineMatches.clear();
-	
 	clipper.End();
 }
 
@@ -1652,13 +4666,20 @@ static int UTF8CharLength(char c)
 	return 1;
 }
 
+static float GetMonospaceAdvance()
+{
+	const ImFont* pFont = ImGui::GetFont();
+	return pFont->GetCharAdvance((ImWchar)' ') * (ImGui::GetFontSize() / pFont->FontSize);
+}
+
 int CrazyLog::GetLineMaxColumn(int aLine)
 {
-	if (aLine >= vLineOffsets.size())
+	if (aLine >= LinesCount)
 		return 0;
 
-	const char* pLineStart = Buf.begin() + vLineOffsets[aLine];
-	const char* pLineEnd = (aLine + 1 < vLineOffsets.Size) ? (Buf.begin() + vLineOffsets[aLine + 1] - 1) : Buf.end();
+	const char* pLineStart;
+	const char* pLineEnd;
+	GetLineRange(aLine, &pLineStart, &pLineEnd);
 	size_t LineSize = pLineEnd - pLineStart;
 
 	int col = 0;
@@ -1678,80 +4699,52 @@ Coordinates CrazyLog::SanitizeCoordinates(const Coordinates & aValue)
 {
 	int Line = aValue.Line;
 	int Column = aValue.Column;
-	if (Line >= (int)vLineOffsets.size())
+	if (Line >= LinesCount)
 	{
-		if (vLineOffsets.empty())
+		if (LinesCount == 0)
 		{
 			Line = 0;
 			Column = 0;
 		}
 		else
 		{
-			Line = (int)vLineOffsets.size() - 1;
+			Line = LinesCount - 1;
 			Column = GetLineMaxColumn(Line);
 		}
 		return Coordinates(Line, Column);
 	}
 	else
 	{
-		Column = vLineOffsets.empty() ? 0 : min(Column, GetLineMaxColumn(Line));
+		Column = LinesCount == 0 ? 0 : min(Column, GetLineMaxColumn(Line));
 		return Coordinates(Line, Column);
 	}
 }
 
 Coordinates CrazyLog::ScreenPosToCoordinates(const ImVec2& aPosition) {
-	ImVec2 Origin = ImGui::GetCursorScreenPos();
-	ImVec2 Local(aPosition.x - Origin.x, aPosition.y - Origin.y);
-
 	int LineNo = MouseOverLineIdx;
 	int ColumnCoord = 0;
-	float ColumnX = 0.0f;
-
-	if (bShowLineNum) {
-		char aBuff[16] = { 0 };
-		snprintf(aBuff, ArrayCount(aBuff), "[ %d ] ", LineNo);
-		ColumnX = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, aBuff, nullptr, nullptr).x;
-	}
 
-	if (LineNo >= 0 && LineNo < (int)vLineOffsets.size())
+	if (LineNo >= 0 && LineNo < LinesCount)
 	{
-		const char* pLineStart = Buf.begin() + vLineOffsets[LineNo];
-		const char* pLineEnd = (LineNo + 1 < vLineOffsets.Size) ? (Buf.begin() + vLineOffsets[LineNo + 1] - 1) : Buf.end();
-		size_t LineSize = pLineEnd - pLineStart;
+		const char* pLineStart;
+		const char* pLineEnd;
+		GetLineRange(LineNo, &pLineStart, &pLineEnd);
 
-		int ColumnIndex = 0;
+		// The text of the line starts where it was drawn, after the line number if it's shown.
+		float Advance = GetMonospaceAdvance();
+		float LocalX = aPosition.x - MouseOverLineTextX;
+		float ColumnX = 0.0f;
 		
-
-		while ((size_t)ColumnIndex < LineSize)
+		const char* pCursor = pLineStart;
+		while (pCursor < pLineEnd)
 		{
-			float ColumnWidth = 0.0f;
-
-			//if (line_start[columnIndex] == '\t')
-			//{
-			//	float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ").x;
-			//	float oldX = columnX;
-			//	float newColumnX = (1.0f + ImFloor((1.0f + columnX) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-			//	columnWidth = newColumnX - oldX;
-			//	if (mTextStart + columnX + columnWidth * 0.5f > local.x)
-			//		break;
-			//	columnX = newColumnX;
-			//	columnCoord = (columnCoord / mTabSize) * mTabSize + mTabSize;
-			//	columnIndex++;
-			//}
-			//else
-			{
-				char TempBuff[7];
-				int CharLen = UTF8CharLength(pLineStart[ColumnIndex]);
-				int i = 0;
-				while (i < 6 && CharLen-- > 0)
-					TempBuff[i++] = pLineStart[ColumnIndex++];
-				TempBuff[i] = '\0';
-				ColumnWidth = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, TempBuff).x;
-				if (ColumnX + ColumnWidth * 0.5f > Local.x)
-					break;
-				ColumnX += ColumnWidth;
-				ColumnCoord++;
-			}
+			float ColumnWidth = (float)GetUTF8CharCells(*pCursor) * Advance;
+			if (ColumnX + ColumnWidth * 0.5f > LocalX)
+				break;
+			
+			ColumnX += ColumnWidth;
+			ColumnCoord++;
+			pCursor += UTF8CharLength(*pCursor);
 		}
 	}
 
@@ -1775,8 +4768,9 @@ void CrazyLog::SetSelection(const Coordinates& aStart, const Coordinates& aEnd,
 		case SM_Word:
 		{
 			int LineNo = Selection.Start.Line;
-			const char* pLineStart = Buf.begin() + vLineOffsets[LineNo];
-			const char* pLineEnd = (LineNo + 1 < vLineOffsets.Size) ? (Buf.begin() + vLineOffsets[LineNo + 1] - 1) : Buf.end();
+			const char* pLineStart;
+			const char* pLineEnd;
+			GetLineRange(LineNo, &pLineStart, &pLineEnd);
 
 			char* pWordStart = (char*)&pLineStart[Selection.Start.Column];
 			pWordStart = GetWordStart(pLineStart, pWordStart);
@@ -1810,7 +4804,7 @@ void CrazyLog::HandleMouseInputs()
 
 	if (ImGui::IsWindowHovered() )
 	{
-		if (vLineOffsets.size() > 0)
+		if (LinesCount > 0)
 		{
 			bool bClick = ImGui::IsMouseClicked(0);
 			bool bDoubleClick = ImGui::IsMouseDoubleClicked(0);
@@ -1883,124 +4877,255 @@ void CrazyLog::HandleMouseInputs()
 	}
 }
 
-// Draws Range until and after selection if a selection is found inside;
-void CrazyLog::DrawColoredRangeAndSelection(const char* pRangeStart, const char* pRangeEnd, const ImVec4 RangeColor,
-								  			const char* pSelectionStart, const char* pSelectionEnd,
-								  			bool& bIsItemHovered)
+// Where the glyphs of a line go and what they are drawn with.
+struct LogLineRenderer
 {
+	ImDrawList* pDrawList;
+	const ImFont* pFont;
+	float Scale;
+	float Advance;
+	ImVec4 ClipRect;
+	ImU32 SelectionColor;
+	
+	float X;
+	float Y;
+	int GlyphsLeft; // Reserved in the draw list and not written yet.
+	
+	// What is selected of the line, empty when nothing is.
+	const char* pSelectionBegin;
+	const char* pSelectionEnd;
+};
 
-	const char* pCursor = pRangeStart;
-
-	if (RangeColor.w != 0)
-		ImGui::PushStyleColor(ImGuiCol_Text, RangeColor);
-
-	if (pSelectionStart == pSelectionEnd) {
-
-		assert(pCursor != pRangeEnd);
-		ImGui::TextUnformatted(pCursor, pRangeEnd);
-		pCursor = pRangeEnd;
-
-		bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
-	}
-	else
+// Same glyph quads ImFont::RenderText would emit, stopping once they go past the right of the clip rect.
+static void EmitLineGlyphs(LogLineRenderer* pRenderer, const char* pText, const char* pTextEnd, ImU32 Color)
+{
+	const ImFont* pFont = pRenderer->pFont;
+	const ImVec4& ClipRect = pRenderer->ClipRect;
+	const float Scale = pRenderer->Scale;
+	const float Y = pRenderer->Y;
+	float X = pRenderer->X;
+	
+	while (pText < pTextEnd && X <= ClipRect.z && pRenderer->GlyphsLeft > 0)
 	{
-		// Selection starts inside the range
-		if (pSelectionStart >= pRangeStart && pSelectionStart < pRangeEnd) 
+		unsigned int c = (unsigned int)(uint8_t)*pText;
+		if (c < 0x80)
 		{
-			//assert(pRangeStart != pSelectionStart);
-			if (pRangeStart != pSelectionStart) // VALID: The selection starts where the range starts 
-			{
-				ImGui::TextUnformatted(pRangeStart, pSelectionStart);
-				pCursor = pSelectionStart;
-
-				bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
-				ImGui::SameLine(0.f,0.f);
-			}
-
-			assert(pCursor != min(pSelectionEnd, pRangeEnd));
-			// Write Selection
-			ImVec2 TextPos = ImGui::GetCursorScreenPos();
-			ImVec2 TextSize = ImGui::CalcTextSize(pCursor, min(pSelectionEnd, pRangeEnd));
-			ImGui::GetWindowDrawList()->AddRectFilled(TextPos, ImVec2(TextPos.x + TextSize.x, TextPos.y + TextSize.y), 
-													IM_COL32(66, 66, 66, 255)); 
-			ImGui::PushStyleColor(ImGuiCol_Text, SelectionTextColor);
-			ImGui::TextUnformatted(pCursor, min(pSelectionEnd, pRangeEnd));
-			ImGui::PopStyleColor();
-
-			bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
-
-			pCursor = min(pSelectionEnd, pRangeEnd);
-
-			//assert(pCursor != pRangeEnd);
-			if (pCursor != pRangeEnd) // VALID: The selection ends where the range ends
-			{ 
-				ImGui::SameLine(0.f,0.f);
-				ImGui::TextUnformatted(pCursor, pRangeEnd);
-				pCursor = pRangeEnd;
-
-				bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
-			}
+			pText += 1;
 		}
-		// Selection ends inside the range
-		else if (pSelectionEnd > pRangeStart && pSelectionEnd <= pRangeEnd)
+		else
 		{
-			assert(pRangeStart != min(pSelectionEnd, pRangeEnd));
-			// Write Selection
-			ImVec2 TextPos = ImGui::GetCursorScreenPos();
-			ImVec2 TextSize = ImGui::CalcTextSize(pRangeStart, min(pSelectionEnd, pRangeEnd));
-			ImGui::GetWindowDrawList()->AddRectFilled(TextPos, ImVec2(TextPos.x + TextSize.x, TextPos.y + TextSize.y), 
-													IM_COL32(66, 66, 66, 255)); 
-
-			ImGui::PushStyleColor(ImGuiCol_Text, SelectionTextColor);
-			ImGui::TextUnformatted(pRangeStart, min(pSelectionEnd, pRangeEnd));
-			ImGui::PopStyleColor();
-
-			bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
-
-			pCursor = min(pSelectionEnd, pRangeEnd);
-
-			//assert(pCursor != pRangeEnd);
-			if (pCursor != pRangeEnd) // VALID: The selection ends where the range ends
+			pText += ImTextCharFromUtf8(&c, pText, pTextEnd);
+			if (c == 0)
+				break;
+		}
+		
+		if (c == '\r')
+			continue;
+		
+		const ImFontGlyph* pGlyph = pFont->FindGlyph((ImWchar)c);
+		if (pGlyph && pGlyph->Visible)
+		{
+			float X1 = X + pGlyph->X0 * Scale;
+			float X2 = X + pGlyph->X1 * Scale;
+			if (X1 <= ClipRect.z && X2 >= ClipRect.x)
 			{
-				ImGui::SameLine(0.f,0.f);
-				ImGui::TextUnformatted(pCursor, pRangeEnd);
-				pCursor = pRangeEnd;
-
-				bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
+				pRenderer->pDrawList->PrimRectUV(ImVec2(X1, Y + pGlyph->Y0 * Scale), ImVec2(X2, Y + pGlyph->Y1 * Scale),
+				                                 ImVec2(pGlyph->U0, pGlyph->V0), ImVec2(pGlyph->U1, pGlyph->V1), Color);
+				pRenderer->GlyphsLeft--;
 			}
-			
 		}
-		// All the range is selected
-		else if (pSelectionStart < pRangeStart && pSelectionEnd > pRangeEnd) 
-		{
-			assert(pRangeStart != min(pSelectionEnd, pRangeEnd));
-			// Write Selection
-			ImVec2 TextPos = ImGui::GetCursorScreenPos();
-			ImVec2 TextSize = ImGui::CalcTextSize(pRangeStart, min(pSelectionEnd, pRangeEnd));
-			ImGui::GetWindowDrawList()->AddRectFilled(TextPos, ImVec2(TextPos.x + TextSize.x, TextPos.y + TextSize.y), 
-													IM_COL32(66, 66, 66, 255)); 
+		
+		X += c == '\t' ? pRenderer->Advance * IM_TABSIZE : pRenderer->Advance;
+	}
+	
+	pRenderer->X = X;
+}
 
-			ImGui::PushStyleColor(ImGuiCol_Text, SelectionTextColor);
-			ImGui::TextUnformatted(pRangeStart, min(pSelectionEnd, pRangeEnd));
-			pCursor = min(pSelectionEnd, pRangeEnd);
-			ImGui::PopStyleColor();
+// The part of the span that is selected goes with the selection color instead.
+static void EmitLineSpan(LogLineRenderer* pRenderer, const char* pText, const char* pTextEnd, ImU32 Color)
+{
+	const char* pSelectionBegin = ImClamp(pRenderer->pSelectionBegin, pText, pTextEnd);
+	const char* pSelectionEnd = ImClamp(pRenderer->pSelectionEnd, pSelectionBegin, pTextEnd);
+	
+	EmitLineGlyphs(pRenderer, pText, pSelectionBegin, Color);
+	EmitLineGlyphs(pRenderer, pSelectionBegin, pSelectionEnd, pRenderer->SelectionColor);
+	EmitLineGlyphs(pRenderer, pSelectionEnd, pTextEnd, Color);
+}
 
-			bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
+// Draws the line as a single item, writing the glyphs straight to the draw list with the color of the span
+// they are in. Returns if the mouse is over its row.
+// NOTE(matiasp): The font is monospace, so where the selection begins and where the mouse is are a count
+// of advances away from the line start, no need to measure the text for any of it. The same goes for
+// the part of a long line that is visible, only the glyphs of those cells are looked at.
+bool CrazyLog::DrawLogLine(int LineNo, const char* pLineStart, const char* pLineEnd,
+                           const char* pSelectionStart, const char* pSelectionEnd,
+                           bool bIsFindLine, bool bIsWindowHovered)
+{
+	ImGuiWindow* pWindow = ImGui::GetCurrentWindow();
+	ImDrawList* pDrawList = pWindow->DrawList;
+	HighlightCacheEntry* pEntry = GetHighlightCacheEntry(LineNo, pLineStart, pLineEnd);
+	
+	LogLineRenderer Renderer;
+	Renderer.pDrawList = pDrawList;
+	Renderer.pFont = ImGui::GetFont();
+	Renderer.Scale = ImGui::GetFontSize() / Renderer.pFont->FontSize;
+	Renderer.Advance = GetMonospaceAdvance();
+	Renderer.ClipRect = pDrawList->_CmdHeader.ClipRect;
+	Renderer.SelectionColor = ImGui::GetColorU32(SelectionTextColor);
+	Renderer.pSelectionBegin = nullptr;
+	Renderer.pSelectionEnd = nullptr;
+	
+	ImVec2 TextPos = ImVec2(pWindow->DC.CursorPos.x, pWindow->DC.CursorPos.y + pWindow->DC.CurrLineTextBaseOffset);
+	ImVec2 TextSize = ImVec2((float)pEntry->CellsCount * Renderer.Advance, ImGui::GetFontSize());
+	ImGui::ItemSize(TextSize, 0.f);
+	
+	ImVec2 MousePos = ImGui::GetMousePos();
+	bool bIsHovered = bIsWindowHovered && MousePos.y >= TextPos.y && MousePos.y < TextPos.y + OutputTextLineHeight;
+	if (bIsHovered)
+	{
+		MouseOverLineIdx = LineNo;
+		MouseOverLineTextX = TextPos.x;
+	}
+	
+	Renderer.X = IM_FLOOR(TextPos.x);
+	Renderer.Y = IM_FLOOR(TextPos.y);
+	
+	// The clipper can hand over a row that is not visible yet.
+	if (Renderer.Y > Renderer.ClipRect.w || Renderer.Y + TextSize.y < Renderer.ClipRect.y)
+		return bIsHovered;
+	
+	if (bIsFindLine)
+		pDrawList->AddRectFilled(TextPos, ImVec2(TextPos.x + TextSize.x, TextPos.y + TextSize.y), IM_COL32(66, 66, 66, 255));
+	
+	if (pSelectionStart && pSelectionEnd && pSelectionStart < pSelectionEnd && 
+	    pSelectionStart < pLineEnd && pSelectionEnd > pLineStart)
+	{
+		Renderer.pSelectionBegin = max(pSelectionStart, pLineStart);
+		Renderer.pSelectionEnd = min(pSelectionEnd, pLineEnd);
+		
+		int SelectionCell = pEntry->bIsOneCellPerByte ? (int)(Renderer.pSelectionBegin - pLineStart) :
+			CountTextCells(pLineStart, Renderer.pSelectionBegin, bIsAVXEnabled);
+		int SelectionCells = pEntry->bIsOneCellPerByte ? (int)(Renderer.pSelectionEnd - Renderer.pSelectionBegin) :
+			CountTextCells(Renderer.pSelectionBegin, Renderer.pSelectionEnd, bIsAVXEnabled);
+		
+		float SelectionX = TextPos.x + (float)SelectionCell * Renderer.Advance;
+		float SelectionWidth = (float)SelectionCells * Renderer.Advance;
+		pDrawList->AddRectFilled(ImVec2(SelectionX, TextPos.y), ImVec2(SelectionX + SelectionWidth, TextPos.y + TextSize.y), 
+		                         IM_COL32(66, 66, 66, 255));
+	}
+	
+	// Only the cells between the sides of the clip rect, plus the one before in case its glyph reaches into it.
+	const char* pVisibleStart = pLineStart;
+	const char* pVisibleEnd = pLineEnd;
+	int GlyphsCount = (int)(pLineEnd - pLineStart);
+	if (Renderer.Advance > 0.f)
+	{
+		int FirstCell = max((int)((Renderer.ClipRect.x - TextPos.x) / Renderer.Advance) - 1, 0);
+		int VisibleCells = (int)((Renderer.ClipRect.z - Renderer.ClipRect.x) / Renderer.Advance) + 3;
+		GlyphsCount = min(GlyphsCount, VisibleCells);
+		
+		int SkippedCells = 0;
+		if (pEntry->bIsOneCellPerByte)
+		{
+			SkippedCells = min(FirstCell, pEntry->CellsCount);
+			pVisibleStart = pLineStart + SkippedCells;
+			pVisibleEnd = pVisibleStart + min(VisibleCells, (int)(pLineEnd - pVisibleStart));
 		}
-		// None of the range is selected
 		else
 		{
-			assert(pCursor != pRangeEnd);
-			ImGui::TextUnformatted(pCursor, pRangeEnd);
-			pCursor = pRangeEnd;
-
-			bIsItemHovered |= ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone);
-
+			// The character the first cell lands on can start a few cells before it, like a tab.
+			int VisibleSkippedCells = 0;
+			pVisibleStart = SkipTextCells(pLineStart, pLineEnd, FirstCell, bIsAVXEnabled, &SkippedCells);
+			pVisibleEnd = SkipTextCells(pVisibleStart, pLineEnd, VisibleCells + FirstCell - SkippedCells, bIsAVXEnabled, &VisibleSkippedCells);
+		}
+		
+		Renderer.X += (float)SkippedCells * Renderer.Advance;
+	}
+	
+	if (GlyphsCount <= 0 || pVisibleStart == pVisibleEnd)
+		return bIsHovered;
+	
+	const HighlightLineMatches* pLineMatches = GetHighlightLineMatches(pEntry, pLineStart, pLineEnd,
+	                                                                   (int)(pVisibleStart - pLineStart),
+	                                                                   (int)(pVisibleEnd - pLineStart));
+	const char* pMatchesStart = pLineStart + pEntry->SearchBegin;
+	
+	// Nothing can be drawn in between, the glyphs are written on what is reserved for them.
+	pDrawList->PrimReserve(GlyphsCount * 6, GlyphsCount * 4);
+	Renderer.GlyphsLeft = GlyphsCount;
+	
+	ImU32 TextColor = ImGui::GetColorU32(ImGuiCol_Text);
+	
+	// A match that begins inside the previous one only colors what is left of it.
+	const char* pLineCursor = pVisibleStart;
+	for (int i = 0; i < pLineMatches->vLineMatches.Size; i++)
+	{
+		const HighlightLineMatchEntry& Match = pLineMatches->vLineMatches[i];
+		const char* pWordBegin = pMatchesStart + Match.WordBeginOffset;
+		const char* pWordEnd = min(pMatchesStart + Match.WordEndOffset + 1, pLineEnd);
+		
+		if (pWordBegin >= pVisibleEnd)
+			break;
+		
+		if (pWordEnd <= pLineCursor)
+			continue;
+		
+		if (pLineCursor < pWordBegin)
+		{
+			EmitLineSpan(&Renderer, pLineCursor, pWordBegin, TextColor);
+			pLineCursor = pWordBegin;
 		}
+		
+		uint8_t FilterIdx = Match.FilterIdxMatching;
+		ImVec4 FilterColor = FilterIdx != 255 ? Filter.vSettings[FilterIdx].Color : FindTextColor;
+		ImU32 SpanColor = FilterColor.w != 0 ? ImGui::GetColorU32(FilterColor) : TextColor;
+		
+		EmitLineSpan(&Renderer, pLineCursor, pWordEnd, SpanColor);
+		pLineCursor = pWordEnd;
 	}
+	
+	if (pLineCursor < pVisibleEnd)
+		EmitLineSpan(&Renderer, pLineCursor, pVisibleEnd, TextColor);
+	
+	pDrawList->PrimUnreserve(Renderer.GlyphsLeft * 6, Renderer.GlyphsLeft * 4);
+	
+	return bIsHovered;
+}
 
-	if (RangeColor.w != 0)
-		ImGui::PopStyleColor();
+// Marks in the gutter which file of the folder the line comes from, naming the file where it starts.
+void CrazyLog::DrawLogSegmentGutter(int LineNo, int PrevLineNo)
+{
+	if (vLogSegments.Size < 2)
+		return;
+	
+	int SegmentIdx = FindLogSegment(LineNo);
+	if (SegmentIdx == -1)
+		return;
+	
+	const LogSegment& Segment = vLogSegments[SegmentIdx];
+	const char* pFileName = StringUtils::GetPathPastLastSlash((char*)Segment.aFilePath);
+	
+	ImGuiWindow* pWindow = ImGui::GetCurrentWindowRead();
+	ImDrawList* pDrawList = ImGui::GetWindowDrawList();
+	ImVec2 LinePos = ImGui::GetCursorScreenPos();
+	ImU32 SegmentColor = SegmentIdx % 2 == 0 ? IM_COL32(66,150,250,255) : IM_COL32(250,150,66,255);
+	
+	// The window padding is the only room on the left that is not scrolled away.
+	ImVec2 GutterMin = ImVec2(pWindow->InnerClipRect.Min.x, LinePos.y);
+	ImVec2 GutterMax = ImVec2(GutterMin.x + 3.f, LinePos.y + OutputTextLineHeight);
+	pDrawList->AddRectFilled(GutterMin, GutterMax, SegmentColor);
+	
+	if (FindLogSegment(PrevLineNo) != SegmentIdx)
+	{
+		float RightX = pWindow->InnerClipRect.Max.x;
+		ImVec2 NameSize = ImGui::CalcTextSize(pFileName);
+		pDrawList->AddLine(ImVec2(GutterMin.x, LinePos.y), ImVec2(RightX, LinePos.y), SegmentColor);
+		pDrawList->AddRectFilled(ImVec2(RightX - NameSize.x - 8.f, LinePos.y), ImVec2(RightX, LinePos.y + NameSize.y), SegmentColor);
+		pDrawList->AddText(ImVec2(RightX - NameSize.x - 4.f, LinePos.y), IM_COL32_BLACK, pFileName);
+	}
+	
+	if (ImGui::IsMouseHoveringRect(GutterMin, ImVec2(GutterMax.x + 4.f, GutterMax.y)))
+		ImGui::SetTooltip("%s", Segment.aFilePath);
 }
 
 void CrazyLog::DrawFullView(PlatformContext* pPlatformCtx)
@@ -2011,88 +5136,38 @@ void CrazyLog::DrawFullView(PlatformContext* pPlatformCtx)
 	const char* buf = Buf.begin();
 	const char* buf_end = Buf.end();
 
-	const char* pSelectionStart = vLineOffsets.size() > Selection.Start.Line ? Buf.begin() + vLineOffsets[Selection.Start.Line] + Selection.Start.Column : nullptr;
-	const char* pSelectionEnd = vLineOffsets.size() > Selection.End.Line ? Buf.begin() + vLineOffsets[Selection.End.Line] + Selection.End.Column : nullptr;
+	const char* pSelectionStart = LinesCount > Selection.Start.Line ? FindLineStart(Selection.Start.Line) + Selection.Start.Column : nullptr;
+	const char* pSelectionEnd = LinesCount > Selection.End.Line ? FindLineStart(Selection.End.Line) + Selection.End.Column : nullptr;
+	bool bIsWindowHovered = ImGui::IsWindowHovered();
 	
 	ImGuiListClipper clipper;
-	clipper.Begin(vLineOffsets.Size);
+	clipper.Begin(LinesCount);
 
-	TempLineMatches.vLineMatches.reserve(20);
 	char aLineNumberBuff[17] = { 0 };
 	while (clipper.Step())
 	{
 		for (int line_no = clipper.DisplayStart; line_no < clipper.DisplayEnd; line_no++)
 		{
+			DrawLogSegmentGutter(line_no, line_no - 1);
+			
 			if (bShowLineNum) {
-				snprintf(aLineNumberBuff, sizeof(aLineNumberBuff), "[%i] -", line_no);
+				// A split line shows the number of the line it comes from.
+				bool bIsSplit = false;
+				int FileLineNo = GetFileLineNo(line_no, &bIsSplit);
+				snprintf(aLineNumberBuff, sizeof(aLineNumberBuff), bIsSplit ? "[%i] +" : "[%i] -", FileLineNo);
 				ImGui::Text(aLineNumberBuff);
 				ImGui::SameLine();
 			}
 			
-			const char* line_start = buf + vLineOffsets[line_no];
-			const char* line_end = (line_no + 1 < vLineOffsets.Size) ? (buf + vLineOffsets[line_no + 1] - 1) : buf_end;
-			
-			bool bIsItemHovered = false;
+			const char* line_start;
+			const char* line_end;
+			GetLineRange(line_no, &line_start, &line_end);
 			
-			CacheHighlightLineMatches(line_start, line_end, &TempLineMatches);
-			
-			if(vFindFullViewLinesCached.Size > 0 && line_no == vFindFullViewLinesCached[CurrentFindFullViewIdx])
-				HighlightLine(line_start, line_end);
-
-			const char* pLineCursor = line_start;
-
-			for (int i = 0; i < TempLineMatches.vLineMatches.Size; i++)
-			{
-				uint8_t FilterIdx = TempLineMatches.vLineMatches[i].FilterIdxMatching;
-				ImVec4 FilterColor = FilterIdx != 255 ? Filter.vSettings[FilterIdx].Color : FindTextColor;
-					
-				const char* pHighlightWordBegin = line_start + TempLineMatches.vLineMatches[i].WordBeginOffset;
-				const char* pHighlightWordEnd = line_start + TempLineMatches.vLineMatches[i].WordEndOffset + 1;
-
-				// Draw until the world begin
-				if (pLineCursor <= pHighlightWordBegin) 
-				{
-
-					// Draw until the highlight begin
-					if (pLineCursor != pHighlightWordBegin) // Valid Case, Previous filter could end at the new word begin
-					{
-						DrawColoredRangeAndSelection(pLineCursor, pHighlightWordBegin, ImVec4(), pSelectionStart, pSelectionEnd, bIsItemHovered);
-						pLineCursor = pHighlightWordBegin;
-
-						if (pLineCursor != line_end)
-							ImGui::SameLine(0.f,0.f);
-					}
-					
-					// Draw highlight 
-					DrawColoredRangeAndSelection(pHighlightWordBegin, pHighlightWordEnd, FilterColor, pSelectionStart, pSelectionEnd, bIsItemHovered);
-					pLineCursor = pHighlightWordEnd;
-
-					if (pLineCursor != line_end)
-						ImGui::SameLine(0.f,0.f);
-				}
-				else if (pLineCursor < pHighlightWordEnd) // In case a previous filter have already highlighted the begin. 
-				{
-					// Draw highlight, 
-					DrawColoredRangeAndSelection(pLineCursor, pHighlightWordEnd, FilterColor, pSelectionStart, pSelectionEnd, bIsItemHovered);
-					pLineCursor = pHighlightWordEnd;
-
-					if (pLineCursor != line_end)
-						ImGui::SameLine(0.f,0.f);
-
-				}
-			}
-				
-			// Draw after the highlights
-			if (pLineCursor != line_end) // Valid Case, we could have reached the end of the buffer.
-				DrawColoredRangeAndSelection(pLineCursor, line_end, ImVec4(), pSelectionStart, pSelectionEnd, bIsItemHovered);
-
-			if (bIsItemHovered)
-				MouseOverLineIdx = line_no;
+			bool bIsFindLine = vFindFullViewLinesCached.Size > 0 && line_no == vFindFullViewLinesCached[CurrentFindFullViewIdx];
+			DrawLogLine(line_no, line_start, line_end, pSelectionStart, pSelectionEnd, bIsFindLine, bIsWindowHovered);
 		}
 	}
 	
-	TempLineMatches.vLineMatches.clear();
-	
 	clipper.End();
 }
 
@@ -2102,13 +5177,15 @@ void CrazyLog::DrawMainBar(float DeltaTime, PlatformContext* pPlatformCtx)
 	{
 		if (ImGui::BeginMenu("Menu"))
 		{
-			if (ImGui::MenuItem("Save", nullptr, nullptr, aFilePathToLoad[0] != 0 && vFiltredLinesCached.Size > 0))
+			bool bCanSave = aFilePathToLoad[0] != 0 && vFiltredLinesCached.Size > 0 && !bIsLoadingFile && !bIsSavingFile && !bIsFilteringLines;
+			if (ImGui::MenuItem("Save", nullptr, nullptr, bCanSave))
 			{
+				// Load it again once the filtered view is written.
 				SaveFilteredView(pPlatformCtx, aFilePathToLoad);
-				LoadFile(pPlatformCtx);
+				bReloadAfterSave = bIsSavingFile;
 			}
 
-			if (ImGui::MenuItem("Save As..", nullptr, nullptr, aFilePathToLoad[0] != 0 && vFiltredLinesCached.Size > 0))
+			if (ImGui::MenuItem("Save As..", nullptr, nullptr, bCanSave))
 			{
 				char aSavePath[MAX_PATH] = { 0 };
 				if (pPlatformCtx->pGetSaveFilePathFunc(aSavePath, sizeof(aSavePath)))
@@ -2169,11 +5246,121 @@ void CrazyLog::DrawMainBar(float DeltaTime, PlatformContext* pPlatformCtx)
 					
 			if (bIsMultithreadEnabled)
 			{
+				bool bIsAutoThreadCountChanged = ImGui::Checkbox("Auto thread count", &bIsAutoThreadCountEnabled);
+				if (bIsAutoThreadCountChanged)
+				{
+					SaveTypeInSettings(pPlatformCtx, "is_auto_thread_count_enabled", cJSON_True, &bIsAutoThreadCountEnabled);
+					
+					if (bIsAutoThreadCountEnabled && !bWantsToTuneThreadCount)
+						ApplyAutoThreadCount();
+				}
+				
+				ImGui::SameLine();
+				HelpMarker("Measures how fast the first big filter goes with more and more threads \n"
+				           "and keeps the count past which the memory can't keep up. \n");
+				
+				ImGui::BeginDisabled(bIsAutoThreadCountEnabled);
 				bool bThreadCountChanged = ImGui::SliderInt("ExtraThreadCount", &SelectedExtraThreadCount, 0, MaxExtraThreadCount);
 				if (bThreadCountChanged)
 					SaveTypeInSettings(pPlatformCtx, "selected_thread_count", cJSON_Number, &SelectedExtraThreadCount);
+				ImGui::EndDisabled();
+			}
+			
+			// The load, save and copy threads are walking the lines with the current stride.
+			ImGui::BeginDisabled(bIsLoadingFile || bIsSavingFile || bIsCopyingLines);
+			
+			bool bSparseLineIndexChanged = ImGui::Checkbox("Sparse line index", &bIsSparseLineIndexEnabled);
+			if (bSparseLineIndexChanged)
+				SaveTypeInSettings(pPlatformCtx, "is_sparse_line_index_enabled", cJSON_True, &bIsSparseLineIndexEnabled);
+			
+			ImGui::SameLine();
+			HelpMarker("Only stores the offset of every Nth line, the rest are resolved on demand. \n"
+			           "Use it to save memory with very big files. \n");
+			
+			if (bIsSparseLineIndexEnabled)
+			{
+				ImGui::SliderInt("LineIndexInterval", &SparseLineIndexInterval, 2, MAX_SPARSE_LINE_INDEX_INTERVAL);
+				if (ImGui::IsItemDeactivatedAfterEdit())
+				{
+					SaveTypeInSettings(pPlatformCtx, "sparse_line_index_interval", cJSON_Number, &SparseLineIndexInterval);
+					bSparseLineIndexChanged = true;
+				}
+			}
+			
+			if (bSparseLineIndexChanged)
+			{
+				// The cached results are line numbers so those are still valid.
+				RebuildLineIndex();
+				SetLastCommand("LINE INDEX REBUILT");
+			}
+			
+			bool bLineSplitChanged = ImGui::Checkbox("Split long lines", &bIsLineSplitEnabled);
+			if (bLineSplitChanged)
+				SaveTypeInSettings(pPlatformCtx, "is_line_split_enabled", cJSON_True, &bIsLineSplitEnabled);
+			
+			ImGui::SameLine();
+			HelpMarker("Lines longer than this are filtered, drawn and highlighted in pieces of about this size, \n"
+			           "so a log that is a single huge line can be filtered on all the threads. \n"
+			           "The pieces keep the line number of the line they come from. \n");
+			
+			if (bIsLineSplitEnabled)
+			{
+				ImGui::SliderInt("SplitLineSizeKB", &SplitLineSizeKB, MIN_SPLIT_LINE_SIZE_KB, MAX_SPLIT_LINE_SIZE_KB);
+				if (ImGui::IsItemDeactivatedAfterEdit())
+				{
+					SaveTypeInSettings(pPlatformCtx, "split_line_size_kb", cJSON_Number, &SplitLineSizeKB);
+					bLineSplitChanged = true;
+				}
+			}
+			
+			if (bLineSplitChanged)
+			{
+				// The lines are not the same anymore, so neither are the results.
+				CancelFilterLines();
+				RebuildLineIndex();
+				ClearCache();
+				ClearFindCache(false);
+				ClearHighlightCache();
+				vSidecarFilters.resize(0);
+				SetLastCommand("LINE INDEX REBUILT");
+			}
+			
+			ImGui::EndDisabled();
+			
+			bool bMemoryMappingChanged = ImGui::Checkbox("Memory map files", &bIsMemoryMappingEnabled);
+			if (bMemoryMappingChanged)
+				SaveTypeInSettings(pPlatformCtx, "is_memory_mapping_enabled", cJSON_True, &bIsMemoryMappingEnabled);
+			
+			ImGui::SameLine();
+			HelpMarker("Static files are used straight from the OS file cache instead of being copied. \n"
+			           "Streamed files are still read since those keep growing. \n");
+			
+			if (bIsMemoryMappingEnabled)
+			{
+				bool bParallelPrefaultChanged = ImGui::Checkbox("Prefault in parallel", &bIsParallelPrefaultEnabled);
+				if (bParallelPrefaultChanged)
+					SaveTypeInSettings(pPlatformCtx, "is_parallel_prefault_enabled", cJSON_True, &bIsParallelPrefaultEnabled);
+				
+				ImGui::SameLine();
+				HelpMarker("Uses the extra threads to bring the whole file into memory while it's being indexed. \n");
+				
+				bool bSidecarIndexChanged = ImGui::Checkbox("Sidecar index", &bIsSidecarIndexEnabled);
+				if (bSidecarIndexChanged)
+					SaveTypeInSettings(pPlatformCtx, "is_sidecar_index_enabled", cJSON_True, &bIsSidecarIndexEnabled);
+				
+				ImGui::SameLine();
+				HelpMarker("Writes a " SIDECAR_INDEX_EXTENSION " file next to static files with the line index and the results \n"
+				           "of the last filters used, so reopening them skips the indexing and the filtering. \n");
 			}
 			
+			ImGui::SliderInt("MaxCopySizeMB", &MaxCopySizeMB, 0, MAX_COPY_SIZE_MB);
+			if (ImGui::IsItemDeactivatedAfterEdit())
+				SaveTypeInSettings(pPlatformCtx, "max_copy_size_mb", cJSON_Number, &MaxCopySizeMB);
+			
+			ImGui::SameLine();
+			HelpMarker("Copying the filtered view is skipped with a warning when it's bigger than this. \n"
+			           "Zero means there is no limit. \n");
+			
 			ImGui::EndMenu();
 		}
 		
@@ -2213,19 +5400,23 @@ void CrazyLog::DrawFind(float DeltaTime, PlatformContext* pPlatformCtx) {
 		int& TargetFindIdx = bIsLookingAtFullView ? CurrentFindFullViewIdx : CurrentFindFiltredIdx;
 		ImVector<int>& vTargetFindLinesCached = bIsLookingAtFullView ? vFindFullViewLinesCached : vFindFiltredLinesCached;
 		
-		// After the find is done (previous frame) focus on the first line 
+		// Focus on the first line as soon as the find gets to it, it could take a few frames.
 		if (bShouldFocusWhenFindFinish) 
 		{
 			if (vTargetFindLinesCached.Size > 0) 
 			{
 				int LineNo = vTargetFindLinesCached[TargetFindIdx];
 		
-				int ItemOffsetY = bIsLookingAtFullView ? LineNo : vFiltredLinesCached.index_from_ptr(vFiltredLinesCached.find(LineNo));
+				int ItemOffsetY = bIsLookingAtFullView ? LineNo : FindFirstLineIdx(&vFiltredLinesCached, LineNo);
 				float ItemPosY = (float)(ItemOffsetY) * OutputTextLineHeight;
 				FindScrollValue = ItemPosY;
+				
+				bShouldFocusWhenFindFinish = false;
+			}
+			else if (IsFindDone())
+			{
+				bShouldFocusWhenFindFinish = false;
 			}
-			
-			bShouldFocusWhenFindFinish = false;
 		}
 		
 		
@@ -2243,24 +5434,31 @@ void CrazyLog::DrawFind(float DeltaTime, PlatformContext* pPlatformCtx) {
 			ImGui::SetKeyboardFocusHere();
 		
 		ImGui::SetNextItemWidth(200);
-		if (ImGui::InputText("Find", aFindTextBuffer, MAX_PATH, ImGuiInputTextFlags_EnterReturnsTrue)) 
+		bool bEnterPressed = ImGui::InputText("Find", aFindTextBuffer, MAX_PATH, ImGuiInputTextFlags_EnterReturnsTrue);
+		
+		// Finds as you type, once the typing stops for a bit or right away with enter.
+		bool bWantsToFind = bEnterPressed;
+		if (ImGui::IsItemEdited())
 		{
-			memcpy(aFindText, aFindTextBuffer, sizeof(aFindTextBuffer));
-			
-			FindTextLen = (int)strlen(aFindText);
-			FindScrollValue = -1.f;
-			
-			CurrentFindFullViewIdx = 0;
-			FindFullViewProccesedLinesCount = 0;
-			vFindFullViewLinesCached.resize(0);
-			
-			CurrentFindFiltredIdx = 0;
-			FindFiltredProccesedLinesCount = 0;
-			vFindFiltredLinesCached.resize(0);
+			FindTypingCooldown = FIND_TYPING_DELAY;
+		}
+		else if (FindTypingCooldown > 0.f)
+		{
+			FindTypingCooldown -= DeltaTime;
+			bWantsToFind |= FindTypingCooldown <= 0.f;
+		}
+		
+		if (bWantsToFind) 
+		{
+			FindTypingCooldown = -1.f;
+			SetFindText(aFindTextBuffer);
 			
 			if (FindTextLen > 0) {
 				bShouldFocusWhenFindFinish = true;
-				RememberInputText(pPlatformCtx, RITT_Find, aFindText);
+				
+				// Only what was meant to be found, not every prefix on the way.
+				if (bEnterPressed)
+					RememberInputText(pPlatformCtx, RITT_Find, aFindText);
 			}
 		}
 		
@@ -2271,7 +5469,7 @@ void CrazyLog::DrawFind(float DeltaTime, PlatformContext* pPlatformCtx) {
 				
 			int LineNo = vTargetFindLinesCached[TargetFindIdx];
 			
-			int ItemOffsetY = bIsLookingAtFullView ? LineNo : vFiltredLinesCached.index_from_ptr(vFiltredLinesCached.find(LineNo));
+			int ItemOffsetY = bIsLookingAtFullView ? LineNo : FindFirstLineIdx(&vFiltredLinesCached, LineNo);
 			float ItemPosY = (float)(ItemOffsetY) * OutputTextLineHeight;
 			FindScrollValue = ItemPosY;
 		}
@@ -2283,7 +5481,7 @@ void CrazyLog::DrawFind(float DeltaTime, PlatformContext* pPlatformCtx) {
 				
 			int LineNo = vTargetFindLinesCached[TargetFindIdx];
 		
-			int ItemOffsetY = bIsLookingAtFullView ? LineNo : vFiltredLinesCached.index_from_ptr(vFiltredLinesCached.find(LineNo));
+			int ItemOffsetY = bIsLookingAtFullView ? LineNo : FindFirstLineIdx(&vFiltredLinesCached, LineNo);
 			float ItemPosY = (float)(ItemOffsetY) * OutputTextLineHeight;
 			FindScrollValue = ItemPosY;
 		}
@@ -2291,7 +5489,14 @@ void CrazyLog::DrawFind(float DeltaTime, PlatformContext* pPlatformCtx) {
 		ImGui::SameLine();
 		
 		ImGui::SetNextItemWidth(-200);
-		ImGui::Text("%i/%i", vTargetFindLinesCached.Size == 0 ? 0 : TargetFindIdx + 1, vTargetFindLinesCached.Size);
+		ImGui::Text("%i/%i%s", vTargetFindLinesCached.Size == 0 ? 0 : TargetFindIdx + 1, vTargetFindLinesCached.Size, 
+		            IsFindDone() ? "" : "...");
+		
+		if (vTargetFindLinesCached.Size > 0)
+		{
+			ImGui::SameLine();
+			ImGui::TextDisabled("(%i in line)", CountFindOccurrences(vTargetFindLinesCached[TargetFindIdx]));
+		}
 
 		ImGui::SameLine();
 		if (ImGui::Button("X"))
@@ -2316,18 +5521,9 @@ void CrazyLog::DrawFind(float DeltaTime, PlatformContext* pPlatformCtx) {
 				if (ImGui::MenuItem(vRecentInputText[i].aText))
 				{
 					memcpy(aFindTextBuffer, vRecentInputText[i].aText, sizeof(RecentInputText::aText));
-					memcpy(aFindText, vRecentInputText[i].aText, sizeof(RecentInputText::aText));
 					
-					FindTextLen = (int)strlen(aFindText);
-					FindScrollValue = -1.f;
-			
-					CurrentFindFullViewIdx = 0;
-					FindFullViewProccesedLinesCount = 0;
-					vFindFullViewLinesCached.resize(0);
-			
-					CurrentFindFiltredIdx = 0;
-					FindFiltredProccesedLinesCount = 0;
-					vFindFiltredLinesCached.resize(0);
+					FindTypingCooldown = -1.f;
+					SetFindText(aFindTextBuffer);
 			
 					if(FindTextLen > 0)
 						bShouldFocusWhenFindFinish = true;
@@ -2372,11 +5568,18 @@ void CrazyLog::DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx)
 	bool bModeJustChanged = LastChangeReason != TMCR_NONE;
 
 	if (bModeJustChanged)
+	{
+		UnwatchFolder(pPlatformCtx);
 		SaveTypeInSettings(pPlatformCtx, "last_selected_target_mode", cJSON_Number, &(int)SelectedTargetMode);
+	}
 	
-	if (SelectedTargetMode == TM_StreamLastModifiedFileFromFolder)
+	if (SelectedTargetMode == TM_StreamLastModifiedFileFromFolder || SelectedTargetMode == TM_StreamAllFilesFromFolder)
 	{
 		bool bLoadTriggerExternally = LastChangeReason == TMCR_RecentSelected;
+		unsigned FolderChanges = pFolderWatcher ? pPlatformCtx->pPollFolderChangesFunc(pFolderWatcher) : FCF_NONE;
+		
+		// NOTE(matiasp): While the folder is watched the timed fetch is only a fallback for the writes that don't get notified.
+		float FileFetchInterval = pFolderWatcher ? max(FileContentFetchSlider, WATCHED_FILE_FETCH_INTERVAL) : FileContentFetchSlider;
 		
 		if (bModeJustChanged)
 		{
@@ -2406,13 +5609,19 @@ void CrazyLog::DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx)
 			bStreamFileLocked = false;
 			bFolderQuery = true;
 			SearchLatestFile(pPlatformCtx);
+			WatchFolder(pPlatformCtx);
 			
 			if (aFolderQueryName[0] != 0) 
 				RememberInputText(pPlatformCtx, RITT_StreamPath, aFolderQueryName);
 		}
 		else if (bFolderQuery && !bStreamFileLocked)
 		{
-			if (FolderFetchCooldown > 0.f ) 
+			// Only a new file can be newer than the one we have, the writes get picked by the fetch below.
+			if (FolderChanges & FCF_NewFile)
+			{
+				SearchLatestFile(pPlatformCtx);
+			}
+			else if (FolderFetchCooldown > 0.f && !pFolderWatcher) 
 			{
 				FolderFetchCooldown -= DeltaTime;
 				if (FolderFetchCooldown <= 0.f) 
@@ -2439,6 +5648,7 @@ void CrazyLog::DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx)
 				strcat_s(aFolderQueryName, "\\*.*");
 
 				SearchLatestFile(pPlatformCtx);
+				WatchFolder(pPlatformCtx);
 				RememberInputText(pPlatformCtx, RITT_StreamPath, aFolderQueryName);
 			}
 		}
@@ -2460,8 +5670,7 @@ void CrazyLog::DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx)
 				if (ImGui::MenuItem(vRecentStreamPaths[i].aText))
 				{
 					memcpy(aFolderQueryName, vRecentStreamPaths[i].aText, sizeof(RecentInputText::aText));
-						
-					SelectedTargetMode = TM_StreamLastModifiedFileFromFolder;
+					
 					PendingModeChange = TMCR_RecentSelected;
 					
 					ImGui::CloseCurrentPopup();
@@ -2475,11 +5684,17 @@ void CrazyLog::DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx)
 		{
 			if (FileContentFetchCooldown > 0 && bFileLoaded) 
 			{
+				// NOTE(matiasp): NTFS doesn't always notify when a file that is still open by the writer grows,
+				// so we keep polling it as fallback. A new file could mean ours got replaced, so that one checks it too.
 				FileContentFetchCooldown -= DeltaTime;
-				if (FileContentFetchCooldown <= 0.f) 
+				if (FileContentFetchCooldown <= 0.f || (FolderChanges & FCF_NewFile)) 
+				{
+					FetchFile(pPlatformCtx, true);
+					FileContentFetchCooldown = FileFetchInterval;
+				}
+				else if (FolderChanges & FCF_FileContent)
 				{
-					FetchFile(pPlatformCtx);
-					FileContentFetchCooldown = FileContentFetchSlider;
+					FetchFile(pPlatformCtx, false);
 				}
 			}
 		}
@@ -2494,7 +5709,7 @@ void CrazyLog::DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx)
 			ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
 			if (bStreamMode && bFileLoaded)
 			{
-				float FileFetchCooldownPercentage = FileContentFetchCooldown / FileContentFetchSlider;
+				float FileFetchCooldownPercentage = FileContentFetchCooldown / FileFetchInterval;
 				ImGui::PushStyleColor(ImGuiCol_Button, IM_COL32(20,100,38,255 * FileFetchCooldownPercentage));
 			}
 			else
@@ -2507,7 +5722,10 @@ void CrazyLog::DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx)
 			ImGui::PopItemFlag();
 			
 			ImGui::SameLine();
-			ImGui::Text("Streaming file: [%s]", StringUtils::GetPathPastLastSlash(aFilePathToLoad));
+			if (vLogSegments.Size > 1)
+				ImGui::Text("Streaming %i files, newest: [%s]", vLogSegments.Size, StringUtils::GetPathPastLastSlash(aFilePathToLoad));
+			else
+				ImGui::Text("Streaming file: [%s]", StringUtils::GetPathPastLastSlash(aFilePathToLoad));
 		}
 	}
 	else if (SelectedTargetMode == TM_StaticText)
@@ -3129,9 +6347,31 @@ bool CrazyLog::AnyFilterActive () const
 	return false;
 }
 
-void CrazyLog::CacheHighlightLineMatches(const char* pLineBegin, const char* pLineEnd, HighlightLineMatches* pFiltredLineMatch)
+// Once a frame, before drawing the lines. Nothing in the cache is any good if the words it highlighted changed.
+void CrazyLog::UpdateHighlightCache()
 {
-	pFiltredLineMatch->vLineMatches.resize(0);
+	ImGuiID FilterHash = ImHashStr(Filter.aInputBuf);
+	for (int i = 0; i < Filter.vSettings.Size; i++)
+		FilterHash = ImHashData(&Filter.vSettings[i].bIsEnabled, sizeof(bool), FilterHash);
+	
+	ImGuiID FindHash = ImHashData(aFindText, FindTextLen);
+	
+	if (FilterHash != HighlightCache.FilterHash || FindHash != HighlightCache.FindHash)
+	{
+		ClearHighlightCache();
+		HighlightCache.FilterHash = FilterHash;
+		HighlightCache.FindHash = FindHash;
+		
+		BuildHighlightNeedles();
+	}
+}
+
+// The enabled filters that are not negated and the find text, sorted the longest first so the line
+// can be searched for all of them at once.
+void CrazyLog::BuildHighlightNeedles()
+{
+	ImVector<TextNeedle>& vNeedles = HighlightCache.vNeedles;
+	vNeedles.resize(0);
 	
 	for (int i = 0; i != Filter.vFilters.Size; i++)
 	{
@@ -3140,66 +6380,151 @@ void CrazyLog::CacheHighlightLineMatches(const char* pLineBegin, const char* pLi
 			continue;
 		
 		const CrazyTextFilter::CrazyTextRange& f = Filter.vFilters[i];
-		if (f.Empty())
+		if (f.Empty() || f.EndOffset <= f.BeginOffset)
 			continue;
 		
 		if (Filter.aInputBuf[f.BeginOffset] == '!')
 			continue;
-
-		const char* pWordBegin = &Filter.aInputBuf[f.BeginOffset];
-		const char* pWordEnd = &Filter.aInputBuf[f.EndOffset];
 		
-		CacheHighlightMatchingWord(pLineBegin, pLineEnd, pWordBegin, pWordEnd, i, pFiltredLineMatch);
+		TextNeedle Needle;
+		Needle.pText = &Filter.aInputBuf[f.BeginOffset];
+		Needle.Size = f.EndOffset - f.BeginOffset;
+		Needle.FilterIdx = (uint8_t)i;
+		vNeedles.push_back(Needle);
 	}
 	
-	if (FindTextLen > 0) {
-		CacheHighlightMatchingWord(pLineBegin, pLineEnd, aFindText, aFindText + FindTextLen, -1, pFiltredLineMatch);
+	if (FindTextLen > 0)
+	{
+		TextNeedle Needle;
+		Needle.pText = aFindText;
+		Needle.Size = FindTextLen;
+		Needle.FilterIdx = 255;
+		vNeedles.push_back(Needle);
+	}
+	
+	// NOTE(matiasp): Insertion sort, they are a handful and the ones with the same size keep their order.
+	for (int i = 1; i < vNeedles.Size; i++)
+	{
+		TextNeedle Needle = vNeedles[i];
+		int j = i;
+		for (; j > 0 && vNeedles[j - 1].Size < Needle.Size; j--)
+			vNeedles[j] = vNeedles[j - 1];
+		
+		vNeedles[j] = Needle;
 	}
-
-	if (pFiltredLineMatch->vLineMatches.Size > 0)
-		qsort(pFiltredLineMatch->vLineMatches.Data, pFiltredLineMatch->vLineMatches.Size, sizeof(HighlightLineMatchEntry), HighlightLineMatchEntry::SortFunc);
 }
 
-void CrazyLog::CacheHighlightMatchingWord(const char* pLineBegin, const char* pLineEnd, 
-										  const char* pWordBegin, const char* pWordEnd, 
-										  int FilterIdx, HighlightLineMatches* pFiltredLineMatch)
+void CrazyLog::ClearHighlightCache()
 {
+	for (int i = 0; i < HighlightCache.vEntries.Size; i++)
+		HighlightCache.vEntries[i].LineMatches.vLineMatches.clear();
 	
-	if (!pWordEnd)
-		pWordEnd = pWordBegin + strlen(pWordBegin);
+	HighlightCache.vEntries.clear();
+}
 
-	const char FirstWordChar = (char)ImToUpper(*pWordBegin);
+// The pointer is good until the next call.
+HighlightCacheEntry* CrazyLog::GetHighlightCacheEntry(int LineNo, const char* pLineBegin, const char* pLineEnd)
+{
+	ImVector<HighlightCacheEntry>& vEntries = HighlightCache.vEntries;
+	int LineSize = (int)(pLineEnd - pLineBegin);
+	int Frame = ImGui::GetFrameCount();
+	
+	int Low = 0;
+	int High = vEntries.Size;
+	while (Low < High)
+	{
+		int Mid = Low + (High - Low) / 2;
+		if (vEntries[Mid].LineNo < LineNo)
+			Low = Mid + 1;
+		else
+			High = Mid;
+	}
 	
-	const char* pLineStart = pLineBegin;
+	if (Low < vEntries.Size && vEntries[Low].LineNo == LineNo)
+	{
+		HighlightCacheEntry& Entry = vEntries[Low];
+		if (Entry.LineSize != LineSize)
+			ResetHighlightCacheEntry(&Entry, pLineBegin, pLineEnd);
 		
-	while ((!pLineEnd && *pLineBegin) || (pLineEnd && pLineBegin < pLineEnd))
+		Entry.LastUsedFrame = Frame;
+		return &Entry;
+	}
+	
+	HighlightCacheEntry Entry;
+	memset(&Entry, 0, sizeof(Entry));
+	
+	// The least used one goes, its memory is reused for this one.
+	if (vEntries.Size >= HIGHLIGHT_CACHE_LINES)
 	{
-		// If our line begin cursor match the first char, then try to see if it matches the entire word
-		if (ImToUpper(*pLineBegin) == FirstWordChar)
+		int LeastUsedIdx = 0;
+		for (int i = 1; i < vEntries.Size; i++)
 		{
-			const char* pWordCursor = pWordBegin + 1;
-			const char* pLineCursor = nullptr;
-			
-			// We iterate the length of our word and break if any character does not match
-			for (pLineCursor = pLineBegin + 1; pWordCursor < pWordEnd; pLineCursor++, pWordCursor++)
-			{
-				if (ImToUpper(*pLineCursor) != ImToUpper(*pWordCursor))
-					break;
-			}
-			
-			// NOTE(matiasp): This is quite expensive to do for line
-			// If we reached the end of the word it means that the entire word is equal
-			if (pWordCursor == pWordEnd)
-			{
-				pFiltredLineMatch->vLineMatches.push_back(
-					HighlightLineMatchEntry((uint8_t)FilterIdx, 
-					                        (uint16_t)(pLineBegin - pLineStart), 
-					                        (uint16_t)((pLineCursor - 1) - pLineStart)));
-			}
+			if (vEntries[i].LastUsedFrame < vEntries[LeastUsedIdx].LastUsedFrame)
+				LeastUsedIdx = i;
 		}
 		
-		pLineBegin++;
+		memcpy(&Entry, &vEntries[LeastUsedIdx], sizeof(Entry));
+		vEntries.erase(vEntries.Data + LeastUsedIdx);
+		
+		if (LeastUsedIdx < Low)
+			Low--;
+	}
+	
+	Entry.LineNo = LineNo;
+	Entry.LastUsedFrame = Frame;
+	ResetHighlightCacheEntry(&Entry, pLineBegin, pLineEnd);
+	
+	// The entry in the cache owns the matches now.
+	HighlightCacheEntry* pEntry = vEntries.insert(vEntries.Data + Low, Entry);
+	memset(&Entry, 0, sizeof(Entry));
+	
+	return pEntry;
+}
+
+// Measures the line, the matches are looked for once it's known what part of it is visible.
+void CrazyLog::ResetHighlightCacheEntry(HighlightCacheEntry* pEntry, const char* pLineBegin, const char* pLineEnd)
+{
+	pEntry->LineSize = (int)(pLineEnd - pLineBegin);
+	pEntry->CellsCount = CountTextCells(pLineBegin, pLineEnd, bIsAVXEnabled);
+	pEntry->bIsOneCellPerByte = pEntry->CellsCount == pEntry->LineSize;
+	pEntry->WindowBegin = 0;
+	pEntry->WindowEnd = 0;
+	pEntry->SearchBegin = 0;
+	pEntry->LineMatches.vLineMatches.resize(0);
+}
+
+// The matches are good for the bytes of the line in [VisibleBegin, VisibleEnd), offset from pEntry->SearchBegin.
+const HighlightLineMatches* CrazyLog::GetHighlightLineMatches(HighlightCacheEntry* pEntry, const char* pLineBegin, const char* pLineEnd,
+                                                              int VisibleBegin, int VisibleEnd)
+{
+	if (pEntry->WindowBegin <= VisibleBegin && VisibleEnd <= pEntry->WindowEnd)
+		return &pEntry->LineMatches;
+	
+	// NOTE(matiasp): Long lines are only looked at around what is visible, with some room so scrolling
+	// sideways doesn't look for them again every frame.
+	int LineSize = (int)(pLineEnd - pLineBegin);
+	int WindowBegin = 0;
+	int WindowEnd = LineSize;
+	if (LineSize > HIGHLIGHT_WHOLE_LINE_SIZE)
+	{
+		WindowBegin = max(VisibleBegin - HIGHLIGHT_WINDOW_MARGIN, 0);
+		WindowEnd = min(VisibleEnd + HIGHLIGHT_WINDOW_MARGIN, LineSize);
 	}
+	
+	// A match that colors the window can begin before it or end after it.
+	int NeedleReach = HighlightCache.vNeedles.Size > 0 ? HighlightCache.vNeedles[0].Size - 1 : 0;
+	int SearchBegin = max(WindowBegin - NeedleReach, 0);
+	int SearchEnd = min(WindowEnd + NeedleReach, LineSize);
+	
+	pEntry->WindowBegin = WindowBegin;
+	pEntry->WindowEnd = WindowEnd;
+	pEntry->SearchBegin = SearchBegin;
+	
+	pEntry->LineMatches.vLineMatches.resize(0);
+	FindAllNeedles(pLineBegin + SearchBegin, pLineBegin + SearchEnd, HighlightCache.vNeedles.Data, HighlightCache.vNeedles.Size, 
+	               bIsAVXEnabled, &pEntry->LineMatches);
+	
+	return &pEntry->LineMatches;
 }
 
 #undef ISSUES_URL
@@ -3212,7 +6537,44 @@ void CrazyLog::CacheHighlightMatchingWord(const char* pLineBegin, const char* pL
 #undef FILE_FETCH_INTERVALERVAL
 #undef FILE_FETCH_INTERVAL
 #undef FOLDER_FETCH_INTERVAL
+#undef WATCHED_FILE_FETCH_INTERVAL
 #undef CONSOLAS_FONT_SIZE
 #undef MAX_EXTRA_THREADS
+#undef SPARSE_LINE_INDEX_INTERVAL
+#undef MAX_SPARSE_LINE_INDEX_INTERVAL
+#undef SPLIT_LINE_SIZE_KB
+#undef MIN_SPLIT_LINE_SIZE_KB
+#undef MAX_SPLIT_LINE_SIZE_KB
+#undef LOAD_FILE_CHUNK_SIZE
+#undef FETCH_FILE_CHUNK_SIZE
+#undef SAVE_FILE_BATCH_LINES
+#undef GATHER_MIN_LINES_PER_THREAD
+#undef GATHER_PROGRESS_LINES
+#undef BACKGROUND_COPY_MIN_LINES
+#undef MAX_COPY_SIZE_MB
+#undef FOLDER_FILES_RESERVE
+#undef STREAM_FILE_START_CHECK_SIZE
+#undef TEXT_ENCODING_SAMPLE_SIZE
+#undef UTF16_TRANSCODE_SLICE_SIZE
+#undef LOAD_PIPELINE_DEPTH
+#undef FILTER_CHUNK_SIZE
+#undef SIDECAR_INDEX_EXTENSION
+#undef SIDECAR_INDEX_MAGIC
+#undef SIDECAR_INDEX_VERSION
+#undef SIDECAR_MAX_FILTERS
+#undef SIDECAR_SAMPLED_BLOCKS_COUNT
+#undef SIDECAR_SAMPLED_BLOCK_SIZE
+#undef FILTER_MIN_PARALLEL_SECONDS
+#undef FILTER_MIN_MEASURE_SIZE
+#undef FILTER_MAX_BLOCKING_SECONDS
+#undef FILTER_JOB_BATCH_CHUNKS
+#undef FIND_SLICE_LINES
+#undef FIND_FRAME_SECONDS
+#undef FIND_TYPING_DELAY
+#undef HIGHLIGHT_CACHE_LINES
+#undef HIGHLIGHT_WHOLE_LINE_SIZE
+#undef HIGHLIGHT_WINDOW_MARGIN
+#undef THREAD_COUNT_KNEE_RATIO
+#undef THREAD_COUNT_REGRESSION_RATIO
 #undef SAVE_ENABLE_MASK
 #undef MAX_REMEMBER_PATHS
\ No newline at end of file
@@ -1,4 +1,9 @@
+#include <atomic>
+#include <thread>
 #include "CrazyTextFilter.h"
+#include "CrazyDecompressor.h"
+#include "CrazyTextEncoding.h"
+#include "CrazyThreadPool.h"
 
 #pragma once
 
@@ -29,6 +34,7 @@ enum TargetMode
 	TM_StaticText = 0,
 	TM_StreamLastModifiedFileFromFolder,
 	TM_StreamFromWebSocket,
+	TM_StreamAllFilesFromFolder,
 	TM_COUNT
 };
 
@@ -46,7 +52,8 @@ static char* apTargetModeStr[TM_COUNT] =
 {
 	"StaticText",
 	"StreamLastModifiedFileFromFolder",
-	"StreamFromWebSocket - TODO"
+	"StreamFromWebSocket - TODO",
+	"StreamAllFilesFromFolder"
 };
 
 struct NamedFilter 
@@ -55,38 +62,34 @@ struct NamedFilter
 	CrazyTextFilter Filter;
 };
 
-struct HighlightLineMatchEntry
+struct HighlightCacheEntry
 {
-	const uint16_t WordBeginOffset;
-	const uint16_t WordEndOffset;
+	int LineNo;
+	int LineSize; // The last line can still grow while streaming.
+	int LastUsedFrame;
 	
-	uint8_t FilterIdxMatching;
+	// How wide the line is in cells of the monospace font, every byte is one when it's all ASCII.
+	int CellsCount;
+	bool bIsOneCellPerByte;
 	
-	HighlightLineMatchEntry(uint8_t in_FilterIdx, const uint16_t in_WordBeginOffset, const uint16_t in_WordEndOffset) :
-							FilterIdxMatching(in_FilterIdx),
-							WordBeginOffset(in_WordBeginOffset),
-							WordEndOffset(in_WordEndOffset)
-	{
-	}
-	
-	static int SortFunc(const void * a, const void * b)
-	{
-		const HighlightLineMatchEntry* pEntryA = (const HighlightLineMatchEntry*)a;
-		const HighlightLineMatchEntry* pEntryB = (const HighlightLineMatchEntry*)b;
-
-		if (pEntryA->WordBeginOffset != pEntryB->WordBeginOffset)
-			return pEntryA->WordBeginOffset > pEntryB->WordBeginOffset;
-
-		uint16_t LenA = pEntryA->WordEndOffset - pEntryA->WordBeginOffset;
-		uint16_t LenB = pEntryB->WordEndOffset - pEntryB->WordBeginOffset;
-
-		return LenA < LenB;
-	}
+	// The colors of the bytes of the line in [WindowBegin, WindowEnd) come from the matches, which are
+	// offsets from SearchBegin. Short lines have them all.
+	int WindowBegin;
+	int WindowEnd;
+	int SearchBegin;
+	HighlightLineMatches LineMatches;
 };
 
-struct HighlightLineMatches
+// NOTE(matiasp): The visible lines barely change from one frame to the next, so their highlights
+// are kept until the filter or the find text change, scrolling only looks at the lines that show up.
+struct HighlightLineCache
 {
-	ImVector<HighlightLineMatchEntry> vLineMatches;
+	ImVector<HighlightCacheEntry> vEntries; // Sorted by line number, the least used goes when it's full.
+	
+	// What the entries were highlighted with, the longest first.
+	ImVector<TextNeedle> vNeedles;
+	ImGuiID FilterHash;
+	ImGuiID FindHash;
 };
 
 struct RecentInputText
@@ -162,20 +165,230 @@ struct SelectionState
 	Coordinates CursorPosition;
 };
 
+// One of the files of the folder when all of them are loaded as a single log.
+struct LogSegment
+{
+	int FirstLineNo; // INT_MAX until the load thread gets to it.
+	int Offset;
+	char aFilePath[MAX_PATH];
+};
+
+struct LoadSegment
+{
+	void* pFileHandle;
+	int Offset;
+	int FileSize;
+	int FirstLineNo;
+	bool bNeedsLineEnd; // So the last line doesn't merge with the first one of the next file.
+	
+	// Every line start, only touched by the thread loading it.
+	ImVector<int> vLineOffsets;
+};
+
+// Shared between the main thread and the thread that reads + index the file in the background.
+// With a filter set, the loaded lines are filtered on their own threads too.
+struct LoadFileJob
+{
+	void* pFileHandle;
+	ReadFileChunkFunc pReadFileChunkFunc;
+	CloseFileFunc pCloseFileFunc;
+	PrefetchMemoryFunc pPrefetchMemoryFunc;
+	ThreadPool* pWorkerPool;
+	char* pDest;
+	int DestCapacity;
+	int FileSize;
+	int LineIndexStride;
+	int MaxLineSize;
+	int PrefaultThreadCount;
+	int ExtraThreadCount;
+	CompressionType Compression;
+	TextEncoding Encoding;
+	int BOMSize;
+	bool bUseAVX;
+	bool bIsMapped;
+	bool bDecompressFailed;
+	bool bOutOfMemory;
+	bool bReplacedInvalidUTF8; // Read by the main thread once it finished.
+	bool bFilterLines;
+	
+	// A copy, the main thread is free to change its own while we load.
+	CrazyTextFilter Filter;
+	
+	// Only touched by the load thread.
+	ImVector<int> vChunkLineOffsets;
+	ImVector<int> vChunkSplitLines;
+	ImVector<LoadSegment> vLoadSegments;
+	struct LoadFilterPass* pFilterPass; // The one running on the pool, null when none is.
+	int IndexedSize;
+	int IndexedLineStart;
+	int IndexedLinesCount;
+	int NextFilterOffset;
+	int NextFilterLineNo;
+	
+	std::atomic<bool> bIsRunning;
+	std::atomic<bool> bShouldCancel;
+	std::atomic<bool> bIsLocked;
+	std::atomic<bool> bStopFiltering;
+	
+	// Between the load thread and the one reading ahead of it, guarded by pReadAheadMutex.
+	// Allocated by the first load, the job lives in memory that never gets constructed.
+	std::mutex* pReadAheadMutex;
+	std::condition_variable* pReadAheadChanged;
+	int ReadAheadSize;
+	int ReadAheadConsumedSize;
+	bool bReadAheadFinished;
+	
+	// Guarded by bIsLocked, consumed by the main thread.
+	ImVector<int> vPendingLineOffsets;
+	ImVector<int> vPendingSplitLines;
+	int PendingLinesCount;
+	int PublishedSize;
+	char* pGrownDest;
+	int GrownDestCapacity;
+	int PublishedSegmentsCount;
+	int LoadedFileSize;
+	ImVector<int> vPendingFiltredLines;
+	int FiltredLinesCount;
+	bool bFinished;
+};
+
+// NOTE(matiasp): The sidecar index is written next to a static log, so reopening it skips the indexing
+// and the filtering of the last filters used with it. The header is followed by the line offsets,
+// the split lines and then by every filter entry.
+struct SidecarIndexHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t FileSize;
+	uint64_t LastWriteTime;
+	uint32_t SampledBlocksHash;
+	int BOMSize;
+	int LinesCount;
+	int LineIndexStride;
+	int LineOffsetsCount;
+	int MaxLineSize;
+	int SplitLinesCount;
+	int FiltersCount;
+};
+
+// Followed by the filtered line numbers.
+struct SidecarFilterHeader
+{
+	char aInputBuf[MAX_PATH * 2];
+	uint64_t EnableMask;
+	int FiltredLinesCount;
+};
+
+struct CrazyLog;
+
+// Shared between the main thread and the thread that writes the filtered lines to disk.
+// NOTE(matiasp): The log must not change while this is running, so streaming is paused
+// and anything that stomps the buffer cancels it first.
+struct SaveFileJob
+{
+	void* pFileHandle;
+	StreamFileFunc pStreamFileFunc;
+	CloseFileFunc pCloseFileFunc;
+	const CrazyLog* pLog;
+	ThreadPool* pWorkerPool;
+	ImVector<int> vLines;
+	int ExtraThreadCount;
+	bool bFailed;
+	
+	std::atomic<bool> bIsRunning;
+	std::atomic<bool> bShouldCancel;
+	std::atomic<int> SavedLinesCount;
+};
+
+// Shared between the main thread and the thread that gathers big filtered views for the clipboard.
+// Same as saving, the log must not change while this is running.
+struct CopyLinesJob
+{
+	const CrazyLog* pLog;
+	ThreadPool* pWorkerPool;
+	ImVector<int> vLines;
+	ImVector<char> vText;
+	int ExtraThreadCount;
+	int CopiedSize;
+	size_t MaxSize;
+	
+	std::atomic<bool> bIsRunning;
+	std::atomic<bool> bShouldCancel;
+	std::atomic<int> CopiedLinesCount;
+};
+
+// The first batches of a big filter run with these thread counts and time themselves.
+struct ThreadCountRamp
+{
+	int aThreadsCount[8];
+	float aSeconds[8];
+	int aSizes[8];
+	int StepsCount;
+	int DoneStepsCount;
+	int BatchChunksCount; // The same for every step, so they can be compared.
+	bool bIsFullRamp; // Otherwise it only checks that the tuned count still pays off.
+};
+
+// Shared between the main thread and the thread that filters big logs in the background.
+// NOTE(matiasp): The bytes it filters must stay where they are, so streaming is paused 
+// and anything that stomps the buffer cancels it first.
+struct FilterLinesJob
+{
+	ThreadPool* pWorkerPool;
+	const char* pBuf;
+	const char* pStart;
+	const char* pEnd;
+	int FirstLineNo;
+	int MaxLineSize;
+	int ExtraThreadCount;
+	bool bUseAVX;
+	GetWallClockFunc pGetWallClockFunc;
+	GetSecondsElapsedFunc pGetSecondsElapsedFunc;
+	
+	// Read by the main thread once it finished.
+	ThreadCountRamp Ramp;
+	
+	// A copy, the main thread is free to change its own while we filter.
+	CrazyTextFilter Filter;
+	
+	// Guarded by bIsLocked, the main thread takes them as every batch of chunks gets done.
+	ImVector<int> vPendingFiltredLines;
+	int FiltredLinesCount;
+	
+	std::atomic<bool> bIsRunning;
+	std::atomic<bool> bShouldCancel;
+	std::atomic<bool> bIsLocked;
+	std::atomic<int> FiltredSize;
+};
+
 struct CrazyLog
 {
 	ImGuiTextBuffer Buf;
 	CrazyTextFilter Filter;
+	
+	// NOTE(matiasp): When the sparse line index is enabled this only stores the offset
+	// of every LineIndexStride line, the rest are resolved on demand from the closest one.
 	ImVector<int> vLineOffsets; 
+	
+	// NOTE(matiasp): A line longer than MaxLineSize is split in virtual lines that are filtered, drawn and
+	// highlighted on their own. These are the sorted ones that go on with the line before them.
+	ImVector<int> vSplitLines;
 	ImVector<int> vFiltredLinesCached;
 	ImVector<int> vFindFiltredLinesCached;
 	ImVector<int> vFindFullViewLinesCached;
+	
+	// The lines the previous find text had, to look at again with the one that extends it.
+	ImVector<int> vFindFullViewNarrowLines;
+	
 	ImVector<NamedFilter> LoadedFilters;
+	ImVector<LogSegment> vLogSegments;
+	ImVector<char> vStreamTranscodeBuf;
+	ImVector<char> vSidecarFilters; // The filter entries of the sidecar index, as those are in the file.
 	ImVector<ImVec4> vDefaultColors;
 	ImVector<RecentInputText> avRecentInputText[RITT_COUNT];
 	int aRecentInputTextTail[RITT_COUNT];
 	
-	HighlightLineMatches TempLineMatches;
+	HighlightLineCache HighlightCache;
 	
 	char aNewVersion[MAX_PATH];
 	char aCurrentVersion[MAX_PATH];
@@ -183,20 +396,39 @@ struct CrazyLog
 	char aFolderQueryName[MAX_PATH * 2];
 	char aFilterNameToSave[MAX_PATH];
 	char aLastCommand[MAX_PATH * 2];
+	char aSidecarLogPath[MAX_PATH * 2]; // Empty when the loaded log can't have a sidecar index.
 	char aFindText[MAX_PATH * 2];
 	int FindTextLen;
+	int LinesCount;
+	int LineIndexStride;
+	int SparseLineIndexInterval;
+	int MaxLineSize; // Zero when the long lines are not split.
+	int SplitLineSizeKB;
+	int MaxCopySizeMB;
+	int LastResolvedLineNo;
+	int LastResolvedLineOffset;
 	int FilterToOverrideIdx;
 	int FilterSelectedIdx;
 	int FiltredLinesCount;
 	int FindFiltredProccesedLinesCount;
 	int FindFullViewProccesedLinesCount;
+	int FindFullViewNarrowedLinesCount;
 	int LastFetchFileSize;
+	int LogBOMSize;
+	int StreamFileStartSize; // Zero when the start of the streamed file as it was read is not known.
+	uint32_t StreamFileStartHash;
+	int LoadJobFiltredLinesCount;
+	int FilterJobFiltredLinesCount;
 	int LastFrameFiltersCount;
 	int SelectedExtraThreadCount;
 	int MaxExtraThreadCount;
+	int AutoExtraThreadCount;
+	int AutoThreadCountCores; // The hardware threads it was tuned with, zero if it never was.
+	int AutoThreadCountSpeedup; // Percent over a single thread it got when tuned.
 	int CurrentFindFiltredIdx;
 	int CurrentFindFullViewIdx;
 	TargetMode SelectedTargetMode;
+	TextEncoding LogEncoding;
 	TargetModeChangeReason LastChangeReason;
 	TargetModeChangeReason PendingModeChange;
 
@@ -206,11 +438,26 @@ struct CrazyLog
 	float FileContentFetchCooldown;
 	float FileContentFetchSlider;
 	float FolderFetchCooldown;
+	float FindTypingCooldown; // The find text is applied once it's been this long without typing.
 	float PeekScrollValue;
 	float FiltredScrollValue;
 	float FindScrollValue;
+	float FilterSecondsPerByte; // Measured on the last big filters, decides if it's worth to go wide.
 
 	FileData LastLoadedFileData;
+	FileIdentity StreamFileIdentity;
+	SidecarIndexHeader SidecarHeader; // What the sidecar index of the loaded log has to match.
+	LoadFileJob LoadJob;
+	SaveFileJob SaveJob;
+	CopyLinesJob CopyJob;
+	FilterLinesJob FilterJob;
+	LARGE_INTEGER FilterJobTimestamp;
+	ThreadPool WorkerPool;
+	MappedFile MappedLog;
+	UnmapFileFunc pUnmapFileFunc;
+	void* pStreamFileHandle;
+	CloseFileFunc pCloseFileFunc;
+	void* pFolderWatcher;
 	uint64_t EnableMask;
 
 	SelectionMode CurrentSelectionMode;
@@ -218,12 +465,28 @@ struct CrazyLog
 	Coordinates InteractiveStart, InteractiveEnd;
 	float LastClick;
 	int MouseOverLineIdx;
+	float MouseOverLineTextX;
 	
 	bool bShouldRememberLastSession;
 	bool bIsMultithreadEnabled;
+	bool bIsAutoThreadCountEnabled;
+	bool bWantsToTuneThreadCount;
+	bool bHasCheckedThreadCount;
 	bool bIsAVXEnabled;
+	bool bIsSparseLineIndexEnabled;
+	bool bIsLineSplitEnabled;
 	bool bAlreadyCached;
 	bool bFileLoaded;
+	bool bIsLoadingFile;
+	bool bIsLoadJobFiltering;
+	bool bIsSavingFile;
+	bool bReloadAfterSave;
+	bool bIsCopyingLines;
+	bool bIsFilteringLines;
+	bool bIsMemoryMappingEnabled;
+	bool bIsParallelPrefaultEnabled;
+	bool bIsSidecarIndexEnabled;
+	bool bSidecarIndexDirty; // The line index is not in the sidecar yet.
 	bool bFolderQuery;
 	bool bStreamMode;
 	bool bStreamFileLocked;
@@ -241,13 +504,38 @@ struct CrazyLog
 	void BuildFonts();
 	void GetVersions(PlatformContext* pPlatformCtx);
 	void Init(PlatformContext* pPlatformCtx);
+	void Shutdown(PlatformContext* pPlatformCtx);
 	void Clear();
 	
 	void LoadClipboard();
-	bool FetchFile(PlatformContext* pPlatformCtx);
+	bool FetchFile(PlatformContext* pPlatformCtx, bool bCheckIdentity);
+	void CloseStreamFile();
+	bool HasStreamFileStartChanged(PlatformContext* pPlatformCtx);
+	void KeepStreamFileStart(const char* pFileStart, int Size);
+	void ResetStreamedLog();
+	void DetectStreamFileEncoding(PlatformContext* pPlatformCtx);
+	size_t ReadStreamFileChunk(PlatformContext* pPlatformCtx, int* pContentSize);
 	bool LoadFile(PlatformContext* pPlatformCtx);
+	bool LoadFolderFiles(PlatformContext* pPlatformCtx);
+	void StartLoadJob(PlatformContext* pPlatformCtx, void* pFileHandle, size_t FileSize, CompressionType Compression, 
+	                  TextEncoding Encoding, int BOMSize, bool bIsMapped);
+	void UpdateLoadFile();
+	bool IsLoadJobFiltering();
+	void CancelLoadFile();
+	void UnmapLog(bool bKeepContent);
+	bool LoadSidecarIndex(PlatformContext* pPlatformCtx, size_t ContentSize);
+	void SaveSidecarIndex(PlatformContext* pPlatformCtx);
+	int FindSidecarFilter();
 	void SearchLatestFile(PlatformContext* pPlatformCtx);
+	void WatchFolder(PlatformContext* pPlatformCtx);
+	void UnwatchFolder(PlatformContext* pPlatformCtx);
 	void SaveFilteredView(PlatformContext* pPlatformCtx, char* pFilePath);
+	void UpdateSaveFile(PlatformContext* pPlatformCtx);
+	void CancelSaveFile();
+	void CopyFilteredLines();
+	void UpdateCopyLines();
+	void CancelCopyLines();
+	void SetClipboardLines(ImVector<char>* pvText, int Size);
 	
 	void LoadFilters(PlatformContext* pPlatformCtx);
 	void SaveLoadedFilters(PlatformContext* pPlatformCtx);
@@ -266,11 +554,33 @@ struct CrazyLog
 	void AddLog(const char* pFileContent, int FileSize);
 	void SetLog(const char* pFileContent, int FileSize);
 	
+	void IndexLines(int FromOffset);
+	void RebuildLineIndex();
+	const char* FindLineStart(int LineNo) const;
+	const char* FindLineEnd(int LineNo, const char* pLineStart) const;
+	const char* FindNextLineStart(const char* pLineStart) const;
+	int GetFileLineNo(int LineNo, bool* pOutIsSplit) const;
+	void GetLineRange(int LineNo, const char** ppLineStart, const char** ppLineEnd);
+	int FindLogSegment(int LineNo) const;
+	
 	void ClearCache();
 	void ClearFindCache(bool bOnlyFilter);
 	
 	void FilterLines(PlatformContext* pPlatformCtx);
+	void StartFilterJob(PlatformContext* pPlatformCtx, size_t PendingSize);
+	void PlanThreadCountRamp(size_t PendingSize);
+	void TuneThreadCount(PlatformContext* pPlatformCtx);
+	void ApplyAutoThreadCount();
+	void UpdateFilterLines(PlatformContext* pPlatformCtx);
+	bool IsFilterJobRunning();
+	void CancelFilterLines();
+	void FinishFilterLines();
 	void FindLines(PlatformContext* pPlatformCtx);
+	void SetFindText(const char* pText);
+	void NarrowFindLines();
+	void IntersectFindFiltredLines();
+	bool IsFindDone() const;
+	int CountFindOccurrences(int LineNo);
 
 	void SetLastCommand(const char* pLastCommand);
 	
@@ -278,6 +588,7 @@ struct CrazyLog
 	void Draw(float DeltaTime, PlatformContext* pPlatformCtx, const char* title, bool* pOpen = NULL);
 	void DrawFiltredView(PlatformContext* pPlatformCtx);
 	void DrawFullView(PlatformContext* pPlatformCtx);
+	void DrawLogSegmentGutter(int LineNo, int PrevLineNo);
 	void DrawTarget(float DeltaTime, PlatformContext* pPlatformCtx);
 	void DrawFind(float DeltaTime, PlatformContext* pPlatformCtx);
 	bool DrawFilters(float DeltaTime, PlatformContext* pPlatformCtx);
@@ -285,9 +596,9 @@ struct CrazyLog
 	bool DrawCherrypick(float DeltaTime, PlatformContext* pPlatformCtx);
 	void DrawMainBar(float DeltaTime, PlatformContext* pPlatformCtx);
 
-	void DrawColoredRangeAndSelection(const char* pRangeStart, const char* pRangeEnd, const ImVec4 RangeColor,
-									const char* pSelectionStart, const char* pSelectionEnd,
-									bool& bIsItemHovered);
+	bool DrawLogLine(int LineNo, const char* pLineStart, const char* pLineEnd,
+	                 const char* pSelectionStart, const char* pSelectionEnd,
+	                 bool bIsFindLine, bool bIsWindowHovered);
 
 
 	int GetLineMaxColumn(int aLine);
@@ -297,8 +608,6 @@ struct CrazyLog
 	void HandleMouseInputs();
 	
 	
-	void HighlightLine(const char* pLineStart, const char* pLineEnd);
-	
 	char* GetWordStart(const char* pLineStart, char* pWordCursor);
 	char* GetWordEnd(const char* pLineEnd, char* pWordCursor, int WordAmount);
 	void SelectCharsFromLine(PlatformContext* pPlatformCtx, const char* pLineStart, const char* pLineEnd, float xOffset);
@@ -306,10 +615,12 @@ struct CrazyLog
 	//Filters;
 	bool AnyFilterActive () const;
 	
-	void CacheHighlightLineMatches(const char* pLineBegin, const char* pLineEnd,
-	                               HighlightLineMatches* pFiltredLineMatch);
-	void CacheHighlightMatchingWord(const char* pLineBegin, const char* pLineEnd, 
-									const char* pWordBegin, const char* pWordEnd, 
-									int FilterIdx, HighlightLineMatches* pFiltredLineMatch);
+	void UpdateHighlightCache();
+	void ClearHighlightCache();
+	void BuildHighlightNeedles();
+	HighlightCacheEntry* GetHighlightCacheEntry(int LineNo, const char* pLineBegin, const char* pLineEnd);
+	void ResetHighlightCacheEntry(HighlightCacheEntry* pEntry, const char* pLineBegin, const char* pLineEnd);
+	const HighlightLineMatches* GetHighlightLineMatches(HighlightCacheEntry* pEntry, const char* pLineBegin, const char* pLineEnd,
+	                                                    int VisibleBegin, int VisibleEnd);
 
 };
\ No newline at end of file
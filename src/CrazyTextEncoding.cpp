@@ -0,0 +1,413 @@
+#include "CrazyTextEncoding.h"
+
+#define TEXT_ENCODING_MIN_SAMPLE_SIZE 16
+#define UTF16_MIN_ZEROS_PERCENT 40
+#define UTF16_MAX_STRAY_ZEROS_RATIO 16
+#define UTF8_REPLACEMENT_CHAR '?'
+#define UTF8_MAX_SEQUENCE_SIZE 4
+
+TextEncoding DetectTextEncoding(const uint8_t* pData, size_t Size, int* pOutBOMSize)
+{
+	*pOutBOMSize = 0;
+	
+	if (Size >= 3 && pData[0] == 0xEF && pData[1] == 0xBB && pData[2] == 0xBF)
+	{
+		*pOutBOMSize = 3;
+		return TE_UTF8;
+	}
+	
+	if (Size >= 2 && pData[0] == 0xFF && pData[1] == 0xFE)
+	{
+		*pOutBOMSize = 2;
+		return TE_UTF16LE;
+	}
+	
+	if (Size >= 2 && pData[0] == 0xFE && pData[1] == 0xFF)
+	{
+		*pOutBOMSize = 2;
+		return TE_UTF16BE;
+	}
+	
+	// NOTE(matiasp): Mostly ASCII text encoded as UTF-16 has a zero in every other byte,
+	// while UTF-8 text has no zeros at all.
+	if (Size < TEXT_ENCODING_MIN_SAMPLE_SIZE)
+		return TE_UTF8;
+	
+	size_t UnitsCount = Size / 2;
+	size_t aZerosCount[2] = { 0, 0 };
+	for (size_t i = 0; i < UnitsCount * 2; i++)
+		aZerosCount[i & 1] += pData[i] == 0 ? 1 : 0;
+	
+	size_t MinZerosCount = UnitsCount * UTF16_MIN_ZEROS_PERCENT / 100;
+	size_t MaxStrayZerosCount = UnitsCount / UTF16_MAX_STRAY_ZEROS_RATIO;
+	
+	if (aZerosCount[1] >= MinZerosCount && aZerosCount[0] <= MaxStrayZerosCount)
+		return TE_UTF16LE;
+	
+	if (aZerosCount[0] >= MinZerosCount && aZerosCount[1] <= MaxStrayZerosCount)
+		return TE_UTF16BE;
+	
+	return TE_UTF8;
+}
+
+//=============================================================
+// UTF-16 to UTF-8
+
+static uint32_t ReadUTF16Unit(const uint8_t* pUnit, bool bBigEndian)
+{
+	return bBigEndian ? ((uint32_t)pUnit[0] << 8) | pUnit[1] : pUnit[0] | ((uint32_t)pUnit[1] << 8);
+}
+
+static int WriteUTF8CodePoint(uint32_t CodePoint, char* pDest)
+{
+	if (CodePoint < 0x80)
+	{
+		pDest[0] = (char)CodePoint;
+		return 1;
+	}
+	
+	if (CodePoint < 0x800)
+	{
+		pDest[0] = (char)(0xC0 | (CodePoint >> 6));
+		pDest[1] = (char)(0x80 | (CodePoint & 0x3F));
+		return 2;
+	}
+	
+	if (CodePoint < 0x10000)
+	{
+		pDest[0] = (char)(0xE0 | (CodePoint >> 12));
+		pDest[1] = (char)(0x80 | ((CodePoint >> 6) & 0x3F));
+		pDest[2] = (char)(0x80 | (CodePoint & 0x3F));
+		return 3;
+	}
+	
+	pDest[0] = (char)(0xF0 | (CodePoint >> 18));
+	pDest[1] = (char)(0x80 | ((CodePoint >> 12) & 0x3F));
+	pDest[2] = (char)(0x80 | ((CodePoint >> 6) & 0x3F));
+	pDest[3] = (char)(0x80 | (CodePoint & 0x3F));
+	return 4;
+}
+
+// Transcodes 32 code units at once when all of them are ASCII, that is the common case for logs.
+static bool TranscodeASCIIBlockAVX(const uint8_t* pSrc, char* pDest, bool bBigEndian)
+{
+	__m256i First = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc));
+	__m256i Second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + 32));
+	
+	if (bBigEndian)
+	{
+		const __m256i SwapBytes = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		                                           1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+		First = _mm256_shuffle_epi8(First, SwapBytes);
+		Second = _mm256_shuffle_epi8(Second, SwapBytes);
+	}
+	
+	// Every bit but the lowest 7 of each code unit, 0xFF80.
+	const __m256i NonASCIIMask = _mm256_set1_epi16(-128);
+	if (!_mm256_testz_si256(_mm256_or_si256(First, Second), NonASCIIMask))
+		return false;
+	
+	// The pack works on each 128 bits lane, so the lanes end up interleaved.
+	__m256i Packed = _mm256_packus_epi16(First, Second);
+	Packed = _mm256_permute4x64_epi64(Packed, _MM_SHUFFLE(3, 1, 2, 0));
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest), Packed);
+	
+	return true;
+}
+
+int TranscodeUTF16ToUTF8(const char* pSrc, int SrcSize, char* pDest, int DestCapacity, int* pOutDestSize,
+                         TextEncoding Encoding, bool bIsLast, bool bUseAVX)
+{
+	const uint8_t* pUnits = (const uint8_t*)pSrc;
+	bool bBigEndian = Encoding == TE_UTF16BE;
+	int SrcIdx = 0;
+	int DestSize = 0;
+	
+	// After a block that is not all ASCII go one by one until its end, so we don't keep trying the same block.
+	int ScalarEndIdx = 0;
+	
+	while (SrcIdx < SrcSize)
+	{
+		if (bUseAVX && SrcIdx >= ScalarEndIdx && SrcSize - SrcIdx >= 64 && DestCapacity - DestSize >= 32)
+		{
+			if (TranscodeASCIIBlockAVX(pUnits + SrcIdx, pDest + DestSize, bBigEndian))
+			{
+				SrcIdx += 64;
+				DestSize += 32;
+				continue;
+			}
+			
+			ScalarEndIdx = SrcIdx + 64;
+		}
+		
+		if (DestCapacity - DestSize < UTF8_MAX_SEQUENCE_SIZE)
+			break;
+		
+		// A lonely byte at the very end is not a character.
+		if (SrcSize - SrcIdx < 2)
+		{
+			if (bIsLast)
+				SrcIdx = SrcSize;
+			
+			break;
+		}
+		
+		uint32_t Unit = ReadUTF16Unit(pUnits + SrcIdx, bBigEndian);
+		uint32_t CodePoint = Unit;
+		int UnitsSize = 2;
+		
+		if (Unit >= 0xD800 && Unit <= 0xDBFF)
+		{
+			// The other half of the pair comes in the next chunk.
+			if (SrcSize - SrcIdx < 4 && !bIsLast)
+				break;
+			
+			uint32_t NextUnit = SrcSize - SrcIdx >= 4 ? ReadUTF16Unit(pUnits + SrcIdx + 2, bBigEndian) : 0;
+			if (NextUnit >= 0xDC00 && NextUnit <= 0xDFFF)
+			{
+				CodePoint = 0x10000 + ((Unit - 0xD800) << 10) + (NextUnit - 0xDC00);
+				UnitsSize = 4;
+			}
+			else
+			{
+				CodePoint = 0xFFFD;
+			}
+		}
+		else if (Unit >= 0xDC00 && Unit <= 0xDFFF)
+		{
+			CodePoint = 0xFFFD;
+		}
+		
+		DestSize += WriteUTF8CodePoint(CodePoint, pDest + DestSize);
+		SrcIdx += UnitsSize;
+	}
+	
+	*pOutDestSize = DestSize;
+	return SrcIdx;
+}
+
+//=============================================================
+// UTF-8 validation
+
+static int GetUTF8LeadSize(uint8_t Lead)
+{
+	if (Lead >= 0xC2 && Lead <= 0xDF)
+		return 2;
+	
+	if (Lead >= 0xE0 && Lead <= 0xEF)
+		return 3;
+	
+	if (Lead >= 0xF0 && Lead <= 0xF4)
+		return 4;
+	
+	return 0;
+}
+
+// Returns 0 for overlongs, surrogates, code points past U+10FFFF and sequences cut by pTextEnd.
+static int GetValidUTF8SequenceSize(const uint8_t* pText, const uint8_t* pTextEnd)
+{
+	uint8_t Lead = pText[0];
+	int Size = GetUTF8LeadSize(Lead);
+	if (Size == 0 || pTextEnd - pText < Size)
+		return 0;
+	
+	uint8_t MinSecond = 0x80;
+	uint8_t MaxSecond = 0xBF;
+	if (Lead == 0xE0)
+		MinSecond = 0xA0;
+	else if (Lead == 0xED)
+		MaxSecond = 0x9F;
+	else if (Lead == 0xF0)
+		MinSecond = 0x90;
+	else if (Lead == 0xF4)
+		MaxSecond = 0x8F;
+	
+	if (pText[1] < MinSecond || pText[1] > MaxSecond)
+		return 0;
+	
+	for (int i = 2; i < Size; i++)
+	{
+		if ((pText[i] & 0xC0) != 0x80)
+			return 0;
+	}
+	
+	return Size;
+}
+
+static char* SanitizeUTF8Sequence(char* pText, char* pTextEnd, bool* pOutReplaced)
+{
+	int Size = GetValidUTF8SequenceSize((const uint8_t*)pText, (const uint8_t*)pTextEnd);
+	if (Size > 0)
+		return pText + Size;
+	
+	// Same size, so nothing that was already indexed moves.
+	*pText = UTF8_REPLACEMENT_CHAR;
+	if (pOutReplaced)
+		*pOutReplaced = true;
+	
+	return pText + 1;
+}
+
+// NOTE(matiasp): One pass for both, the same compare that looks for the new lines tells us
+// if the block is all ASCII, only the blocks that are not go through the validation.
+static char* FindNewLineSanitizeUTF8AVX(char* pText, char* pTextEnd, bool* pOutReplaced)
+{
+	const __m256i NewLine = _mm256_set1_epi8('\n');
+	
+	while (pText < pTextEnd)
+	{
+		if (pTextEnd - pText >= 32)
+		{
+			const __m256i Block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pText));
+			uint32_t Mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Block, NewLine)) |
+				(uint32_t)_mm256_movemask_epi8(Block);
+			
+			if (Mask == 0)
+			{
+				pText += 32;
+				continue;
+			}
+			
+			pText += GetFirstBitSet(Mask);
+		}
+		
+		if (*pText == '\n')
+			return pText;
+		
+		pText = (*pText & 0x80) ? SanitizeUTF8Sequence(pText, pTextEnd, pOutReplaced) : pText + 1;
+	}
+	
+	return pTextEnd;
+}
+
+static char* FindNewLineSanitizeUTF8Scalar(char* pText, char* pTextEnd, bool* pOutReplaced)
+{
+	const uint64_t LowBits = 0x0101010101010101llu;
+	const uint64_t HighBits = 0x8080808080808080llu;
+	const uint64_t NewLines = LowBits * '\n';
+	
+	while (pText < pTextEnd)
+	{
+		if (pTextEnd - pText >= 8)
+		{
+			uint64_t Word;
+			memcpy(&Word, pText, sizeof(Word));
+			
+			// A zero byte after the xor is a new line.
+			uint64_t NewLineBytes = Word ^ NewLines;
+			uint64_t HasNewLine = (NewLineBytes - LowBits) & ~NewLineBytes & HighBits;
+			
+			if (((Word & HighBits) | HasNewLine) == 0)
+			{
+				pText += 8;
+				continue;
+			}
+		}
+		
+		if (*pText == '\n')
+			return pText;
+		
+		pText = (*pText & 0x80) ? SanitizeUTF8Sequence(pText, pTextEnd, pOutReplaced) : pText + 1;
+	}
+	
+	return pTextEnd;
+}
+
+char* FindNewLineSanitizeUTF8(char* pText, char* pTextEnd, bool bUseAVX, bool* pOutReplaced)
+{
+	if (bUseAVX)
+		return FindNewLineSanitizeUTF8AVX(pText, pTextEnd, pOutReplaced);
+	
+	return FindNewLineSanitizeUTF8Scalar(pText, pTextEnd, pOutReplaced);
+}
+
+char* FindUTF8IncompleteStart(char* pTextStart, char* pPos)
+{
+	for (int i = 1; i < UTF8_MAX_SEQUENCE_SIZE && pPos - i >= pTextStart; i++)
+	{
+		uint8_t Byte = (uint8_t)pPos[-i];
+		if ((Byte & 0xC0) == 0x80)
+			continue;
+		
+		return GetUTF8LeadSize(Byte) > i ? pPos - i : pPos;
+	}
+	
+	return pPos;
+}
+
+int GetUTF8CharCells(char c)
+{
+	if ((c & 0xC0) == 0x80 || c == '\r')
+		return 0;
+	
+	return c == '\t' ? IM_TABSIZE : 1;
+}
+
+static int CountBlockCellsAVX(const char* pText)
+{
+	const __m256i Block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pText));
+	const __m256i LeadBits = _mm256_and_si256(Block, _mm256_set1_epi8((char)0xC0));
+	
+	uint32_t NoCellsMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(LeadBits, _mm256_set1_epi8((char)0x80))) |
+		(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Block, _mm256_set1_epi8('\r')));
+	uint32_t TabsMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Block, _mm256_set1_epi8('\t')));
+	
+	if ((NoCellsMask | TabsMask) == 0)
+		return 32;
+	
+	return 32 - (int)__popcnt(NoCellsMask) + (IM_TABSIZE - 1) * (int)__popcnt(TabsMask);
+}
+
+int CountTextCells(const char* pText, const char* pTextEnd, bool bUseAVX)
+{
+	int CellsCount = 0;
+	
+	if (bUseAVX)
+	{
+		for (; pTextEnd - pText >= 32; pText += 32)
+			CellsCount += CountBlockCellsAVX(pText);
+	}
+	
+	for (; pText < pTextEnd; pText++)
+		CellsCount += GetUTF8CharCells(*pText);
+	
+	return CellsCount;
+}
+
+// NOTE(matiasp): A block can end in the middle of a character, its bytes after the first take no cells
+// so it doesn't matter on which block they are counted.
+const char* SkipTextCells(const char* pText, const char* pTextEnd, int CellIdx, bool bUseAVX, int* pOutSkippedCells)
+{
+	int SkippedCells = 0;
+	
+	if (bUseAVX)
+	{
+		while (pTextEnd - pText >= 32)
+		{
+			int BlockCells = CountBlockCellsAVX(pText);
+			if (SkippedCells + BlockCells > CellIdx)
+				break;
+			
+			SkippedCells += BlockCells;
+			pText += 32;
+		}
+	}
+	
+	for (; pText < pTextEnd; pText++)
+	{
+		int CharCells = GetUTF8CharCells(*pText);
+		if (CharCells > 0 && SkippedCells + CharCells > CellIdx)
+			break;
+		
+		SkippedCells += CharCells;
+	}
+	
+	*pOutSkippedCells = SkippedCells;
+	return pText;
+}
+
+#undef TEXT_ENCODING_MIN_SAMPLE_SIZE
+#undef UTF16_MIN_ZEROS_PERCENT
+#undef UTF16_MAX_STRAY_ZEROS_RATIO
+#undef UTF8_REPLACEMENT_CHAR
+#undef UTF8_MAX_SEQUENCE_SIZE
@@ -0,0 +1,36 @@
+#pragma once
+
+enum TextEncoding
+{
+	TE_UTF8 = 0,
+	TE_UTF16LE,
+	TE_UTF16BE,
+
+	TE_COUNT
+};
+
+// Looks at the BOM, without one it guesses from the zeros of the ASCII characters encoded as UTF-16.
+TextEncoding DetectTextEncoding(const uint8_t* pData, size_t Size, int* pOutBOMSize);
+
+// Transcodes until pSrc or pDest runs out, returns how many bytes of pSrc were consumed.
+// Unless bIsLast, a surrogate pair or a code unit cut by the end of pSrc is left for the next call.
+int TranscodeUTF16ToUTF8(const char* pSrc, int SrcSize, char* pDest, int DestCapacity, int* pOutDestSize,
+                         TextEncoding Encoding, bool bIsLast, bool bUseAVX);
+
+// Returns the first new line in the range or pTextEnd, replacing on the way every byte of an invalid
+// UTF-8 sequence with '?'. A sequence cut by pTextEnd is not valid.
+// pOutReplaced is set to true when something was replaced, it's left untouched otherwise.
+char* FindNewLineSanitizeUTF8(char* pText, char* pTextEnd, bool bUseAVX, bool* pOutReplaced = nullptr);
+
+// If pPos lands in the middle of a sequence that starts after pTextStart returns where it starts, otherwise pPos.
+char* FindUTF8IncompleteStart(char* pTextStart, char* pPos);
+
+// Cells of a monospace grid the byte takes the way ImGui lays the text out. Only the first byte of a
+// character takes any, a carriage return takes none and a tab takes IM_TABSIZE.
+int GetUTF8CharCells(char c);
+
+int CountTextCells(const char* pText, const char* pTextEnd, bool bUseAVX);
+
+// Returns the character that covers the cell CellIdx, or pTextEnd when the text is not that wide.
+// pOutSkippedCells is set to how many cells come before it.
+const char* SkipTextCells(const char* pText, const char* pTextEnd, int CellIdx, bool bUseAVX, int* pOutSkippedCells);
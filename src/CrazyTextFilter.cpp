@@ -25,13 +25,41 @@ uint32_t GetFirstBitSet(const uint32_t value) {
 	return ctz(value);
 }
 
+// Returns a pointer to the first new line in the range or pTextEnd if there is none.
+const char* FindNewLineAVX(const char* pText, const char* pTextEnd)
+{
+	const __m256i NewLine = _mm256_set1_epi8('\n');
+	
+	while (pTextEnd - pText >= 32)
+	{
+		const __m256i Block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pText));
+		uint32_t Mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(Block, NewLine));
+		
+		if (Mask != 0)
+			return pText + GetFirstBitSet(Mask);
+		
+		pText += 32;
+	}
+	
+	const char* pNewLine = (const char*)memchr(pText, '\n', pTextEnd - pText);
+	return pNewLine ? pNewLine : pTextEnd;
+}
+
+const char* FindNewLine(const char* pText, const char* pTextEnd, bool bUseAVX)
+{
+	if (bUseAVX)
+		return FindNewLineAVX(pText, pTextEnd);
+	
+	const char* pNewLine = (const char*)memchr(pText, '\n', pTextEnd - pText);
+	return pNewLine ? pNewLine : pTextEnd;
+}
+
 bool HaystackContainsNeedleAVX(const char* pHaystack, size_t HaystackSize, const char* pNeedle, size_t NeedleSize, const char* pBufEnd)
 {
 	size_t LastIteration = HaystackSize / 32;
 	const bool bWillExceedBufEnd = (pHaystack + (LastIteration*32) + NeedleSize - 1 + 32) >= pBufEnd;
 	
 	constexpr uint64_t UpcaseMask = 0xdfdfdfdfdfdfdfdfllu; 
-	constexpr uint8_t UpcaseMask8 = 0xdf;
 	
 	const __m256i UpcaseMask256 = _mm256_set1_epi64x(UpcaseMask);
 	
@@ -40,8 +68,6 @@ bool HaystackContainsNeedleAVX(const char* pHaystack, size_t HaystackSize, const
 	First = _mm256_and_si256(First, UpcaseMask256);
 	Last = _mm256_and_si256(Last, UpcaseMask256);
 	
-	size_t LastCharIdxBetween = NeedleSize < 3 ? NeedleSize - 1 : NeedleSize - 2;
-	
 	if (!bWillExceedBufEnd) 
 	{
 		for (size_t i = 0; i < HaystackSize; i += 32) 
@@ -58,22 +84,15 @@ bool HaystackContainsNeedleAVX(const char* pHaystack, size_t HaystackSize, const
 
 				const uint32_t BitPos = GetFirstBitSet(Mask);
 		
-				const char* pSubStr = pHaystack + i + BitPos + 1;
+				const char* pSubStr = pHaystack + i + BitPos;
 		
 				// This is to avoid bleeding outside of the haystack size
-				if (&pSubStr[LastCharIdxBetween] > pHaystack + HaystackSize)
+				if (pSubStr + NeedleSize > pHaystack + HaystackSize)
 					return false;
 		
-				const char* pNeedleCursor = NeedleSize == 1 ? &pNeedle[0] : &pNeedle[1];
-				bool bMatchEntireWord = true;
-				for (size_t z = 0; z < LastCharIdxBetween; ++z) {
-					if ((pNeedleCursor[z] & UpcaseMask8) != (pSubStr[z] & UpcaseMask8)) {
-						bMatchEntireWord = false;
-						break;
-					}
-				}
-		
-				if (bMatchEntireWord)
+				// NOTE(matiasp): The mask folds more than the letters ('@' and '`', '[' and '{'...), so it only 
+				// gives us candidates. Checking them the same way ImStristr does keeps both searches finding the same.
+				if (ImStrnicmp(pNeedle, pSubStr, NeedleSize) == 0)
 					return true;
 		
 				Mask = ClearLeftMostSet(Mask);
@@ -144,6 +163,91 @@ bool HaystackContainsNeedle(const char* pHaystack, size_t HaystackSize, const ch
 	return false;
 }
 
+static bool NeedleMatchesAt(const char* pText, const TextNeedle* pNeedle)
+{
+	for (int i = 0; i < pNeedle->Size; i++)
+	{
+		if (ImToUpper(pText[i]) != ImToUpper(pNeedle->pText[i]))
+			return false;
+	}
+	
+	return true;
+}
+
+static void PushNeedleMatch(int Pos, const TextNeedle* pNeedle, HighlightLineMatches* pOut)
+{
+	pOut->vLineMatches.push_back(HighlightLineMatchEntry(pNeedle->FilterIdx, (uint16_t)Pos, (uint16_t)(Pos + pNeedle->Size - 1)));
+}
+
+void FindAllNeedles(const char* pHaystack, const char* pHaystackEnd, const TextNeedle* pNeedles, int NeedlesCount,
+                    bool bUseAVX, HighlightLineMatches* pOut)
+{
+	const int HaystackSize = (int)(pHaystackEnd - pHaystack);
+	
+	int MaxNeedleSize = 0;
+	for (int i = 0; i < NeedlesCount; i++)
+		MaxNeedleSize = pNeedles[i].Size > MaxNeedleSize ? pNeedles[i].Size : MaxNeedleSize;
+	
+	int Pos = 0;
+	
+	// NOTE(matiasp): One bit per needle and position in the masks, so it only goes wide with up to 32 needles.
+	if (bUseAVX && NeedlesCount <= 32)
+	{
+		const __m256i UpcaseMask256 = _mm256_set1_epi8((char)0xdf);
+		
+		__m256i aFirst[32];
+		__m256i aLast[32];
+		for (int i = 0; i < NeedlesCount; i++)
+		{
+			aFirst[i] = _mm256_and_si256(_mm256_set1_epi8(pNeedles[i].pText[0]), UpcaseMask256);
+			aLast[i] = _mm256_and_si256(_mm256_set1_epi8(pNeedles[i].pText[pNeedles[i].Size - 1]), UpcaseMask256);
+		}
+		
+		// The blocks stop where the last char of the longest needle would go past the end, the rest goes one by one.
+		for (; Pos + 32 + MaxNeedleSize - 1 <= HaystackSize; Pos += 32)
+		{
+			const __m256i BlockFirst = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pHaystack + Pos)), UpcaseMask256);
+			
+			uint32_t aMasks[32];
+			uint32_t AnyMask = 0;
+			for (int i = 0; i < NeedlesCount; i++)
+			{
+				const __m256i BlockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pHaystack + Pos + pNeedles[i].Size - 1));
+				
+				const __m256i EqualFirst = _mm256_cmpeq_epi8(aFirst[i], BlockFirst);
+				const __m256i EqualLast  = _mm256_cmpeq_epi8(aLast[i], _mm256_and_si256(BlockLast, UpcaseMask256));
+				
+				aMasks[i] = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(EqualFirst, EqualLast));
+				AnyMask |= aMasks[i];
+			}
+			
+			// Position by position, so the matches come out sorted.
+			while (AnyMask != 0)
+			{
+				const uint32_t BitPos = GetFirstBitSet(AnyMask);
+				const uint32_t Bit = 1u << BitPos;
+				
+				for (int i = 0; i < NeedlesCount; i++)
+				{
+					if ((aMasks[i] & Bit) && NeedleMatchesAt(pHaystack + Pos + BitPos, &pNeedles[i]))
+						PushNeedleMatch(Pos + (int)BitPos, &pNeedles[i], pOut);
+				}
+				
+				AnyMask = ClearLeftMostSet(AnyMask);
+			}
+		}
+	}
+	
+	for (; Pos < HaystackSize; Pos++)
+	{
+		for (int i = 0; i < NeedlesCount; i++)
+		{
+			if (pNeedles[i].Size <= HaystackSize - Pos && NeedleMatchesAt(pHaystack + Pos, &pNeedles[i]))
+				PushNeedleMatch(Pos, &pNeedles[i], pOut);
+		}
+	}
+}
+
 CrazyTextFilter::CrazyTextFilter(const char* pDefaultFilter) 
 {
 	aInputBuf[0] = 0;
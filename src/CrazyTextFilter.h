@@ -40,6 +40,40 @@ struct CrazyTextRangeSettings {
 	bool bIsEnabled;
 };
 
+struct HighlightLineMatchEntry
+{
+	const uint16_t WordBeginOffset;
+	const uint16_t WordEndOffset;
+	
+	uint8_t FilterIdxMatching;
+	
+	HighlightLineMatchEntry(uint8_t in_FilterIdx, const uint16_t in_WordBeginOffset, const uint16_t in_WordEndOffset) :
+							FilterIdxMatching(in_FilterIdx),
+							WordBeginOffset(in_WordBeginOffset),
+							WordEndOffset(in_WordEndOffset)
+	{
+	}
+};
+
+struct HighlightLineMatches
+{
+	ImVector<HighlightLineMatchEntry> vLineMatches;
+};
+
+// A word to look for in every position of a line, FilterIdx is what the matches of it are tagged with.
+struct TextNeedle
+{
+	const char* pText;
+	int Size;
+	uint8_t FilterIdx;
+};
+
+// Appends every match of every needle, overlapping ones too, without reading past pHaystackEnd.
+// None of the needles can be empty and they have to come sorted the longest first, then the matches come out sorted by where
+// they begin and the longest first when they begin at the same place.
+void FindAllNeedles(const char* pHaystack, const char* pHaystackEnd, const TextNeedle* pNeedles, int NeedlesCount,
+                    bool bUseAVX, HighlightLineMatches* pOut);
+
 struct CrazyTextFilter 
 {
 	CrazyTextFilter(const char* pDefaultFilter = "");
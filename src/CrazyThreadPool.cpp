@@ -0,0 +1,191 @@
+#include "CrazyThreadPool.h"
+
+struct PoolTaskBatch
+{
+	PoolTaskFunc pTaskFunc;
+	void* pUserData;
+	int TasksCount;
+	int MaxWorkersCount;
+
+	std::atomic<int> NextTaskIdx;
+	std::atomic<int> DoneTasksCount;
+
+	// Guarded by the pool mutex, the owner can't release the batch until it's back to zero.
+	int WorkersCount;
+	bool bIsQueued;
+};
+
+static void RunBatchTasks(PoolTaskBatch* pBatch)
+{
+	int DoneTasksCount = 0;
+	for (int TaskIdx = pBatch->NextTaskIdx.fetch_add(1); TaskIdx < pBatch->TasksCount;
+	     TaskIdx = pBatch->NextTaskIdx.fetch_add(1))
+	{
+		pBatch->pTaskFunc(pBatch->pUserData, TaskIdx);
+		DoneTasksCount++;
+	}
+
+	if (DoneTasksCount)
+		pBatch->DoneTasksCount.fetch_add(DoneTasksCount);
+}
+
+static PoolTaskBatch* FindBatchToJoin(ThreadPool* pPool)
+{
+	for (int i = 0; i < pPool->vBatches.Size; i++)
+	{
+		PoolTaskBatch* pBatch = pPool->vBatches[i];
+		if (pBatch->WorkersCount < pBatch->MaxWorkersCount && pBatch->NextTaskIdx.load() < pBatch->TasksCount)
+			return pBatch;
+	}
+
+	return nullptr;
+}
+
+static void PoolWorkerMT(ThreadPool* pPool)
+{
+	std::unique_lock<std::mutex> Lock(*pPool->pMutex);
+
+	while (true)
+	{
+		PoolTaskBatch* pBatch = FindBatchToJoin(pPool);
+		if (!pBatch)
+		{
+			if (pPool->bShouldStop)
+				return;
+
+			pPool->pWorkAvailable->wait(Lock);
+			continue;
+		}
+
+		pBatch->WorkersCount++;
+		Lock.unlock();
+
+		RunBatchTasks(pBatch);
+
+		Lock.lock();
+		pBatch->WorkersCount--;
+	}
+}
+
+void GrowThreadPool(ThreadPool* pPool, int WorkersCount)
+{
+	if (WorkersCount > THREAD_POOL_MAX_WORKERS)
+		WorkersCount = THREAD_POOL_MAX_WORKERS;
+
+	int CurrentCount = pPool->WorkersCount.load();
+	if (WorkersCount <= CurrentCount)
+		return;
+
+	if (!pPool->pMutex)
+	{
+		pPool->pMutex = IM_NEW(std::mutex)();
+		pPool->pWorkAvailable = IM_NEW(std::condition_variable)();
+		pPool->bShouldStop = false;
+	}
+
+	for (int i = CurrentCount; i < WorkersCount; i++)
+		pPool->aWorkers[i] = std::thread(PoolWorkerMT, pPool);
+
+	pPool->WorkersCount.store(WorkersCount);
+}
+
+void StopThreadPool(ThreadPool* pPool)
+{
+	if (!pPool->pMutex)
+		return;
+
+	{
+		std::lock_guard<std::mutex> Lock(*pPool->pMutex);
+		pPool->bShouldStop = true;
+	}
+	pPool->pWorkAvailable->notify_all();
+
+	int WorkersCount = pPool->WorkersCount.load();
+	for (int i = 0; i < WorkersCount; i++)
+		pPool->aWorkers[i].join();
+
+	pPool->WorkersCount.store(0);
+	pPool->vBatches.clear();
+
+	IM_DELETE(pPool->pWorkAvailable);
+	IM_DELETE(pPool->pMutex);
+	pPool->pWorkAvailable = nullptr;
+	pPool->pMutex = nullptr;
+}
+
+static void QueueBatch(ThreadPool* pPool, PoolTaskBatch* pBatch, PoolTaskFunc pTaskFunc, void* pUserData, int TasksCount, int MaxWorkersCount)
+{
+	pBatch->pTaskFunc = pTaskFunc;
+	pBatch->pUserData = pUserData;
+	pBatch->TasksCount = TasksCount;
+	pBatch->MaxWorkersCount = MaxWorkersCount;
+	pBatch->NextTaskIdx.store(0);
+	pBatch->DoneTasksCount.store(0);
+	pBatch->WorkersCount = 0;
+	pBatch->bIsQueued = pPool && pPool->WorkersCount.load() > 0 && TasksCount > 0 && MaxWorkersCount > 0;
+
+	if (!pBatch->bIsQueued)
+		return;
+
+	{
+		std::lock_guard<std::mutex> Lock(*pPool->pMutex);
+		pPool->vBatches.push_back(pBatch);
+	}
+
+	if (pBatch->MaxWorkersCount == 1)
+		pPool->pWorkAvailable->notify_one();
+	else
+		pPool->pWorkAvailable->notify_all();
+}
+
+// Takes what is left of the batch and waits for the workers to be done with it.
+static void FinishBatch(ThreadPool* pPool, PoolTaskBatch* pBatch)
+{
+	RunBatchTasks(pBatch);
+
+	if (!pBatch->bIsQueued)
+		return;
+
+	// The tasks that are left are already running on a worker.
+	while (pBatch->DoneTasksCount.load() < pBatch->TasksCount)
+		std::this_thread::yield();
+
+	std::unique_lock<std::mutex> Lock(*pPool->pMutex);
+	pPool->vBatches.find_erase(pBatch);
+	while (pBatch->WorkersCount > 0)
+	{
+		Lock.unlock();
+		std::this_thread::yield();
+		Lock.lock();
+	}
+}
+
+void RunPoolTasks(ThreadPool* pPool, PoolTaskFunc pTaskFunc, void* pUserData, int TasksCount, int MaxWorkersCount)
+{
+	if (!pPool || pPool->WorkersCount.load() == 0 || TasksCount < 2 || MaxWorkersCount < 1)
+	{
+		for (int i = 0; i < TasksCount; i++)
+			pTaskFunc(pUserData, i);
+
+		return;
+	}
+
+	// NOTE(matiasp): The calling thread takes tasks too, no point on waking more workers than that.
+	PoolTaskBatch Batch;
+	QueueBatch(pPool, &Batch, pTaskFunc, pUserData, TasksCount, MaxWorkersCount < TasksCount - 1 ? MaxWorkersCount : TasksCount - 1);
+	FinishBatch(pPool, &Batch);
+}
+
+PoolTaskBatch* StartPoolTasks(ThreadPool* pPool, PoolTaskFunc pTaskFunc, void* pUserData, int TasksCount, int MaxWorkersCount)
+{
+	// Nobody else takes tasks until it's finished, so every one of them can go to a worker.
+	PoolTaskBatch* pBatch = IM_NEW(PoolTaskBatch)();
+	QueueBatch(pPool, pBatch, pTaskFunc, pUserData, TasksCount, MaxWorkersCount < TasksCount ? MaxWorkersCount : TasksCount);
+	return pBatch;
+}
+
+void FinishPoolTasks(ThreadPool* pPool, PoolTaskBatch* pBatch)
+{
+	FinishBatch(pPool, pBatch);
+	IM_DELETE(pBatch);
+}
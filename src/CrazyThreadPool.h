@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define THREAD_POOL_MAX_WORKERS 32
+
+// Runs the task TaskIdx of a batch, the tasks of the same batch run at the same time on any thread.
+typedef void (*PoolTaskFunc)(void* pUserData, int TaskIdx);
+
+struct PoolTaskBatch;
+
+// NOTE(matiasp): The workers stay parked until there is a batch to run, so handing work over costs
+// a wake up instead of creating and joining threads every time.
+// Any thread can run a batch, the one that runs it takes tasks too.
+struct ThreadPool
+{
+	std::thread aWorkers[THREAD_POOL_MAX_WORKERS];
+	std::atomic<int> WorkersCount;
+
+	// Allocated when it starts, the pool lives in memory that never gets constructed.
+	std::mutex* pMutex;
+	std::condition_variable* pWorkAvailable;
+
+	// Guarded by pMutex.
+	ImVector<PoolTaskBatch*> vBatches;
+	bool bShouldStop;
+};
+
+// Only grows, from the main thread. Starts the pool if it's not running.
+void GrowThreadPool(ThreadPool* pPool, int WorkersCount);
+
+// Waits for the workers to finish what they are running, nothing can be running batches anymore.
+void StopThreadPool(ThreadPool* pPool);
+
+// Returns once the tasks in [0, TasksCount) ran, on at most MaxWorkersCount workers plus the calling thread.
+// Without a pool or any worker they all run on the calling thread.
+void RunPoolTasks(ThreadPool* pPool, PoolTaskFunc pTaskFunc, void* pUserData, int TasksCount, int MaxWorkersCount);
+
+// Same as RunPoolTasks but it returns right away, the workers run the tasks while the calling thread does something else.
+// The batch has to be handed to FinishPoolTasks, that runs what is left on the calling thread and waits for the rest.
+PoolTaskBatch* StartPoolTasks(ThreadPool* pPool, PoolTaskFunc pTaskFunc, void* pUserData, int TasksCount, int MaxWorkersCount);
+void FinishPoolTasks(ThreadPool* pPool, PoolTaskBatch* pBatch);
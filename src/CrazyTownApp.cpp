@@ -8,6 +8,9 @@
 
 #include "SharedDefinitions.cpp"
 #include "CrazyTextFilter.cpp"
+#include "CrazyThreadPool.cpp"
+#include "CrazyDecompressor.cpp"
+#include "CrazyTextEncoding.cpp"
 #include "CrazyLog.cpp"
 
 struct AppMemory 
@@ -66,11 +69,28 @@ void AppInit(PlatformContext* pPlatformCtx, PlatformReloadContext* pPlatformRelo
 	pMem->Log.BuildFonts();
 }
 
-void AppShutdown(PlatformReloadContext* pPlatformReloadCtx) {}
+void AppShutdown(PlatformContext* pPlatformCtx, PlatformReloadContext* pPlatformReloadCtx) 
+{
+	AppMemory *pMem = (AppMemory *)pPlatformCtx->pPermanentMemory;
+	pMem->Log.Shutdown(pPlatformCtx);
+}
 
-void AppOnHotReload(bool Started, PlatformReloadContext* pPlatformReloadCtx)
+void AppOnHotReload(bool Started, PlatformContext* pPlatformCtx, PlatformReloadContext* pPlatformReloadCtx)
 {
-	if (!Started) 
+	AppMemory *pMem = (AppMemory *)pPlatformCtx->pPermanentMemory;
+	
+	if (Started)
+	{
+		// The workers are running code from the dll we are about to unload, PreDraw starts them again.
+		// The filter job goes on from where it was left the next time the lines are filtered.
+		// The load, save and copy jobs run that code too, and those are not picked up again.
+		pMem->Log.CancelSaveFile();
+		pMem->Log.CancelCopyLines();
+		pMem->Log.CancelFilterLines();
+		pMem->Log.CancelLoadFile();
+		StopThreadPool(&pMem->Log.WorkerPool);
+	}
+	else 
 	{
 		ImGui::SetCurrentContext(pPlatformReloadCtx->pImGuiCtx);
 		ImGui::SetAllocatorFunctions(pPlatformReloadCtx->pImGuiAllocFunc, pPlatformReloadCtx->pImGuiFreeFunc);
@@ -189,7 +189,10 @@ void Win32GetExePath(char* pExePathBuffer, size_t BufferSize, size_t& OutPathSiz
 
 void* Win32GetFileHandle(char* pPath, unsigned CreationDisposition)
 {
-	HANDLE FileHandle =	CreateFileA(pPath, GENERIC_WRITE, 0, 0, CreationDisposition, 0, 0);
+	HANDLE FileHandle =	CreateFileA(pPath, GENERIC_WRITE, 0, 0, CreationDisposition, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+		return nullptr;
+	
 	return FileHandle;
 }
  
@@ -294,6 +297,184 @@ FileContent Win32ReadFile(char* pPath)
 	return Result;
 }
 
+void* Win32OpenFile(char* pPath, size_t* pOutFileSize)
+{
+	HANDLE FileHandle = CreateFileA(pPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+		return nullptr;
+	
+	LARGE_INTEGER FileSize;
+	if (!GetFileSizeEx(FileHandle, &FileSize))
+	{
+		CloseHandle(FileHandle);
+		return nullptr;
+	}
+	
+	*pOutFileSize = (size_t)FileSize.QuadPart;
+	return FileHandle;
+}
+
+bool Win32GetFileIdentity(char* pPath, FileIdentity* pOutIdentity)
+{
+	// No access rights needed just to query the attributes, so it doesn't bother the writer.
+	HANDLE FileHandle = CreateFileA(pPath, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, 0, 0);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	
+	BY_HANDLE_FILE_INFORMATION FileInfo;
+	bool bResult = GetFileInformationByHandle(FileHandle, &FileInfo) != 0;
+	if (bResult)
+	{
+		pOutIdentity->FileId = ((uint64_t)FileInfo.nFileIndexHigh << 32) | FileInfo.nFileIndexLow;
+		pOutIdentity->CreationTime = ((uint64_t)FileInfo.ftCreationTime.dwHighDateTime << 32) | FileInfo.ftCreationTime.dwLowDateTime;
+		pOutIdentity->LastWriteTime = ((uint64_t)FileInfo.ftLastWriteTime.dwHighDateTime << 32) | FileInfo.ftLastWriteTime.dwLowDateTime;
+		pOutIdentity->Size = ((uint64_t)FileInfo.nFileSizeHigh << 32) | FileInfo.nFileSizeLow;
+	}
+	
+	CloseHandle(FileHandle);
+	return bResult;
+}
+
+size_t Win32ReadFileChunk(void* pHandle, uint64_t Offset, void* pDest, size_t Size)
+{
+	OVERLAPPED Overlapped = {};
+	Overlapped.Offset = (DWORD)Offset;
+	Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+	
+	DWORD BytesRead = 0;
+	if (!ReadFile(pHandle, pDest, (DWORD)Size, &BytesRead, &Overlapped))
+		return 0;
+	
+	return BytesRead;
+}
+
+bool Win32GetOpenFileSize(void* pHandle, uint64_t* pOutSize)
+{
+	LARGE_INTEGER FileSize;
+	if (!GetFileSizeEx(pHandle, &FileSize))
+		return false;
+	
+	*pOutSize = (uint64_t)FileSize.QuadPart;
+	return true;
+}
+
+void Win32CloseFile(void* pHandle)
+{
+	CloseHandle(pHandle);
+}
+
+bool Win32MapFile(char* pPath, MappedFile* pOutMappedFile)
+{
+	HANDLE FileHandle = CreateFileA(pPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	
+	SYSTEM_INFO SystemInfo;
+	GetSystemInfo(&SystemInfo);
+	
+	bool bMapped = false;
+	LARGE_INTEGER FileSize;
+	
+	// NOTE(matiasp): The log expects a null terminator right after the content, the view only gives us that 
+	// (the zeroed tail of the last page) when the file doesn't end right on a page boundary.
+	if (GetFileSizeEx(FileHandle, &FileSize) && FileSize.QuadPart > 0 && (FileSize.QuadPart % SystemInfo.dwPageSize) != 0)
+	{
+		// Copy on write, so writing into the view never reaches the file.
+		HANDLE MappingHandle = CreateFileMappingA(FileHandle, 0, PAGE_WRITECOPY, 0, 0, 0);
+		if (MappingHandle)
+		{
+			void* pView = MapViewOfFile(MappingHandle, FILE_MAP_COPY, 0, 0, 0);
+			if (pView)
+			{
+				pOutMappedFile->pView = pView;
+				pOutMappedFile->Size = (size_t)FileSize.QuadPart;
+				bMapped = true;
+			}
+			
+			// The view keeps the mapping alive.
+			CloseHandle(MappingHandle);
+		}
+	}
+	
+	CloseHandle(FileHandle);
+	
+	return bMapped;
+}
+
+void Win32UnmapFile(MappedFile* pMappedFile)
+{
+	if (pMappedFile->pView)
+		UnmapViewOfFile(pMappedFile->pView);
+	
+	pMappedFile->pView = nullptr;
+	pMappedFile->Size = 0;
+}
+
+void Win32PrefetchMemory(void* pAddress, size_t Size)
+{
+	WIN32_MEMORY_RANGE_ENTRY Range;
+	Range.VirtualAddress = pAddress;
+	Range.NumberOfBytes = Size;
+	
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &Range, 0);
+}
+
+static int Win32CompareFileWriteTime(const void* pA, const void* pB)
+{
+	const FileData* pFileA = (const FileData*)pA;
+	const FileData* pFileB = (const FileData*)pB;
+	
+	return CompareFileTime((const FILETIME*)pFileA->FileTime.aWriteTime, (const FILETIME*)pFileB->FileTime.aWriteTime);
+}
+
+// Same query as Win32FetchLastFileFolder, returns how many files match it.
+// Only fills the output, sorted from the oldest to the newest, if all of them fit.
+int Win32ListFolderFiles(char* pFolderQuery, FileData* pOutFiles, int MaxFilesCount)
+{
+	size_t FolderPathLen = 0;
+	for (size_t i = StringUtils::Length(pFolderQuery); i != 0; i--)
+	{
+		if (pFolderQuery[i - 1] == '\\' || pFolderQuery[i - 1] == '/')
+		{
+			FolderPathLen = i;
+			break;
+		}
+	}
+	
+	WIN32_FIND_DATA FindData;
+	HANDLE hFind = FindFirstFile(pFolderQuery, &FindData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return 0;
+	
+	int FilesCount = 0;
+	do 
+	{
+		bool bIsDirectory = (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		bool bIsEmpty = FindData.nFileSizeLow == 0 && FindData.nFileSizeHigh == 0;
+		if (bIsDirectory || bIsEmpty)
+			continue;
+		
+		if (FilesCount < MaxFilesCount)
+		{
+			FileData* pFile = &pOutFiles[FilesCount];
+			memcpy(pFile->aFilePath, pFolderQuery, sizeof(char) * FolderPathLen);
+			strcpy_s(&pFile->aFilePath[FolderPathLen], sizeof(pFile->aFilePath) - FolderPathLen, FindData.cFileName);
+			memcpy(&pFile->FileTime.aWriteTime, &FindData.ftLastWriteTime, sizeof(FILETIME));
+			memcpy(&pFile->FileTime.aCreationTime, &FindData.ftCreationTime, sizeof(FILETIME));
+		}
+		
+		FilesCount++;
+	} 
+	while (FindNextFile(hFind, &FindData));
+	
+	FindClose(hFind);
+	
+	if (FilesCount <= MaxFilesCount)
+		qsort(pOutFiles, FilesCount, sizeof(FileData), Win32CompareFileWriteTime);
+	
+	return FilesCount;
+}
+
 bool Win32FetchLastFileFolder(char* pFolderQuery, FileData* pLastFileTimeData, FileData* pOutLastFileFolder)
 {
 	// Check the proper format
@@ -376,6 +557,110 @@ bool Win32FetchLastFileFolder(char* pFolderQuery, FileData* pLastFileTimeData, F
 	return bFoundNewFile;
 }
 
+struct Win32FolderWatcher
+{
+	HANDLE DirectoryHandle;
+	HANDLE ThreadHandle;
+	volatile LONG ChangeFlags;
+	volatile LONG bShouldStop;
+	DWORD aNotifyBuffer[1024];
+};
+
+DWORD WINAPI Win32FolderWatcherProc(LPVOID pParameter)
+{
+	Win32FolderWatcher* pWatcher = (Win32FolderWatcher*)pParameter;
+	DWORD NotifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+	DWORD BytesReturned = 0;
+	
+	// Blocks until something changes in the folder, we only tell apart a new file showing up
+	// from a file being written, the app figures out the rest in the next frame.
+	while (!pWatcher->bShouldStop && 
+	       ReadDirectoryChangesW(pWatcher->DirectoryHandle, pWatcher->aNotifyBuffer, sizeof(pWatcher->aNotifyBuffer), 
+	                             FALSE, NotifyFilter, &BytesReturned, 0, 0))
+	{
+		// NOTE(matiasp): Zero bytes means the buffer overflowed and the records were lost, so assume anything changed.
+		unsigned ChangeFlags = BytesReturned == 0 ? (unsigned)(FCF_NewFile | FCF_FileContent) : (unsigned)FCF_NONE;
+		
+		BYTE* pRecord = (BYTE*)pWatcher->aNotifyBuffer;
+		while (BytesReturned != 0)
+		{
+			FILE_NOTIFY_INFORMATION* pNotifyInfo = (FILE_NOTIFY_INFORMATION*)pRecord;
+			if (pNotifyInfo->Action == FILE_ACTION_ADDED || pNotifyInfo->Action == FILE_ACTION_RENAMED_NEW_NAME)
+				ChangeFlags |= FCF_NewFile;
+			else if (pNotifyInfo->Action == FILE_ACTION_MODIFIED)
+				ChangeFlags |= FCF_FileContent;
+			
+			if (pNotifyInfo->NextEntryOffset == 0)
+				break;
+			
+			pRecord += pNotifyInfo->NextEntryOffset;
+		}
+		
+		if (ChangeFlags != FCF_NONE)
+			InterlockedOr(&pWatcher->ChangeFlags, (LONG)ChangeFlags);
+	}
+	
+	return 0;
+}
+
+void* Win32WatchFolder(char* pFolderQuery)
+{
+	// We expect to receive FolderPath\*.extension, same as Win32FetchLastFileFolder
+	char aFolderPath[MAX_PATH] = { 0 };
+	size_t FolderQueryLen = StringUtils::Length(pFolderQuery);
+	for (size_t i = FolderQueryLen; i > 1; i--) 
+	{
+		if (pFolderQuery[i] == '.' && pFolderQuery[i-1] == '*') 
+		{
+			memcpy(aFolderPath, pFolderQuery, i - 1);
+			break;
+		}
+	}
+	
+	if (aFolderPath[0] == 0)
+		return nullptr;
+	
+	HANDLE DirectoryHandle = CreateFileA(aFolderPath, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 
+	                                     0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
+	if (DirectoryHandle == INVALID_HANDLE_VALUE)
+		return nullptr;
+	
+	Win32FolderWatcher* pWatcher = (Win32FolderWatcher*)VirtualAlloc(0, sizeof(Win32FolderWatcher), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+	pWatcher->DirectoryHandle = DirectoryHandle;
+	pWatcher->ThreadHandle = CreateThread(0, 0, Win32FolderWatcherProc, pWatcher, 0, 0);
+	
+	if (!pWatcher->ThreadHandle)
+	{
+		CloseHandle(DirectoryHandle);
+		VirtualFree(pWatcher, 0, MEM_RELEASE);
+		return nullptr;
+	}
+	
+	return pWatcher;
+}
+
+unsigned Win32PollFolderChanges(void* pWatcherHandle)
+{
+	Win32FolderWatcher* pWatcher = (Win32FolderWatcher*)pWatcherHandle;
+	return (unsigned)InterlockedExchange(&pWatcher->ChangeFlags, 0);
+}
+
+void Win32UnwatchFolder(void* pWatcherHandle)
+{
+	Win32FolderWatcher* pWatcher = (Win32FolderWatcher*)pWatcherHandle;
+	InterlockedExchange(&pWatcher->bShouldStop, 1);
+	
+	// The thread could be just about to block again, so keep cancelling until it's gone.
+	do
+	{
+		CancelIoEx(pWatcher->DirectoryHandle, 0);
+	} while (WaitForSingleObject(pWatcher->ThreadHandle, 10) == WAIT_TIMEOUT);
+	
+	CloseHandle(pWatcher->ThreadHandle);
+	CloseHandle(pWatcher->DirectoryHandle);
+	VirtualFree(pWatcher, 0, MEM_RELEASE);
+}
+
 
 
 bool Win32FileDialogOpen(DWORD Options, char* aOutPath, size_t PathCapacity)
@@ -409,7 +694,8 @@ bool Win32FileDialogOpen(DWORD Options, char* aOutPath, size_t PathCapacity)
 						{
 							{L"All Documents (*.*)",         L"*.*"},
 							{L"Text Document (*.txt)",       L"*.txt"},
-							{L"Log Document (*.log)",       L"*.log"}
+							{L"Log Document (*.log)",       L"*.log"},
+							{L"Compressed Log (*.gz;*.lz4)", L"*.gz;*.lz4"}
 						};
 
 						hr = pFileDialog->SetFileTypes(ARRAYSIZE(aFileTypes), aFileTypes);
@@ -775,12 +1061,24 @@ int WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int S
 	//==================================================
 	
 	gPlatformContext.pReadFileFunc = Win32ReadFile;
+	gPlatformContext.pOpenFileFunc = Win32OpenFile;
+	gPlatformContext.pReadFileChunkFunc = Win32ReadFileChunk;
+	gPlatformContext.pGetOpenFileSizeFunc = Win32GetOpenFileSize;
+	gPlatformContext.pCloseFileFunc = Win32CloseFile;
+	gPlatformContext.pMapFileFunc = Win32MapFile;
+	gPlatformContext.pUnmapFileFunc = Win32UnmapFile;
+	gPlatformContext.pPrefetchMemoryFunc = Win32PrefetchMemory;
 	gPlatformContext.pWriteFileFunc = Win32WriteFile;
 	gPlatformContext.pStreamFileFunc = Win32StreamFile;
 	gPlatformContext.pGetFileHandleFunc = Win32GetFileHandle;
 	gPlatformContext.pGetExePathFunc = Win32GetExePath;
 	gPlatformContext.pFreeFileContentFunc = Win32FreeFile;
 	gPlatformContext.pFetchLastFileFolderFunc = Win32FetchLastFileFolder;
+	gPlatformContext.pListFolderFilesFunc = Win32ListFolderFiles;
+	gPlatformContext.pGetFileIdentityFunc = Win32GetFileIdentity;
+	gPlatformContext.pWatchFolderFunc = Win32WatchFolder;
+	gPlatformContext.pPollFolderChangesFunc = Win32PollFolderChanges;
+	gPlatformContext.pUnwatchFolderFunc = Win32UnwatchFolder;
 	gPlatformContext.pOpenURLFunc = Win32OpenURL;
 	gPlatformContext.pGetWallClockFunc = Win32GetWallClock;
 	gPlatformContext.pGetSecondsElapsedFunc = Win32GetSecondsElapsed;
@@ -850,10 +1148,10 @@ int WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int S
 			if (!BuildingMarkerExist) 
 			{
 				OutputDebugStringA("Reloading! \n");
-				gHotReloadableCode.pOnHotReloadFunc(true, &gPlatformReloadContext);
+				gHotReloadableCode.pOnHotReloadFunc(true, &gPlatformContext, &gPlatformReloadContext);
 				UnloadHotReloadDLL(&gHotReloadableCode);
 				gHotReloadableCode = HotReloadDll(aHotReloadDLLFullPath, aHotReloadTempDLLFullPath);
-				gHotReloadableCode.pOnHotReloadFunc(false, &gPlatformReloadContext);
+				gHotReloadableCode.pOnHotReloadFunc(false, &gPlatformContext, &gPlatformReloadContext);
 			}
 		}
 		
@@ -950,7 +1248,7 @@ int WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int S
 		LastCounter = EndCounter;
 	};
 	
-	gHotReloadableCode.pShutdownFunc(&gPlatformReloadContext);
+	gHotReloadableCode.pShutdownFunc(&gPlatformContext, &gPlatformReloadContext);
 	
 	if (DragDrop.m_hWnd != 0) {
 		RevokeDragDrop(hwnd);
@@ -6,9 +6,9 @@ typedef void PreInitFunc(size_t* OutPermanentMemorySize, size_t* OutScratchMemor
 typedef void InitFunc(PlatformContext*, PlatformReloadContext*);
 typedef void PreUpdateFunc(PlatformContext*);
 typedef void UpdateFunc(float, PlatformContext*);
-typedef void OnHotReloadFunc(bool, PlatformReloadContext*);
+typedef void OnHotReloadFunc(bool, PlatformContext*, PlatformReloadContext*);
 typedef void OnDropFunc(PlatformContext*, char*);
-typedef void ShutdownFunc(PlatformReloadContext*);
+typedef void ShutdownFunc(PlatformContext*, PlatformReloadContext*);
 
 struct HotReloadableDll 
 {
@@ -49,12 +49,35 @@ struct FileContent
 	void* pFile;
 };
 
+struct MappedFile 
+{
+	size_t Size;
+	void* pView;
+};
+
 struct FileTimeData
 {
 	unsigned long aWriteTime[2];
 	unsigned long aCreationTime[2];
 };
 
+// What tells apart a file that was replaced by another one with the same name.
+struct FileIdentity
+{
+	uint64_t FileId;
+	uint64_t CreationTime;
+	uint64_t LastWriteTime;
+	uint64_t Size;
+};
+
+// What the folder watcher saw since the last time it was polled.
+enum FolderChangeFlags : unsigned
+{
+	FCF_NONE = 0,
+	FCF_NewFile = 1 << 0,
+	FCF_FileContent = 1 << 1,
+};
+
 struct FileData 
 {
 	FileTimeData FileTime;
@@ -78,6 +101,18 @@ typedef void*   (*AllocFunc)(size_t Size, void* pUserData);
 typedef void    (*FreeFunc)(void* pLocation, void* pUserData); 
 
 typedef FileContent    (*ReadFileFunc)(char* pPath);
+typedef void*          (*OpenFileFunc)(char* pPath, size_t* pOutFileSize);
+typedef size_t         (*ReadFileChunkFunc)(void* pHandle, uint64_t Offset, void* pDest, size_t Size);
+typedef bool           (*GetOpenFileSizeFunc)(void* pHandle, uint64_t* pOutSize);
+typedef void           (*CloseFileFunc)(void* pHandle);
+typedef bool           (*MapFileFunc)(char* pPath, MappedFile* pOutMappedFile);
+typedef void           (*UnmapFileFunc)(MappedFile* pMappedFile);
+typedef void           (*PrefetchMemoryFunc)(void* pAddress, size_t Size);
+typedef void*          (*WatchFolderFunc)(char* pFolderQuery);
+typedef unsigned       (*PollFolderChangesFunc)(void* pWatcher);
+typedef void           (*UnwatchFolderFunc)(void* pWatcher);
+typedef int            (*ListFolderFilesFunc)(char* pFolderQuery, FileData* pOutFiles, int MaxFilesCount);
+typedef bool           (*GetFileIdentityFunc)(char* pPath, FileIdentity* pOutIdentity);
 typedef bool           (*WriteFileFunc)(FileContent* pFileContent, char* pPath);
 typedef bool           (*StreamFileFunc)(FileContent* pFileContent, void* pHandle, bool bShouldCloseHandle);
 typedef void           (*GetExePathFunc)(char* pExePathBuffer, size_t BufferSize, size_t& OutPathSize, bool bIncludeFilename);
@@ -109,12 +144,24 @@ struct PlatformContext
 	ScratchMemory ScratchMem;
 	
 	ReadFileFunc pReadFileFunc;
+	OpenFileFunc pOpenFileFunc;
+	ReadFileChunkFunc pReadFileChunkFunc;
+	GetOpenFileSizeFunc pGetOpenFileSizeFunc;
+	CloseFileFunc pCloseFileFunc;
+	MapFileFunc pMapFileFunc;
+	UnmapFileFunc pUnmapFileFunc;
+	PrefetchMemoryFunc pPrefetchMemoryFunc;
+	WatchFolderFunc pWatchFolderFunc;
+	PollFolderChangesFunc pPollFolderChangesFunc;
+	UnwatchFolderFunc pUnwatchFolderFunc;
 	WriteFileFunc pWriteFileFunc;
 	StreamFileFunc pStreamFileFunc;
 	GetFileHandleFunc pGetFileHandleFunc;
 	GetExePathFunc pGetExePathFunc;
 	FreeFileContentFunc pFreeFileContentFunc;
 	FetchLastFileFolderFunc pFetchLastFileFolderFunc;
+	ListFolderFilesFunc pListFolderFilesFunc;
+	GetFileIdentityFunc pGetFileIdentityFunc;
 	OpenURLFunc pOpenURLFunc;
 	GetWallClockFunc pGetWallClockFunc;
 	GetSecondsElapsedFunc pGetSecondsElapsedFunc;